@@ -1,10 +1,10 @@
 SET commonflags=-Wall -Wextra -Werror -g
-SET sources=./src/main.c ./src/lexer.c ./src/read.c ./src/astron.c ./src/common.c ./src/eval.c ./src/print.c ./src/son.c ./src/lir.c ./src/value.c ./src/vm.c ./src/gc.c ./src/platform_win32.c
+SET sources=./src/main.c ./src/lexer.c ./src/read.c ./src/astron.c ./src/common.c ./src/eval.c ./src/print.c ./src/son.c ./src/lir.c ./src/lir_opt.c ./src/lir_reg.c ./src/lir_verify.c ./src/lir_cache.c ./src/image.c ./src/expand.c ./src/port.c ./src/value.c ./src/persistent.c ./src/vm.c ./src/gc.c ./src/platform_win32.c
 
 IF "%1" == release (
     clang -o ananas.exe %commonflags% -O2 %sources%
 ) ELSE IF "%1" == san (
-    clang -o ananas.exe %commonflags% -fsanitize=address -DANANAS_REPLACE_ARENA_WITH_MALLOC -O0 %sources%
+    clang -o ananas.exe %commonflags% -fsanitize=address -DANANAS_REPLACE_ARENA_WITH_MALLOC -DANANAS_VM_CHECKED -O0 %sources%
 ) ELSE (
-    clang -o ananas.exe %commonflags% -O0 %sources%
+    clang -o ananas.exe %commonflags% -DANANAS_VM_CHECKED -O0 %sources%
 )
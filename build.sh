@@ -2,13 +2,13 @@
 
 set -xe
 
-commonflags="-Wall -Wextra -Werror -g"
-sources="./src/main.c ./src/lexer.c ./src/read.c ./src/astron.c ./src/common.c ./src/eval.c ./src/print.c ./src/son.c ./src/lir.c ./src/value.c ./src/vm.c ./src/gc.c ./src/platform_linux_glibc.c"
+commonflags="-Wall -Wextra -Werror -g -pthread"
+sources="./src/main.c ./src/lexer.c ./src/read.c ./src/astron.c ./src/common.c ./src/eval.c ./src/print.c ./src/son.c ./src/lir.c ./src/lir_opt.c ./src/lir_reg.c ./src/lir_verify.c ./src/lir_cache.c ./src/image.c ./src/expand.c ./src/port.c ./src/value.c ./src/persistent.c ./src/vm.c ./src/gc.c ./src/platform_linux_glibc.c"
 
 if [ "$1" = "release" ]; then
     clang -o ananas $commonflags -O2 $sources
 elif [ "$1" = "san" ]; then
-    clang -o ananas $commonflags -fsanitize=address -DANANAS_REPLACE_ARENA_WITH_MALLOC -O0 $sources
+    clang -o ananas $commonflags -fsanitize=address -DANANAS_REPLACE_ARENA_WITH_MALLOC -DANANAS_VM_CHECKED -O0 $sources
 else
-    clang -o ananas $commonflags -O0 $sources
+    clang -o ananas $commonflags -DANANAS_VM_CHECKED -O0 $sources
 fi
@@ -4,6 +4,11 @@
 
 #include <stdarg.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ANANAS_COMMON_SSE2
+#endif
+
 #define PAGE_SIZE 4096
 
 void AnanasArenaInit(AnanasArena *arena, UZ cap) {
@@ -62,25 +67,107 @@ HeliosAllocator AnanasArenaToHeliosAllocator(AnanasArena *arena) {
     };
 }
 
+// NOTE: Formats straight into the error buffer without touching the temporary allocator, so
+// readers running on several threads can report errors at the same time.
 void AnanasErrorContextMessage(AnanasErrorContext *ctx, U32 row, U32 col, const char *fmt, ...) {
     ctx->ok = 0;
 
-    HeliosAllocator temp_alloc = HeliosGetTempAllocator();
+    char *buffer = (char *)ctx->error_buffer.data;
+    UZ buffer_count = ctx->error_buffer.count;
 
-    UZ fmt_buffer_count = strlen(fmt) + ctx->place.count + 50;
-    U8 *fmt_buffer = HeliosAlloc(temp_alloc, fmt_buffer_count + 1);
-    snprintf((char *)fmt_buffer,
-             fmt_buffer_count,
-             HELIOS_SV_FMT ":%u:%u: %s",
-             HELIOS_SV_ARG(ctx->place),
-             row,
-             col,
-             fmt);
+    int prefix_count = snprintf(buffer,
+                                buffer_count,
+                                HELIOS_SV_FMT ":%u:%u: ",
+                                HELIOS_SV_ARG(ctx->place),
+                                row,
+                                col);
+    if (prefix_count < 0 || (UZ)prefix_count >= buffer_count) return;
 
     va_list args;
     va_start(args, fmt);
-    vsnprintf((char *)ctx->error_buffer.data, ctx->error_buffer.count, (const char *)fmt_buffer, args);
+    vsnprintf(buffer + prefix_count, buffer_count - prefix_count, fmt, args);
     va_end(args);
 }
 
 ERMIS_IMPL_ARRAY(U8, AnanasDString)
+
+void AnanasDStringAppend(AnanasDString *str, const void *data, UZ count) {
+    AnanasDStringPushMany(str, data, count);
+}
+
+// NOTE: Single bytes are left to `memchr`. Longer needles are filtered 16 positions at a
+// time by comparing both their first and their last byte, and only the positions where
+// both match are compared in full, which keeps the search close to linear on real text.
+B32 AnanasStringViewFind(HeliosStringView haystack, HeliosStringView needle, UZ *out_index) {
+    if (needle.count == 0) {
+        *out_index = 0;
+        return 1;
+    }
+
+    if (needle.count > haystack.count) return 0;
+
+    if (needle.count == 1) {
+        const U8 *found = memchr(haystack.data, needle.data[0], haystack.count);
+        if (found == NULL) return 0;
+
+        *out_index = found - haystack.data;
+        return 1;
+    }
+
+    UZ last = needle.count - 1;
+    UZ positions_count = haystack.count - last;
+    UZ i = 0;
+
+#ifdef ANANAS_COMMON_SSE2
+    __m128i first_byte = _mm_set1_epi8((char)needle.data[0]);
+    __m128i last_byte = _mm_set1_epi8((char)needle.data[last]);
+
+    for (; i + 16 <= positions_count; i += 16) {
+        __m128i firsts = _mm_loadu_si128((const __m128i *)(haystack.data + i));
+        __m128i lasts = _mm_loadu_si128((const __m128i *)(haystack.data + i + last));
+        U32 mask = (U32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(firsts, first_byte),
+                                                        _mm_cmpeq_epi8(lasts, last_byte)));
+
+        while (mask != 0) {
+            UZ candidate = i + (UZ)__builtin_ctz(mask);
+            if (memcmp(haystack.data + candidate + 1, needle.data + 1, last - 1) == 0) {
+                *out_index = candidate;
+                return 1;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+#endif // ANANAS_COMMON_SSE2
+
+    while (i < positions_count) {
+        const U8 *found = memchr(haystack.data + i, needle.data[0], positions_count - i);
+        if (found == NULL) return 0;
+
+        UZ candidate = found - haystack.data;
+        if (haystack.data[candidate + last] == needle.data[last]
+            && memcmp(haystack.data + candidate + 1, needle.data + 1, last - 1) == 0) {
+            *out_index = candidate;
+            return 1;
+        }
+
+        i = candidate + 1;
+    }
+
+    return 0;
+}
+
+static B32 AnanasIsTrimmed(U8 c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+HeliosStringView AnanasStringViewTrim(HeliosStringView sv) {
+    while (sv.count > 0 && AnanasIsTrimmed(sv.data[0])) {
+        ++sv.data;
+        --sv.count;
+    }
+
+    while (sv.count > 0 && AnanasIsTrimmed(sv.data[sv.count - 1])) --sv.count;
+
+    return sv;
+}
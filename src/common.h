@@ -24,6 +24,8 @@ HELIOS_INLINE void AnanasErrorContextInit(AnanasErrorContext *ctx, U8 *err_buf,
 
 ERMIS_DECL_ARRAY(U8, AnanasDString)
 
+void AnanasDStringAppend(AnanasDString *str, const void *data, UZ count);
+
 void AnanasErrorContextMessage(AnanasErrorContext *ctx, U32 row, U32 col, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
 
 typedef struct {
@@ -61,4 +63,14 @@ static inline U64 AnanasFnv1Hash(HeliosStringView sv) {
     return hash;
 }
 
+// NOTE: Finds the first occurrence of `needle` in `haystack`. An empty needle is found at 0.
+B32 AnanasStringViewFind(HeliosStringView haystack, HeliosStringView needle, UZ *out_index);
+
+// NOTE: Drops spaces, tabs, carriage returns and newlines from both ends.
+HeliosStringView AnanasStringViewTrim(HeliosStringView sv);
+
+static inline U64 AnanasPointerHash(const void *ptr) {
+    return (U64)((UZ)ptr >> 3) * 0x9E3779B97F4A7C15ull;
+}
+
 #endif // ANANAS_COMMON_H_
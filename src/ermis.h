@@ -16,6 +16,7 @@
                                                                         \
     void arrname##Init(arrname *arr, HeliosAllocator allocator, UZ cap); \
     void arrname##Push(arrname *arr, T item);                           \
+    void arrname##PushMany(arrname *arr, const T *items, UZ count);     \
     void arrname##OrderedRemove(arrname *arr, UZ idx);                  \
     void arrname##UnorderedRemove(arrname *arr, UZ idx);                \
                                                                         \
@@ -54,6 +55,19 @@
         }                                                               \
                                                                         \
         arr->items[arr->count++] = item;                                \
+    }                                                                   \
+                                                                        \
+    /* NOTE: Grows at most once and copies the items with a single memcpy. */ \
+    void arrname##PushMany(arrname *arr, const T *items, UZ count) {    \
+        if (count == 0) return;                                         \
+        if (arr->count + count > arr->capacity) {                       \
+            UZ new_capacity = HELIOS_MAX(ERMIS_ARRAY_GROW_FACTOR(arr->capacity), arr->count + count); \
+            arr->items = HeliosRealloc(arr->allocator, arr->items, sizeof(T) * arr->capacity, sizeof(T) * new_capacity); \
+            arr->capacity = new_capacity;                               \
+        }                                                               \
+                                                                        \
+        memcpy(arr->items + arr->count, items, sizeof(T) * count);      \
+        arr->count += count;                                            \
     }                                                                   \
     \
     void arrname##OrderedRemove(arrname *arr, UZ idx) { \
@@ -70,12 +84,14 @@
         U8 *meta;                                                       \
         UZ capacity;                                                    \
         UZ count;                                                       \
+        UZ tombstones;                                                  \
         HeliosAllocator allocator;                                      \
     } hashmapname;                                                      \
                                                                         \
     void hashmapname##Init(hashmapname *map, HeliosAllocator allocator, UZ cap); \
     B32 hashmapname##Insert(hashmapname *map, K key, V value);          \
     V *hashmapname##FindPtr(hashmapname *map, K key);                   \
+    B32 hashmapname##Remove(hashmapname *map, K key);                   \
     void hashmapname##Clear(hashmapname *map);                          \
                                                                         \
     HELIOS_INLINE B32 hashmapname##Find(hashmapname *map, K key, V *value) { \
@@ -99,6 +115,9 @@
 #define ERMIS_HASHMAP_GROW_FACTOR(x) ((x) * 3)
 
 #define ERMIS_HASH_OCCUPIED (1 << 0)
+// NOTE: A removed slot keeps the probe chains running through it intact, lookups only stop
+// at slots that were never occupied.
+#define ERMIS_HASH_TOMBSTONE (1 << 1)
 
 #define ERMIS_HASHMAP_FOREACH(hashmap, keyname, valuename, body)        \
     for (UZ _idx = 0; _idx < (hashmap)->capacity; ++_idx) {             \
@@ -116,12 +135,15 @@
         map->values = HeliosAlloc(allocator, sizeof(V) * map->capacity);          \
         map->meta = HeliosAlloc(allocator, sizeof(map->meta[0]) * map->capacity); \
         map->count = 0;                                                 \
+        map->tombstones = 0;                                            \
     }                                                                   \
                                                                         \
     int hashmapname##Insert(hashmapname *map, K key, V value) {         \
-        UZ load_percentage = map->count * 100 / map->capacity;          \
+        UZ load_percentage = (map->count + map->tombstones) * 100 / map->capacity; \
         if (load_percentage >= 70) {                                    \
-            UZ new_cap = ERMIS_HASHMAP_GROW_FACTOR(map->capacity);      \
+            /* NOTE: a map that is mostly tombstones is rehashed in place */ \
+            UZ live_percentage = map->count * 100 / map->capacity;      \
+            UZ new_cap = live_percentage >= 35 ? ERMIS_HASHMAP_GROW_FACTOR(map->capacity) : map->capacity; \
             hashmapname new_map;                                        \
             hashmapname##Init(&new_map, map->allocator, new_cap);       \
                                                                         \
@@ -134,22 +156,30 @@
         }                                                               \
                                                                         \
         U64 idx = hashfunc(key) % map->capacity;                        \
+        SZ tombstone_idx = -1;                                          \
                                                                         \
         do {                                                            \
-            if ((map->meta[idx] & ERMIS_HASH_OCCUPIED) == 0) {          \
+            if (map->meta[idx] & ERMIS_HASH_OCCUPIED) {                 \
+                if (eqfunc(map->keys[idx], key)) {                      \
+                    map->keys[idx] = key;                               \
+                    map->values[idx] = value;                           \
+                    return 0;                                           \
+                }                                                       \
+            } else if (map->meta[idx] & ERMIS_HASH_TOMBSTONE) {         \
+                if (tombstone_idx < 0) tombstone_idx = (SZ)idx;         \
+            } else {                                                    \
+                if (tombstone_idx >= 0) {                               \
+                    idx = (U64)tombstone_idx;                           \
+                    --map->tombstones;                                  \
+                }                                                       \
+                                                                        \
                 map->keys[idx] = key;                                   \
                 map->values[idx] = value;                               \
-                map->meta[idx] |= ERMIS_HASH_OCCUPIED;                  \
+                map->meta[idx] = ERMIS_HASH_OCCUPIED;                   \
                 ++map->count;                                           \
                 return 1;                                               \
             }                                                           \
                                                                         \
-            if (eqfunc(map->keys[idx], key)) {                          \
-                map->keys[idx] = key;                                   \
-                map->values[idx] = value;                               \
-                return 0;                                               \
-            }                                                           \
-                                                                        \
             ++idx;                                                      \
             if (idx >= map->capacity) idx = 0;                          \
         } while (1);                                                    \
@@ -160,6 +190,8 @@
         U64 start_idx = idx;                                            \
                                                                         \
         do {                                                            \
+            if (map->meta[idx] == 0) break;                             \
+                                                                        \
             if ((map->meta[idx] & ERMIS_HASH_OCCUPIED) && eqfunc(key, map->keys[idx])) { \
                 return &map->values[idx];                               \
             }                                                           \
@@ -170,11 +202,23 @@
         } while (idx != start_idx);                                     \
                                                                         \
         return NULL;                                                    \
-    } \
+    }                                                                   \
+                                                                        \
+    B32 hashmapname##Remove(hashmapname *map, K key) {                  \
+        V *found_ptr = hashmapname##FindPtr(map, key);                  \
+        if (found_ptr == NULL) return 0;                                \
+                                                                        \
+        UZ idx = (UZ)(found_ptr - map->values);                         \
+        map->meta[idx] = ERMIS_HASH_TOMBSTONE;                          \
+        --map->count;                                                   \
+        ++map->tombstones;                                              \
+        return 1;                                                       \
+    }                                                                   \
     \
     void hashmapname##Clear(hashmapname *map) {                         \
         memset(map->meta, 0, sizeof(*map->meta) * map->capacity); \
         map->count = 0; \
+        map->tombstones = 0; \
     }
 
 // Equality and hash functions
@@ -1,9 +1,11 @@
 #include "eval.h"
 #include "print.h"
+#include "port.h"
+#include "persistent.h"
 
 ERMIS_IMPL_HASHMAP(HeliosStringView, AnanasValue, AnanasEnvMap, HeliosStringViewEqual, AnanasFnv1Hash)
 
-static AnanasValue *AnanasEnvLookup(AnanasEnv *env, HeliosStringView name) {
+AnanasValue *AnanasEnvLookup(AnanasEnv *env, HeliosStringView name) {
     while (env != NULL) {
         AnanasValue *ptr = AnanasEnvMapFindPtr(&env->map, name);
         if (ptr != NULL) return ptr;
@@ -13,21 +15,103 @@ static AnanasValue *AnanasEnvLookup(AnanasEnv *env, HeliosStringView name) {
     return NULL;
 }
 
+static B32 AnanasCallSiteEqual(AnanasList *lhs, AnanasList *rhs) {
+    return lhs == rhs;
+}
+
+ERMIS_IMPL_HASHMAP(AnanasList *, AnanasValue, AnanasMacroExpansionMap, AnanasCallSiteEqual, AnanasPointerHash)
+
+// NOTE: The cache lives in the macro, so redefining or shadowing the macro binds a macro with
+// no expansions and the call site is expanded again. Call sites are never mutated once read.
+static B32 AnanasExpandMacroCallSite(AnanasMacro *macro,
+                                     AnanasToken where,
+                                     AnanasList *call_site,
+                                     HeliosAllocator allocator,
+                                     AnanasErrorContext *error_ctx,
+                                     AnanasValue *result) {
+    if (macro->is_native) return AnanasEvalMacroWithArgumentList(macro, where, call_site->cdr, allocator, error_ctx, result);
+
+    AnanasUserMacro *user_macro = &macro->u.user;
+    if (user_macro->expansions == NULL) {
+        user_macro->expansions = HeliosAlloc(allocator, sizeof(*user_macro->expansions));
+        AnanasMacroExpansionMapInit(user_macro->expansions, allocator, 7);
+    }
+
+    AnanasValue *cached = AnanasMacroExpansionMapFindPtr(user_macro->expansions, call_site);
+    if (cached != NULL) {
+        *result = *cached;
+        return 1;
+    }
+
+    if (!AnanasEvalMacroWithArgumentList(macro, where, call_site->cdr, allocator, error_ctx, result)) return 0;
+
+    AnanasMacroExpansionMapInsert(user_macro->expansions, call_site, *result);
+    return 1;
+}
+
 void AnanasEnvInit(AnanasEnv *env, AnanasEnv *parent_env, HeliosAllocator allocator) {
     AnanasEnvMapInit(&env->map, allocator, 37);
     env->parent_env = parent_env;
+    env->captured = 0;
+}
+
+static void AnanasEnvMarkCaptured(AnanasEnv *env) {
+    while (env != NULL && !env->captured) {
+        env->captured = 1;
+        env = env->parent_env;
+    }
 }
 
 #define ANANAS_ENUM_NATIVE_FUNCTIONS \
     X("cons", AnanasCons) \
     X("read-file", AnanasReadFile) \
+    X("write-file", AnanasWriteFile) \
     X("list", AnanasListProc) \
     X("car", AnanasCar) \
     X("cdr", AnanasCdr) \
+    X("length", AnanasLength) \
+    X("append", AnanasAppend) \
+    X("reverse", AnanasReverse) \
+    X("nth", AnanasNth) \
+    X("last", AnanasLast) \
+    X("list-tail", AnanasListTail) \
     X("string-split", AnanasStringSplit) \
+    X("string-split-once", AnanasStringSplitOnce) \
     X("concat", AnanasConcat) \
     X("concat-syms", AnanasConcatSyms) \
     X("substring", AnanasSubstring) \
+    X("string-length", AnanasStringLength) \
+    X("index-of", AnanasIndexOf) \
+    X("char-at", AnanasCharAt) \
+    X("string->int", AnanasStringToInt) \
+    X("starts-with?", AnanasStartsWith) \
+    X("trim", AnanasTrim) \
+    X("join", AnanasJoin) \
+    X("make-table", AnanasMakeTable) \
+    X("table-get", AnanasTableGet) \
+    X("table-set!", AnanasTableSet) \
+    X("table-remove!", AnanasTableRemove) \
+    X("table-count", AnanasTableCount) \
+    X("table-keys", AnanasTableKeys) \
+    X("table->list", AnanasTableToList) \
+    X("hash-map", AnanasHashMapProc) \
+    X("hash-map-get", AnanasHashMapGet) \
+    X("hash-map-set", AnanasHashMapSetProc) \
+    X("hash-map-remove", AnanasHashMapRemoveProc) \
+    X("hash-map-count", AnanasHashMapCount) \
+    X("hash-map-keys", AnanasHashMapKeys) \
+    X("hash-map->list", AnanasHashMapToList) \
+    X("vector", AnanasVectorProc) \
+    X("vector-get", AnanasVectorGetProc) \
+    X("vector-set", AnanasVectorSetProc) \
+    X("vector-push", AnanasVectorPushProc) \
+    X("vector-length", AnanasVectorLength) \
+    X("vector->list", AnanasVectorToList) \
+    X("list->vector", AnanasListToVector) \
+    X("map", AnanasMap) \
+    X("filter", AnanasFilter) \
+    X("fold", AnanasFold) \
+    X("for-each", AnanasForEach) \
     X("print", AnanasPrintBuiltin) \
     X("print-string", AnanasPrintString) \
     X("read", AnanasRead) \
@@ -44,6 +128,37 @@ void AnanasEnvInit(AnanasEnv *env, AnanasEnv *parent_env, HeliosAllocator alloca
 ANANAS_ENUM_NATIVE_FUNCTIONS
 #undef X
 
+static const struct {
+    const char *name;
+    AnanasNativeFunction func;
+} ananas_native_functions[] = {
+#define X(name, func) {name, func},
+ANANAS_ENUM_NATIVE_FUNCTIONS
+#undef X
+};
+
+B32 AnanasNativeFunctionName(AnanasNativeFunction func, HeliosStringView *name) {
+    for (UZ i = 0; i < sizeof(ananas_native_functions) / sizeof(ananas_native_functions[0]); ++i) {
+        if (ananas_native_functions[i].func == func) {
+            *name = HELIOS_SV_LIT(ananas_native_functions[i].name);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+B32 AnanasNativeFunctionByName(HeliosStringView name, AnanasNativeFunction *func) {
+    for (UZ i = 0; i < sizeof(ananas_native_functions) / sizeof(ananas_native_functions[0]); ++i) {
+        if (HeliosStringViewEqualCStr(name, ananas_native_functions[i].name)) {
+            *func = ananas_native_functions[i].func;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 void AnanasRootEnvPopulate(AnanasEnv *env) {
     HeliosAllocator allocator = env->map.allocator;
 
@@ -68,8 +183,12 @@ static B32 AnanasConvertToBool(AnanasValue node) {
     case AnanasValueType_Symbol:
     case AnanasValueType_List:
     case AnanasValueType_String:
+    case AnanasValueType_StringBuilder:
     case AnanasValueType_Function:
     case AnanasValueType_Macro:
+    case AnanasValueType_Table:
+    case AnanasValueType_HashMap:
+    case AnanasValueType_Vector:
         return 1;
 
     case AnanasValueType_Bool: return node.u.boolean;
@@ -122,8 +241,9 @@ static B32 AnanasEvalFunctionWithArgumentList(AnanasFunction *function,
 
     AnanasUserFunction user_function = function->u.user;
 
-    AnanasEnv call_env;
-    AnanasEnvInit(&call_env, user_function.enclosing_env, allocator);
+    // NOTE: Lambdas made by the body keep a pointer to the env, so it cannot live on the C stack.
+    AnanasEnv *call_env = HeliosAlloc(allocator, sizeof(*call_env));
+    AnanasEnvInit(call_env, user_function.enclosing_env, allocator);
 
     if (user_function.params.variable) {
         HELIOS_ASSERT(user_function.params.count >= 1);
@@ -137,7 +257,7 @@ static B32 AnanasEvalFunctionWithArgumentList(AnanasFunction *function,
             HeliosStringView param_name = user_function.params.names[args_count];
             AnanasValue param_value;
             if (!AnanasEval(args_list->car, allocator, env, &param_value, error_ctx)) return 0;
-            AnanasEnvMapInsert(&call_env.map, param_name, param_value);
+            AnanasEnvMapInsert(&call_env->map, param_name, param_value);
 
             ++args_count;
             args_list = args_list->cdr;
@@ -155,30 +275,20 @@ static B32 AnanasEvalFunctionWithArgumentList(AnanasFunction *function,
 
         HELIOS_ASSERT(user_function.params.count - args_count == 1);
 
-        AnanasList *rest_list = NULL;
-        AnanasList *current_rest_list = rest_list;
+        AnanasListBuilder rest_list;
+        AnanasListBuilderInit(&rest_list);
 
         while (args_list != NULL) {
             AnanasValue param_value;
             if (!AnanasEval(args_list->car, allocator, env, &param_value, error_ctx)) return 0;
 
-            AnanasList *list = HeliosAlloc(allocator, sizeof(*list));
-            list->car = param_value;
-
-            if (rest_list == NULL) {
-                rest_list = list;
-                current_rest_list = list;
-            } else {
-                current_rest_list->cdr = list;
-                current_rest_list = list;
-            }
+            AnanasListBuilderAppend(&rest_list, allocator, param_value);
 
             args_list = args_list->cdr;
         }
 
         HeliosStringView rest_param_name = user_function.params.names[user_function.params.count - 1];
-        AnanasValue rest_param_value = {.type = AnanasValueType_List, .u = {.list = rest_list}};
-        AnanasEnvMapInsert(&call_env.map, rest_param_name, rest_param_value);
+        AnanasEnvMapInsert(&call_env->map, rest_param_name, AnanasListValue(rest_list.head));
     } else {
         UZ arguments_count = 0;
 
@@ -197,7 +307,7 @@ static B32 AnanasEvalFunctionWithArgumentList(AnanasFunction *function,
             if (!AnanasEval(args_list->car, allocator, env, &param_value, error_ctx)) return 0;
 
             HeliosStringView param_name = user_function.params.names[arguments_count];
-            AnanasEnvMapInsert(&call_env.map, param_name, param_value);
+            AnanasEnvMapInsert(&call_env->map, param_name, param_value);
 
             arguments_count++;
             args_list = args_list->cdr;
@@ -217,7 +327,106 @@ static B32 AnanasEvalFunctionWithArgumentList(AnanasFunction *function,
     AnanasList *function_body = user_function.body;
     return AnanasEvalFormList(function_body,
                               allocator,
-                              &call_env,
+                              call_env,
+                              error_ctx,
+                              result);
+}
+
+// NOTE: Calls a function with already evaluated arguments, for the natives that call back
+// into user code once per item. All the calls made through a frame share one env, which is
+// cleared instead of allocated again unless the previous call let a closure capture it.
+typedef struct {
+    AnanasFunction *function;
+    UZ args_count;
+    AnanasToken where;
+    AnanasEnv *env;
+} AnanasCallFrame;
+
+static B32 AnanasCallFrameInit(AnanasCallFrame *frame,
+                               AnanasFunction *function,
+                               UZ args_count,
+                               AnanasToken where,
+                               HeliosAllocator allocator,
+                               AnanasErrorContext *error_ctx) {
+    frame->function = function;
+    frame->args_count = args_count;
+    frame->where = where;
+
+    if (function->is_native) return 1;
+
+    AnanasParams params = function->u.user.params;
+    if (params.variable) {
+        HELIOS_ASSERT(params.count >= 1);
+
+        if (args_count < params.count - 1) {
+            AnanasErrorContextMessage(error_ctx,
+                                      where.row,
+                                      where.col,
+                                      "not enough arguments for function call: expected at least %zu, got %zu instead",
+                                      params.count - 1,
+                                      args_count);
+            return 0;
+        }
+    } else if (args_count != params.count) {
+        AnanasErrorContextMessage(error_ctx,
+                                  where.row,
+                                  where.col,
+                                  "%s arguments: expected %zu, got %zu",
+                                  args_count > params.count ? "too many" : "not enough",
+                                  params.count,
+                                  args_count);
+        return 0;
+    }
+
+    frame->env = HeliosAlloc(allocator, sizeof(*frame->env));
+    AnanasEnvInit(frame->env, function->u.user.enclosing_env, allocator);
+    return 1;
+}
+
+static B32 AnanasCallFrameCall(AnanasCallFrame *frame,
+                               AnanasValue *args,
+                               HeliosAllocator allocator,
+                               AnanasErrorContext *error_ctx,
+                               AnanasValue *result) {
+    AnanasFunction *function = frame->function;
+
+    if (function->is_native) {
+        AnanasArgs call_args = {
+            .values = args,
+            .count = frame->args_count,
+        };
+
+        return function->u.native(call_args, frame->where, allocator, error_ctx, result);
+    }
+
+    AnanasUserFunction user_function = function->u.user;
+
+    if (frame->env->captured) {
+        frame->env = HeliosAlloc(allocator, sizeof(*frame->env));
+        AnanasEnvInit(frame->env, user_function.enclosing_env, allocator);
+    } else if (frame->env->map.count != 0) {
+        AnanasEnvMapClear(&frame->env->map);
+    }
+
+    UZ fixed_count = user_function.params.variable ? user_function.params.count - 1 : user_function.params.count;
+    for (UZ i = 0; i < fixed_count; ++i) {
+        AnanasEnvMapInsert(&frame->env->map, user_function.params.names[i], args[i]);
+    }
+
+    if (user_function.params.variable) {
+        AnanasListBuilder rest_list;
+        AnanasListBuilderInit(&rest_list);
+
+        for (UZ i = fixed_count; i < frame->args_count; ++i) {
+            AnanasListBuilderAppend(&rest_list, allocator, args[i]);
+        }
+
+        AnanasEnvMapInsert(&frame->env->map, user_function.params.names[fixed_count], AnanasListValue(rest_list.head));
+    }
+
+    return AnanasEvalFormList(user_function.body,
+                              allocator,
+                              frame->env,
                               error_ctx,
                               result);
 }
@@ -247,8 +456,8 @@ B32 AnanasEvalMacroWithArgumentList(AnanasMacro *macro,
 
     AnanasUserMacro user_macro = macro->u.user;
 
-    AnanasEnv call_env;
-    AnanasEnvInit(&call_env, user_macro.enclosing_env, allocator);
+    AnanasEnv *call_env = HeliosAlloc(allocator, sizeof(*call_env));
+    AnanasEnvInit(call_env, user_macro.enclosing_env, allocator);
 
     if (user_macro.params.variable) {
         HELIOS_ASSERT(user_macro.params.count >= 1);
@@ -260,7 +469,7 @@ B32 AnanasEvalMacroWithArgumentList(AnanasMacro *macro,
             if (args_count >= expected_args_count) break;
 
             HeliosStringView param_name = user_macro.params.names[args_count];
-            AnanasEnvMapInsert(&call_env.map, param_name, args_list->car);
+            AnanasEnvMapInsert(&call_env->map, param_name, args_list->car);
 
             ++args_count;
             args_list = args_list->cdr;
@@ -280,7 +489,7 @@ B32 AnanasEvalMacroWithArgumentList(AnanasMacro *macro,
 
         HeliosStringView rest_param_name = user_macro.params.names[user_macro.params.count - 1];
         AnanasValue rest_param_value = {.type = AnanasValueType_List, .u = {.list = args_list}};
-        AnanasEnvMapInsert(&call_env.map, rest_param_name, rest_param_value);
+        AnanasEnvMapInsert(&call_env->map, rest_param_name, rest_param_value);
     } else {
         UZ args_count = 0;
         while (args_list != NULL) {
@@ -294,294 +503,1144 @@ B32 AnanasEvalMacroWithArgumentList(AnanasMacro *macro,
                 return 0;
             }
 
-            HeliosStringView param_name = user_macro.params.names[args_count];
-            AnanasEnvMapInsert(&call_env.map, param_name, args_list->car);
+            HeliosStringView param_name = user_macro.params.names[args_count];
+            AnanasEnvMapInsert(&call_env->map, param_name, args_list->car);
+
+            ++args_count;
+            args_list = args_list->cdr;
+        }
+
+        if (args_count != user_macro.params.count) {
+            AnanasErrorContextMessage(error_ctx,
+                                      where.row,
+                                      where.col,
+                                      "Not enough arguments for macro call: expected '%zu', got %zu instead",
+                                      user_macro.params.count,
+                                      args_count);
+            return 0;
+        }
+    }
+
+    return AnanasEvalFormList(user_macro.body,
+                              allocator,
+                              call_env,
+                              error_ctx,
+                              result);
+}
+
+static const char *AnanasTypeName(AnanasValueType type) {
+    switch (type) {
+    case AnanasValueType_Int:      return "int";
+    case AnanasValueType_String:   return "string";
+    case AnanasValueType_StringBuilder: return "string";
+    case AnanasValueType_Bool:     return "bool";
+    case AnanasValueType_Function: return "function";
+    case AnanasValueType_Macro:    return "macro";
+    case AnanasValueType_List:     return "list";
+    case AnanasValueType_Symbol:   return "symbol";
+    case AnanasValueType_Table:    return "table";
+    case AnanasValueType_HashMap:  return "hash-map";
+    case AnanasValueType_Vector:   return "vector";
+    }
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasCons) {
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(1, List, cdr);
+
+    AnanasList *list = HeliosAlloc(arena, sizeof(*list));
+    list->car = args.values[0];
+    list->cdr = cdr_arg.u.list;
+
+    result->type = AnanasValueType_List;
+    result->u.list = list;
+
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasListProc) {
+    (void) where;
+    (void) error_ctx;
+
+    AnanasListBuilder result_list;
+    AnanasListBuilderInit(&result_list);
+
+    for (UZ i = 0; i < args.count; ++i) AnanasListBuilderAppend(&result_list, arena, args.values[i]);
+
+    ANANAS_NATIVE_RETURN(AnanasListValue(result_list.head));
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasCar) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, List, list);
+
+    AnanasList *list = list_arg.u.list;
+    if (list == NULL) {
+        ANANAS_NATIVE_BAIL("called 'car' on an empty list");
+    }
+
+    ANANAS_NATIVE_RETURN(list->car);
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasCdr) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, List, list);
+
+    AnanasList *list = list_arg.u.list;
+    if (list == NULL) {
+        ANANAS_NATIVE_BAIL("called 'cdr' on an empty list");
+    }
+
+    result->type = AnanasValueType_List;
+    result->u.list = list->cdr;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasLength) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, List, list);
+
+    S64 length = 0;
+    for (AnanasList *list = list_arg.u.list; list != NULL; list = list->cdr) ++length;
+
+    result->type = AnanasValueType_Int;
+    result->u.integer = length;
+    return 1;
+}
+
+// NOTE: Every list but the last one is copied, the last one becomes the tail of the result.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasAppend) {
+    for (UZ i = 0; i < args.count; ++i) {
+        AnanasValue arg = args.values[i];
+        if (arg.type != AnanasValueType_List) {
+            ANANAS_NATIVE_BAIL_FMT("Argument type mismatch: expected the argument at position %zu to be of type list but got type %s instead",
+                                    i,
+                                    AnanasTypeName(arg.type));
+        }
+    }
+
+    if (args.count == 0) ANANAS_NATIVE_RETURN(AnanasListValue(NULL));
+
+    AnanasListBuilder result_list;
+    AnanasListBuilderInit(&result_list);
+
+    for (UZ i = 0; i + 1 < args.count; ++i) {
+        for (AnanasList *list = args.values[i].u.list; list != NULL; list = list->cdr) {
+            AnanasListBuilderAppend(&result_list, arena, list->car);
+        }
+    }
+
+    AnanasList *last_list = args.values[args.count - 1].u.list;
+    ANANAS_NATIVE_RETURN(AnanasListValue(AnanasListBuilderFinish(&result_list, last_list)));
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasReverse) {
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, List, list);
+
+    AnanasList *reversed_list = NULL;
+    for (AnanasList *list = list_arg.u.list; list != NULL; list = list->cdr) {
+        AnanasList *cons = HeliosAlloc(arena, sizeof(*cons));
+        cons->car = list->car;
+        cons->cdr = reversed_list;
+        reversed_list = cons;
+    }
+
+    ANANAS_NATIVE_RETURN(AnanasListValue(reversed_list));
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasNth) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, List, list);
+    ANANAS_CHECK_ARG_TYPE(1, Int, index);
+
+    S64 index = index_arg.u.integer;
+    AnanasList *list = list_arg.u.list;
+    for (S64 i = 0; i < index && list != NULL; ++i) list = list->cdr;
+
+    if (index < 0 || list == NULL) {
+        ANANAS_NATIVE_BAIL_FMT("index %lld is out of bounds for the list passed to 'nth'", (long long)index);
+    }
+
+    ANANAS_NATIVE_RETURN(list->car);
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasLast) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, List, list);
+
+    AnanasList *list = list_arg.u.list;
+    if (list == NULL) {
+        ANANAS_NATIVE_BAIL("called 'last' on an empty list");
+    }
+
+    while (list->cdr != NULL) list = list->cdr;
+
+    ANANAS_NATIVE_RETURN(list->car);
+}
+
+// NOTE: Drops the first `count` elements and returns the rest of the list itself, not a copy.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasListTail) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, List, list);
+    ANANAS_CHECK_ARG_TYPE(1, Int, count);
+
+    S64 count = count_arg.u.integer;
+    if (count < 0) {
+        ANANAS_NATIVE_BAIL_FMT("expected a non-negative count, got %lld", (long long)count);
+    }
+
+    AnanasList *list = list_arg.u.list;
+    for (S64 i = 0; i < count; ++i) {
+        if (list == NULL) {
+            ANANAS_NATIVE_BAIL_FMT("can't drop %lld elements from a list of length %lld", (long long)count, (long long)i);
+        }
+        list = list->cdr;
+    }
+
+    ANANAS_NATIVE_RETURN(AnanasListValue(list));
+}
+
+// NOTE: Files up to this size are copied into the arena and unmapped right away. Bigger ones
+// stay mapped for the rest of the process, since strings have no lifetime to unmap them at, and
+// truncating such a file while its contents are still in use faults the process.
+#define ANANAS_READ_FILE_COPY_MAX (1024 * 1024)
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasReadFile) {
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, file_name);
+
+    HeliosStringView file_name = file_name_arg.u.string;
+    U8 *data;
+    UZ count;
+    if (!AnanasPlatformMapFile(file_name, 0, &data, &count)) {
+        *result = ANANAS_FALSE;
+        return 1;
+    }
+
+    if (count > 0 && count <= ANANAS_READ_FILE_COPY_MAX) {
+        U8 *copy = HeliosAlloc(arena, count);
+        memcpy(copy, data, count);
+        AnanasPlatformUnmapFile(data, count);
+        data = copy;
+    }
+
+    result->type = AnanasValueType_String;
+    result->u.string = (HeliosStringView) {.data = data, .count = count};
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasStringSplit) {
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+    ANANAS_CHECK_ARG_TYPE(1, String, separator);
+
+    HeliosStringView string = string_arg.u.string;
+    HeliosStringView separator = separator_arg.u.string;
+
+    if (separator.count == 0) {
+        ANANAS_NATIVE_BAIL("the separator passed to 'string-split' is empty");
+    }
+
+    AnanasListBuilder results_list;
+    AnanasListBuilderInit(&results_list);
+
+    HeliosStringView rest = string;
+    while (1) {
+        UZ index;
+        B32 found = AnanasStringViewFind(rest, separator, &index);
+
+        AnanasValue part = {.type = AnanasValueType_String};
+        part.u.string = (HeliosStringView) {.data = rest.data, .count = found ? index : rest.count};
+        AnanasListBuilderAppend(&results_list, arena, part);
+
+        if (!found) break;
+
+        rest.data += index + separator.count;
+        rest.count -= index + separator.count;
+    }
+
+    ANANAS_NATIVE_RETURN(AnanasListValue(results_list.head));
+}
+
+// NOTE: Splits at the first separator only and returns `(before after)`, or false when there is
+// none. Both pieces are slices of the string, so walking a big input with it produces the pieces
+// one at a time instead of building the whole list up front.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasStringSplitOnce) {
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+    ANANAS_CHECK_ARG_TYPE(1, String, separator);
+
+    HeliosStringView string = string_arg.u.string;
+    HeliosStringView separator = separator_arg.u.string;
+
+    if (separator.count == 0) {
+        ANANAS_NATIVE_BAIL("the separator passed to 'string-split-once' is empty");
+    }
+
+    UZ index;
+    if (!AnanasStringViewFind(string, separator, &index)) ANANAS_NATIVE_RETURN(ANANAS_FALSE);
+
+    AnanasList *after = HeliosAlloc(arena, sizeof(*after));
+    after->car.type = AnanasValueType_String;
+    after->car.u.string = (HeliosStringView) {
+        .data = string.data + index + separator.count,
+        .count = string.count - index - separator.count,
+    };
+
+    AnanasList *before = HeliosAlloc(arena, sizeof(*before));
+    before->car.type = AnanasValueType_String;
+    before->car.u.string = (HeliosStringView) {.data = string.data, .count = index};
+    before->cdr = after;
+
+    result->type = AnanasValueType_List;
+    result->u.list = before;
+    return 1;
+}
+
+// NOTE: Shorter results are plain strings, longer ones are string builders, so that building
+// a string up by repeated `concat`, like `(set out (concat out ...))`, is linear in what gets
+// appended instead of copying everything so far every time.
+#define ANANAS_STRING_BUILDER_MIN_SIZE 256
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasConcat) {
+    if (args.count == 0) {
+        ANANAS_NATIVE_BAIL("no arguments passed to 'concat'");
+    }
+
+    UZ total_count = 0;
+    for (UZ i = 0; i < args.count; ++i) {
+        AnanasValue arg = AnanasArgAt(args, i);
+        if (arg.type != AnanasValueType_String) {
+            AnanasErrorContextMessage(error_ctx,
+                                      arg.token.row,
+                                      arg.token.col,
+                                      "expected a value of type string, got %s instead",
+                                      AnanasTypeName(arg.type));
+            return 0;
+        }
+
+        total_count += arg.u.string.count;
+    }
+
+    if (total_count < ANANAS_STRING_BUILDER_MIN_SIZE) {
+        U8 *buffer = HeliosAlloc(arena, total_count);
+        UZ offset = 0;
+        for (UZ i = 0; i < args.count; ++i) {
+            HeliosStringView string = AnanasArgAt(args, i).u.string;
+            memcpy(buffer + offset, string.data, string.count);
+            offset += string.count;
+        }
+
+        result->type = AnanasValueType_String;
+        result->u.string = (HeliosStringView) {.data = buffer, .count = total_count};
+        return 1;
+    }
+
+    AnanasValue head = args.values[0];
+    AnanasStringBuffer *buffer = NULL;
+    UZ first_arg = 0;
+
+    if (head.type == AnanasValueType_StringBuilder) {
+        AnanasStringBuilder *head_builder = head.u.string_builder;
+        if (head_builder->string.count == head_builder->buffer->count) {
+            buffer = head_builder->buffer;
+            first_arg = 1;
+        }
+    }
+
+    if (buffer == NULL) {
+        buffer = HeliosAlloc(arena, sizeof(*buffer));
+        buffer->capacity = total_count * 2;
+        buffer->data = HeliosAlloc(arena, buffer->capacity);
+        buffer->count = 0;
+    } else if (buffer->capacity < total_count) {
+        // NOTE: The old data stays where it is, earlier builders still point into it.
+        UZ capacity = HELIOS_MAX(buffer->capacity * 2, total_count);
+        U8 *data = HeliosAlloc(arena, capacity);
+        memcpy(data, buffer->data, buffer->count);
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+
+    for (UZ i = first_arg; i < args.count; ++i) {
+        HeliosStringView string = AnanasArgAt(args, i).u.string;
+        memcpy(buffer->data + buffer->count, string.data, string.count);
+        buffer->count += string.count;
+    }
+
+    AnanasStringBuilder *builder = HeliosAlloc(arena, sizeof(*builder));
+    builder->buffer = buffer;
+    builder->string = (HeliosStringView) {.data = buffer->data, .count = total_count};
+
+    result->type = AnanasValueType_StringBuilder;
+    result->u.string_builder = builder;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasConcatSyms) {
+    if (args.count == 0) {
+        ANANAS_NATIVE_BAIL("no arguments passed to 'concat-syms'");
+    }
+
+    UZ total_count = 0;
+    for (UZ i = 0; i < args.count; ++i) {
+        AnanasValue arg = AnanasArgAt(args, i);
+        if (arg.type != AnanasValueType_Symbol) {
+            AnanasErrorContextMessage(error_ctx,
+                                      arg.token.row,
+                                      arg.token.col,
+                                      "expected a value of type symbol, got %s instead",
+                                      AnanasTypeName(arg.type));
+            return 0;
+        }
+
+        total_count += arg.u.symbol.count;
+    }
+
+    U8 *buffer = HeliosAlloc(arena, total_count);
+    UZ offset = 0;
+    for (UZ i = 0; i < args.count; ++i) {
+        HeliosStringView sym = args.values[i].u.symbol;
+        memcpy(buffer + offset, sym.data, sym.count);
+        offset += sym.count;
+    }
+
+    result->type = AnanasValueType_Symbol;
+    result->u.symbol.data = buffer;
+    result->u.symbol.count = total_count;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasSubstring) {
+    (void) arena;
+
+    if (args.count < 2) {
+        ANANAS_NATIVE_BAIL_FMT("expected at least 2 arguments, got %zu instead", args.count);
+    }
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+    ANANAS_CHECK_ARG_TYPE(1, Int, start);
+
+    HeliosStringView string = string_arg.u.string;
+    UZ substring_start = start_arg.u.integer;
+
+    if (substring_start >= string.count) {
+        result->type = AnanasValueType_String;
+        result->u.string = HELIOS_SV_LIT("");
+        return 1;
+    }
+
+    UZ substring_count;
+
+    if (args.count == 2) {
+        substring_count = string.count - substring_start;
+    } else if (args.count == 3) {
+        ANANAS_CHECK_ARG_TYPE(2, Int, count);
+        substring_count = count_arg.u.integer;
+
+        UZ available_bytes = string.count - substring_start;
+        if (available_bytes < substring_count) {
+            ANANAS_NATIVE_BAIL_FMT("number of available bytes %zu in string is less than requested (%zu)", available_bytes, substring_count);
+        }
+    } else {
+        HELIOS_UNREACHABLE();
+    }
+
+    result->type = AnanasValueType_String;
+    result->u.string.data = &string.data[substring_start];
+    result->u.string.count = substring_count;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasStringLength) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+
+    result->type = AnanasValueType_Int;
+    result->u.integer = (S64)string_arg.u.string.count;
+    return 1;
+}
+
+// NOTE: The byte offset of the first occurrence of `needle`, or -1 when there is none.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasIndexOf) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+    ANANAS_CHECK_ARG_TYPE(1, String, needle);
+
+    UZ index;
+    B32 found = AnanasStringViewFind(string_arg.u.string, needle_arg.u.string, &index);
+
+    result->type = AnanasValueType_Int;
+    result->u.integer = found ? (S64)index : -1;
+    return 1;
+}
+
+// NOTE: There is no character type, the byte at `index` comes back as a string of length 1.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasCharAt) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+    ANANAS_CHECK_ARG_TYPE(1, Int, index);
+
+    HeliosStringView string = string_arg.u.string;
+    S64 index = index_arg.u.integer;
+    if (index < 0 || (UZ)index >= string.count) {
+        ANANAS_NATIVE_BAIL_FMT("index %lld out of bounds for a string of length %zu", (long long)index, string.count);
+    }
+
+    result->type = AnanasValueType_String;
+    result->u.string = (HeliosStringView) {.data = string.data + index, .count = 1};
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasStringToInt) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+
+    S64 integer;
+    if (!HeliosParseS64DetectBase(string_arg.u.string, &integer)) {
+        ANANAS_NATIVE_BAIL_FMT("'string->int' could not parse \"" HELIOS_SV_FMT "\" as an integer",
+                               HELIOS_SV_ARG(string_arg.u.string));
+    }
+
+    result->type = AnanasValueType_Int;
+    result->u.integer = integer;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasStartsWith) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+    ANANAS_CHECK_ARG_TYPE(1, String, prefix);
+
+    ANANAS_NATIVE_RETURN(ANANAS_BOOL(HeliosStringViewStartsWithSV(string_arg.u.string, prefix_arg.u.string)));
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasTrim) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, String, string);
+
+    result->type = AnanasValueType_String;
+    result->u.string = AnanasStringViewTrim(string_arg.u.string);
+    return 1;
+}
+
+// NOTE: Sums the lengths first, so the result is copied into a single exactly sized buffer.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasJoin) {
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, List, strings);
+    ANANAS_CHECK_ARG_TYPE(1, String, separator);
+
+    HeliosStringView separator = separator_arg.u.string;
+
+    UZ total_count = 0;
+    for (AnanasList *list = strings_arg.u.list; list != NULL; list = list->cdr) {
+        if (list->car.type != AnanasValueType_String) {
+            ANANAS_NATIVE_BAIL_FMT("expected a list of strings, got an element of type %s", AnanasTypeName(list->car.type));
+        }
+
+        total_count += list->car.u.string.count;
+        if (list->cdr != NULL) total_count += separator.count;
+    }
+
+    U8 *buffer = HeliosAlloc(arena, total_count);
+    UZ offset = 0;
+    for (AnanasList *list = strings_arg.u.list; list != NULL; list = list->cdr) {
+        HeliosStringView string = list->car.u.string;
+        memcpy(buffer + offset, string.data, string.count);
+        offset += string.count;
+
+        if (list->cdr != NULL) {
+            memcpy(buffer + offset, separator.data, separator.count);
+            offset += separator.count;
+        }
+    }
+
+    result->type = AnanasValueType_String;
+    result->u.string = (HeliosStringView) {.data = buffer, .count = total_count};
+    return 1;
+}
+
+#define ANANAS_CHECK_HASH_KEY(n, name)                                  \
+    AnanasValue name = AnanasArgAt(args, (n));                          \
+    if (!AnanasValueIsHashable(name)) {                                 \
+        ANANAS_NATIVE_BAIL_FMT("a value of type %s can't be used as a key", \
+                                AnanasTypeName(name.type));             \
+    }
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasMakeTable) {
+    ANANAS_CHECK_ARGS_COUNT(0);
+
+    AnanasTable *table = HeliosAlloc(arena, sizeof(*table));
+    AnanasTableMapInit(&table->map, arena, 0);
+
+    result->type = AnanasValueType_Table;
+    result->u.table = table;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasTableGet) {
+    (void) arena;
+    if (args.count != 2 && args.count != 3) {
+        ANANAS_NATIVE_BAIL_FMT("Argument count mismatch: expected 2 or 3 but got %zu instead", args.count);
+    }
+
+    ANANAS_CHECK_ARG_TYPE(0, Table, table);
+    ANANAS_CHECK_HASH_KEY(1, key);
+
+    AnanasValue *value = AnanasTableMapFindPtr(&table_arg.u.table->map, key);
+    if (value != NULL) ANANAS_NATIVE_RETURN(*value);
+
+    ANANAS_NATIVE_RETURN(args.count == 3 ? AnanasArgAt(args, 2) : ANANAS_FALSE);
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasTableSet) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(3);
+
+    ANANAS_CHECK_ARG_TYPE(0, Table, table);
+    ANANAS_CHECK_HASH_KEY(1, key);
+
+    AnanasValue value = AnanasArgAt(args, 2);
+    AnanasTableMapInsert(&table_arg.u.table->map, key, value);
+
+    ANANAS_NATIVE_RETURN(value);
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasTableRemove) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(2);
+
+    ANANAS_CHECK_ARG_TYPE(0, Table, table);
+    ANANAS_CHECK_HASH_KEY(1, key);
+
+    ANANAS_NATIVE_RETURN(ANANAS_BOOL(AnanasTableMapRemove(&table_arg.u.table->map, key)));
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasTableCount) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, Table, table);
+
+    result->type = AnanasValueType_Int;
+    result->u.integer = (S64)table_arg.u.table->map.count;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasTableKeys) {
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, Table, table);
+
+    AnanasList *keys_list = NULL;
+    ERMIS_HASHMAP_FOREACH(&table_arg.u.table->map, key, value, {
+            (void) value;
+            AnanasList *list = HeliosAlloc(arena, sizeof(*list));
+            list->car = key;
+            list->cdr = keys_list;
+            keys_list = list;
+        });
+
+    result->type = AnanasValueType_List;
+    result->u.list = keys_list;
+    return 1;
+}
+
+// NOTE: Returns the entries as a list of `(key value)` pairs, in no particular order.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasTableToList) {
+    ANANAS_CHECK_ARGS_COUNT(1);
+
+    ANANAS_CHECK_ARG_TYPE(0, Table, table);
 
-            ++args_count;
-            args_list = args_list->cdr;
-        }
+    AnanasList *entries_list = NULL;
+    ERMIS_HASHMAP_FOREACH(&table_arg.u.table->map, key, value, {
+            AnanasList *pair = HeliosAlloc(arena, sizeof(*pair) * 2);
+            pair[0].car = key;
+            pair[0].cdr = &pair[1];
+            pair[1].car = value;
+            pair[1].cdr = NULL;
 
-        if (args_count != user_macro.params.count) {
-            AnanasErrorContextMessage(error_ctx,
-                                      where.row,
-                                      where.col,
-                                      "Not enough arguments for macro call: expected '%zu', got %zu instead",
-                                      user_macro.params.count,
-                                      args_count);
-            return 0;
-        }
+            AnanasList *list = HeliosAlloc(arena, sizeof(*list));
+            list->car.type = AnanasValueType_List;
+            list->car.u.list = pair;
+            list->cdr = entries_list;
+            entries_list = list;
+        });
+
+    result->type = AnanasValueType_List;
+    result->u.list = entries_list;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasHashMapProc) {
+    if (args.count % 2 != 0) {
+        ANANAS_NATIVE_BAIL_FMT("expected an even number of arguments, keys followed by their values, but got %zu", args.count);
     }
 
-    return AnanasEvalFormList(user_macro.body,
-                              allocator,
-                              &call_env,
-                              error_ctx,
-                              result);
+    AnanasHashMap *hash_map = AnanasHashMapEmpty(arena);
+    for (UZ i = 0; i < args.count; i += 2) {
+        ANANAS_CHECK_HASH_KEY(i, key);
+        hash_map = AnanasHashMapSet(arena, hash_map, key, AnanasArgAt(args, i + 1));
+    }
+
+    result->type = AnanasValueType_HashMap;
+    result->u.hash_map = hash_map;
+    return 1;
 }
 
-static const char *AnanasTypeName(AnanasValueType type) {
-    switch (type) {
-    case AnanasValueType_Int:      return "int";
-    case AnanasValueType_String:   return "string";
-    case AnanasValueType_Bool:     return "bool";
-    case AnanasValueType_Function: return "function";
-    case AnanasValueType_Macro:    return "macro";
-    case AnanasValueType_List:     return "list";
-    case AnanasValueType_Symbol:   return "symbol";
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasHashMapGet) {
+    (void) arena;
+    if (args.count != 2 && args.count != 3) {
+        ANANAS_NATIVE_BAIL_FMT("Argument count mismatch: expected 2 or 3 but got %zu instead", args.count);
     }
+
+    ANANAS_CHECK_ARG_TYPE(0, HashMap, hash_map);
+    ANANAS_CHECK_HASH_KEY(1, key);
+
+    AnanasValue *value = AnanasHashMapFind(hash_map_arg.u.hash_map, key);
+    if (value != NULL) ANANAS_NATIVE_RETURN(*value);
+
+    ANANAS_NATIVE_RETURN(args.count == 3 ? AnanasArgAt(args, 2) : ANANAS_FALSE);
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasCons) {
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasHashMapSetProc) {
+    ANANAS_CHECK_ARGS_COUNT(3);
+
+    ANANAS_CHECK_ARG_TYPE(0, HashMap, hash_map);
+    ANANAS_CHECK_HASH_KEY(1, key);
+
+    result->type = AnanasValueType_HashMap;
+    result->u.hash_map = AnanasHashMapSet(arena, hash_map_arg.u.hash_map, key, AnanasArgAt(args, 2));
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasHashMapRemoveProc) {
     ANANAS_CHECK_ARGS_COUNT(2);
 
-    ANANAS_CHECK_ARG_TYPE(1, List, cdr);
+    ANANAS_CHECK_ARG_TYPE(0, HashMap, hash_map);
+    ANANAS_CHECK_HASH_KEY(1, key);
 
-    AnanasList *list = HeliosAlloc(arena, sizeof(*list));
-    list->car = args.values[0];
-    list->cdr = cdr_arg.u.list;
+    result->type = AnanasValueType_HashMap;
+    result->u.hash_map = AnanasHashMapRemove(arena, hash_map_arg.u.hash_map, key);
+    return 1;
+}
 
-    result->type = AnanasValueType_List;
-    result->u.list = list;
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasHashMapCount) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
 
+    ANANAS_CHECK_ARG_TYPE(0, HashMap, hash_map);
+
+    result->type = AnanasValueType_Int;
+    result->u.integer = (S64)hash_map_arg.u.hash_map->count;
     return 1;
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasListProc) {
-    (void) where;
-    (void) error_ctx;
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasHashMapKeys) {
+    ANANAS_CHECK_ARGS_COUNT(1);
 
-    AnanasList *result_list = NULL;
-    AnanasList *current_list = result_list;
+    ANANAS_CHECK_ARG_TYPE(0, HashMap, hash_map);
 
-    for (UZ i = 0; i < args.count; ++i) {
+    AnanasHashMapIterator it;
+    AnanasHashMapIteratorInit(&it, hash_map_arg.u.hash_map);
+
+    AnanasList *keys_list = NULL;
+    AnanasHashMapEntry entry;
+    while (AnanasHashMapIteratorNext(&it, &entry)) {
         AnanasList *list = HeliosAlloc(arena, sizeof(*list));
-        list->car = args.values[i];
-        if (result_list == NULL) {
-            result_list = list;
-            current_list = list;
-        } else {
-            current_list->cdr = list;
-            current_list = list;
-        }
+        list->car = entry.key;
+        list->cdr = keys_list;
+        keys_list = list;
     }
 
     result->type = AnanasValueType_List;
-    result->u.list = result_list;
+    result->u.list = keys_list;
     return 1;
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasCar) {
-    (void) arena;
+// NOTE: Returns the entries as a list of `(key value)` pairs, in no particular order.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasHashMapToList) {
     ANANAS_CHECK_ARGS_COUNT(1);
 
-    ANANAS_CHECK_ARG_TYPE(0, List, list);
+    ANANAS_CHECK_ARG_TYPE(0, HashMap, hash_map);
 
-    AnanasList *list = list_arg.u.list;
-    if (list == NULL) {
-        ANANAS_NATIVE_BAIL("called 'car' on an empty list");
+    AnanasHashMapIterator it;
+    AnanasHashMapIteratorInit(&it, hash_map_arg.u.hash_map);
+
+    AnanasList *entries_list = NULL;
+    AnanasHashMapEntry entry;
+    while (AnanasHashMapIteratorNext(&it, &entry)) {
+        AnanasList *pair = HeliosAlloc(arena, sizeof(*pair) * 2);
+        pair[0].car = entry.key;
+        pair[0].cdr = &pair[1];
+        pair[1].car = entry.value;
+        pair[1].cdr = NULL;
+
+        AnanasList *list = HeliosAlloc(arena, sizeof(*list));
+        list->car.type = AnanasValueType_List;
+        list->car.u.list = pair;
+        list->cdr = entries_list;
+        entries_list = list;
     }
 
-    ANANAS_NATIVE_RETURN(list->car);
+    result->type = AnanasValueType_List;
+    result->u.list = entries_list;
+    return 1;
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasCdr) {
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasVectorProc) {
+    (void) where;
+    (void) error_ctx;
+
+    AnanasVector *vector = AnanasVectorEmpty(arena);
+    for (UZ i = 0; i < args.count; ++i) vector = AnanasVectorPush(arena, vector, args.values[i]);
+
+    result->type = AnanasValueType_Vector;
+    result->u.vector = vector;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasVectorGetProc) {
     (void) arena;
-    ANANAS_CHECK_ARGS_COUNT(1);
+    ANANAS_CHECK_ARGS_COUNT(2);
 
-    ANANAS_CHECK_ARG_TYPE(0, List, list);
+    ANANAS_CHECK_ARG_TYPE(0, Vector, vector);
+    ANANAS_CHECK_ARG_TYPE(1, Int, index);
 
-    AnanasList *list = list_arg.u.list;
-    if (list == NULL) {
-        ANANAS_NATIVE_BAIL("called 'cdr' on an empty list");
+    AnanasVector *vector = vector_arg.u.vector;
+    S64 index = index_arg.u.integer;
+    if (index < 0 || (U64)index >= vector->count) {
+        ANANAS_NATIVE_BAIL_FMT("index %lld is out of bounds for a vector of length %zu", (long long)index, vector->count);
     }
 
-    result->type = AnanasValueType_List;
-    result->u.list = list->cdr;
-    return 1;
+    ANANAS_NATIVE_RETURN(AnanasVectorGet(vector, (UZ)index));
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasReadFile) {
-    ANANAS_CHECK_ARGS_COUNT(1);
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasVectorSetProc) {
+    ANANAS_CHECK_ARGS_COUNT(3);
 
-    ANANAS_CHECK_ARG_TYPE(0, String, file_name);
+    ANANAS_CHECK_ARG_TYPE(0, Vector, vector);
+    ANANAS_CHECK_ARG_TYPE(1, Int, index);
 
-    HeliosStringView file_name = file_name_arg.u.string;
-    HeliosStringView file_contents = HeliosReadEntireFile(arena, file_name);
-    if (file_contents.data == NULL) {
-        *result = ANANAS_FALSE;
-        return 1;
+    AnanasVector *vector = vector_arg.u.vector;
+    S64 index = index_arg.u.integer;
+    if (index < 0 || (U64)index >= vector->count) {
+        ANANAS_NATIVE_BAIL_FMT("index %lld is out of bounds for a vector of length %zu", (long long)index, vector->count);
     }
 
-    result->type = AnanasValueType_String;
-    result->u.string = file_contents;
+    result->type = AnanasValueType_Vector;
+    result->u.vector = AnanasVectorSet(arena, vector, (UZ)index, AnanasArgAt(args, 2));
     return 1;
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasStringSplit) {
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasVectorPushProc) {
     ANANAS_CHECK_ARGS_COUNT(2);
 
-    ANANAS_CHECK_ARG_TYPE(0, String, string);
-    ANANAS_CHECK_ARG_TYPE(1, String, separator);
+    ANANAS_CHECK_ARG_TYPE(0, Vector, vector);
 
-    HeliosStringView string = string_arg.u.string;
-    HeliosStringView separator = separator_arg.u.string;
+    result->type = AnanasValueType_Vector;
+    result->u.vector = AnanasVectorPush(arena, vector_arg.u.vector, AnanasArgAt(args, 1));
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasVectorLength) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(1);
 
-    AnanasList *results_list = NULL;
-    AnanasList *current_list = results_list;
+    ANANAS_CHECK_ARG_TYPE(0, Vector, vector);
 
-    UZ substring_start = 0;
-    for (SZ i = 0; i < (SZ)string.count - (SZ)separator.count + 1; ) {
-        HeliosStringView s = {.data = &string.data[i], .count = separator.count};
-        if (!HeliosStringViewEqual(separator, s)) {
-            ++i;
-            continue;
-        }
+    result->type = AnanasValueType_Int;
+    result->u.integer = (S64)vector_arg.u.vector->count;
+    return 1;
+}
 
-        HeliosStringView string_part = {.data = &string.data[substring_start], .count = i - substring_start};
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasVectorToList) {
+    ANANAS_CHECK_ARGS_COUNT(1);
 
-        AnanasList *list = HeliosAlloc(arena, sizeof(*list));
-        list->car.type = AnanasValueType_String;
-        list->car.u.string = string_part;
+    ANANAS_CHECK_ARG_TYPE(0, Vector, vector);
 
-        if (results_list == NULL) {
-            results_list = list;
-            current_list = list;
-        } else {
-            current_list->cdr = list;
-            current_list = list;
-        }
+    AnanasVector *vector = vector_arg.u.vector;
 
-        substring_start = i + s.count;
-        i += s.count;
+    AnanasList *items_list = NULL;
+    for (UZ i = vector->count; i > 0; --i) {
+        AnanasList *list = HeliosAlloc(arena, sizeof(*list));
+        list->car = AnanasVectorGet(vector, i - 1);
+        list->cdr = items_list;
+        items_list = list;
     }
 
-    HeliosStringView last_string_part = {.data = &string.data[substring_start], .count = string.count - substring_start};
+    result->type = AnanasValueType_List;
+    result->u.list = items_list;
+    return 1;
+}
+
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasListToVector) {
+    ANANAS_CHECK_ARGS_COUNT(1);
 
-    AnanasList *list = HeliosAlloc(arena, sizeof(*list));
-    list->car.type = AnanasValueType_String;
-    list->car.u.string = last_string_part;
+    ANANAS_CHECK_ARG_TYPE(0, List, list);
 
-    if (results_list == NULL) {
-        results_list = list;
-    } else {
-        current_list->cdr = list;
+    AnanasVector *vector = AnanasVectorEmpty(arena);
+    for (AnanasList *list = list_arg.u.list; list != NULL; list = list->cdr) {
+        vector = AnanasVectorPush(arena, vector, list->car);
     }
 
-    result->type = AnanasValueType_List;
-    result->u.list = results_list;
+    result->type = AnanasValueType_Vector;
+    result->u.vector = vector;
     return 1;
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasConcat) {
-    if (args.count == 0) {
-        ANANAS_NATIVE_BAIL("no arguments passed to 'concat'");
+// NOTE: Lists and vectors pass each item to the function, tables pass each key and value.
+// The function may change a table while it is being walked, which can rehash it, so the keys
+// are copied up front. The walk visits the keys the table had at the start, skips the ones
+// removed since and passes the current value of the rest.
+typedef struct {
+    AnanasValue sequence;
+    AnanasList *list;
+    AnanasValue *keys;
+    UZ keys_count;
+    UZ index;
+} AnanasSequenceIterator;
+
+static B32 AnanasSequenceIteratorInit(AnanasSequenceIterator *it,
+                                      AnanasValue sequence,
+                                      UZ *items_count,
+                                      HeliosAllocator arena,
+                                      AnanasToken where,
+                                      AnanasErrorContext *error_ctx) {
+    it->sequence = sequence;
+    it->list = NULL;
+    it->keys = NULL;
+    it->keys_count = 0;
+    it->index = 0;
+
+    switch (sequence.type) {
+    case AnanasValueType_List:   it->list = sequence.u.list; *items_count = 1; return 1;
+    case AnanasValueType_Vector: *items_count = 1; return 1;
+    case AnanasValueType_Table: {
+        AnanasTableMap *map = &sequence.u.table->map;
+        it->keys = HeliosAlloc(arena, map->count * sizeof(*it->keys));
+        ERMIS_HASHMAP_FOREACH(map, key, value, {
+                (void) value;
+                it->keys[it->keys_count++] = key;
+            });
+        *items_count = 2;
+        return 1;
     }
+    default:
+        ANANAS_NATIVE_BAIL_FMT("expected a list, a vector or a table, got a value of type %s instead",
+                                AnanasTypeName(sequence.type));
+    }
+}
 
-    AnanasDString buf = {0};
-    AnanasDStringInit(&buf, arena, 1024);
-
-    for (UZ i = 0; i < args.count; ++i) {
-        AnanasValue arg = AnanasArgAt(args, i);
-        if (arg.type != AnanasValueType_String) {
-            AnanasErrorContextMessage(error_ctx,
-                                      arg.token.row,
-                                      arg.token.col,
-                                      "expected a value of type string, got %s instead",
-                                      AnanasTypeName(arg.type));
-            return 0;
+static B32 AnanasSequenceIteratorNext(AnanasSequenceIterator *it, AnanasValue *items) {
+    switch (it->sequence.type) {
+    case AnanasValueType_List: {
+        if (it->list == NULL) return 0;
+        items[0] = it->list->car;
+        it->list = it->list->cdr;
+        return 1;
+    }
+    case AnanasValueType_Vector: {
+        AnanasVector *vector = it->sequence.u.vector;
+        if (it->index >= vector->count) return 0;
+        items[0] = AnanasVectorGet(vector, it->index++);
+        return 1;
+    }
+    case AnanasValueType_Table: {
+        AnanasTableMap *map = &it->sequence.u.table->map;
+        while (it->index < it->keys_count) {
+            AnanasValue key = it->keys[it->index++];
+            AnanasValue *value = AnanasTableMapFindPtr(map, key);
+            if (value != NULL) {
+                items[0] = key;
+                items[1] = *value;
+                return 1;
+            }
         }
+        return 0;
+    }
+    default: HELIOS_UNREACHABLE();
+    }
+}
 
-        HeliosStringView sym = arg.u.string;
-        for (UZ j = 0; j < sym.count; ++j) {
-            AnanasDStringPush(&buf, sym.data[j]);
-        }
+// NOTE: Builds a sequence of the same type as the one being walked. Tables keep the key of
+// each entry and take the new value.
+typedef struct {
+    AnanasValueType type;
+    AnanasListBuilder list;
+    AnanasVector *vector;
+    AnanasTable *table;
+} AnanasSequenceBuilder;
+
+static void AnanasSequenceBuilderInit(AnanasSequenceBuilder *builder, HeliosAllocator allocator, AnanasValueType type) {
+    builder->type = type;
+    AnanasListBuilderInit(&builder->list);
+    builder->vector = NULL;
+    builder->table = NULL;
+
+    if (type == AnanasValueType_Vector) {
+        builder->vector = AnanasVectorEmpty(allocator);
+    } else if (type == AnanasValueType_Table) {
+        builder->table = HeliosAlloc(allocator, sizeof(*builder->table));
+        AnanasTableMapInit(&builder->table->map, allocator, 0);
     }
+}
 
-    result->type = AnanasValueType_String;
-    result->u.symbol.data = buf.items;
-    result->u.symbol.count = buf.count;
-    return 1;
+static void AnanasSequenceBuilderAppend(AnanasSequenceBuilder *builder,
+                                        HeliosAllocator allocator,
+                                        AnanasValue *items,
+                                        AnanasValue value) {
+    switch (builder->type) {
+    case AnanasValueType_List:   AnanasListBuilderAppend(&builder->list, allocator, value); break;
+    case AnanasValueType_Vector: builder->vector = AnanasVectorPush(allocator, builder->vector, value); break;
+    case AnanasValueType_Table:  AnanasTableMapInsert(&builder->table->map, items[0], value); break;
+    default: HELIOS_UNREACHABLE();
+    }
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasConcatSyms) {
-    if (args.count == 0) {
-        ANANAS_NATIVE_BAIL("no arguments passed to 'concat-syms'");
+static AnanasValue AnanasSequenceBuilderFinish(AnanasSequenceBuilder *builder) {
+    AnanasValue value = {.type = builder->type};
+    switch (builder->type) {
+    case AnanasValueType_List:   value.u.list = builder->list.head; break;
+    case AnanasValueType_Vector: value.u.vector = builder->vector; break;
+    case AnanasValueType_Table:  value.u.table = builder->table; break;
+    default: HELIOS_UNREACHABLE();
     }
+    return value;
+}
 
-    AnanasDString buf = {0};
-    AnanasDStringInit(&buf, arena, 1024);
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasMap) {
+    ANANAS_CHECK_ARGS_COUNT(2);
 
-    for (UZ i = 0; i < args.count; ++i) {
-        AnanasValue arg = AnanasArgAt(args, i);
-        if (arg.type != AnanasValueType_Symbol) {
-            AnanasErrorContextMessage(error_ctx,
-                                      arg.token.row,
-                                      arg.token.col,
-                                      "expected a value of type symbol, got %s instead",
-                                      AnanasTypeName(arg.type));
-            return 0;
-        }
+    ANANAS_CHECK_ARG_TYPE(0, Function, function);
 
-        HeliosStringView sym = arg.u.symbol;
-        for (UZ j = 0; j < sym.count; ++j) {
-            AnanasDStringPush(&buf, sym.data[j]);
-        }
+    AnanasSequenceIterator it;
+    UZ items_count;
+    if (!AnanasSequenceIteratorInit(&it, AnanasArgAt(args, 1), &items_count, arena, where, error_ctx)) return 0;
+
+    AnanasCallFrame frame;
+    if (!AnanasCallFrameInit(&frame, function_arg.u.function, items_count, where, arena, error_ctx)) return 0;
+
+    AnanasSequenceBuilder mapped;
+    AnanasSequenceBuilderInit(&mapped, arena, it.sequence.type);
+
+    AnanasValue items[2];
+    while (AnanasSequenceIteratorNext(&it, items)) {
+        AnanasValue value;
+        if (!AnanasCallFrameCall(&frame, items, arena, error_ctx, &value)) return 0;
+        AnanasSequenceBuilderAppend(&mapped, arena, items, value);
     }
 
-    result->type = AnanasValueType_Symbol;
-    result->u.symbol.data = buf.items;
-    result->u.symbol.count = buf.count;
-    return 1;
+    ANANAS_NATIVE_RETURN(AnanasSequenceBuilderFinish(&mapped));
 }
 
-ANANAS_DEFINE_NATIVE_FUNCTION(AnanasSubstring) {
-    (void) arena;
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasFilter) {
+    ANANAS_CHECK_ARGS_COUNT(2);
 
-    if (args.count < 2) {
-        ANANAS_NATIVE_BAIL_FMT("expected at least 2 arguments, got %zu instead", args.count);
+    ANANAS_CHECK_ARG_TYPE(0, Function, predicate);
+
+    AnanasSequenceIterator it;
+    UZ items_count;
+    if (!AnanasSequenceIteratorInit(&it, AnanasArgAt(args, 1), &items_count, arena, where, error_ctx)) return 0;
+
+    AnanasCallFrame frame;
+    if (!AnanasCallFrameInit(&frame, predicate_arg.u.function, items_count, where, arena, error_ctx)) return 0;
+
+    AnanasSequenceBuilder kept;
+    AnanasSequenceBuilderInit(&kept, arena, it.sequence.type);
+
+    AnanasValue items[2];
+    while (AnanasSequenceIteratorNext(&it, items)) {
+        AnanasValue keep;
+        if (!AnanasCallFrameCall(&frame, items, arena, error_ctx, &keep)) return 0;
+        if (AnanasConvertToBool(keep)) AnanasSequenceBuilderAppend(&kept, arena, items, items[items_count - 1]);
     }
 
-    ANANAS_CHECK_ARG_TYPE(0, String, string);
-    ANANAS_CHECK_ARG_TYPE(1, Int, start);
+    ANANAS_NATIVE_RETURN(AnanasSequenceBuilderFinish(&kept));
+}
 
-    HeliosStringView string = string_arg.u.string;
-    UZ substring_start = start_arg.u.integer;
+// NOTE: The function gets the accumulator first, followed by the item or the key and value.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasFold) {
+    ANANAS_CHECK_ARGS_COUNT(3);
 
-    if (substring_start >= string.count) {
-        result->type = AnanasValueType_String;
-        result->u.string = HELIOS_SV_LIT("");
-        return 1;
+    ANANAS_CHECK_ARG_TYPE(0, Function, function);
+
+    AnanasSequenceIterator it;
+    UZ items_count;
+    if (!AnanasSequenceIteratorInit(&it, AnanasArgAt(args, 2), &items_count, arena, where, error_ctx)) return 0;
+
+    AnanasCallFrame frame;
+    if (!AnanasCallFrameInit(&frame, function_arg.u.function, items_count + 1, where, arena, error_ctx)) return 0;
+
+    AnanasValue call_args[3];
+    call_args[0] = AnanasArgAt(args, 1);
+
+    while (AnanasSequenceIteratorNext(&it, call_args + 1)) {
+        if (!AnanasCallFrameCall(&frame, call_args, arena, error_ctx, &call_args[0])) return 0;
     }
 
-    UZ substring_count;
+    ANANAS_NATIVE_RETURN(call_args[0]);
+}
 
-    if (args.count == 2) {
-        substring_count = string.count - substring_start;
-    } else if (args.count == 3) {
-        ANANAS_CHECK_ARG_TYPE(2, Int, count);
-        substring_count = count_arg.u.integer;
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasForEach) {
+    ANANAS_CHECK_ARGS_COUNT(2);
 
-        UZ available_bytes = string.count - substring_start;
-        if (available_bytes < substring_count) {
-            ANANAS_NATIVE_BAIL_FMT("number of available bytes %zu in string is less than requested (%zu)", available_bytes, substring_count);
-        }
-    } else {
-        HELIOS_UNREACHABLE();
+    ANANAS_CHECK_ARG_TYPE(0, Function, function);
+
+    AnanasSequenceIterator it;
+    UZ items_count;
+    if (!AnanasSequenceIteratorInit(&it, AnanasArgAt(args, 1), &items_count, arena, where, error_ctx)) return 0;
+
+    AnanasCallFrame frame;
+    if (!AnanasCallFrameInit(&frame, function_arg.u.function, items_count, where, arena, error_ctx)) return 0;
+
+    AnanasValue items[2];
+    while (AnanasSequenceIteratorNext(&it, items)) {
+        AnanasValue ignored;
+        if (!AnanasCallFrameCall(&frame, items, arena, error_ctx, &ignored)) return 0;
     }
 
-    result->type = AnanasValueType_String;
-    result->u.string.data = &string.data[substring_start];
-    result->u.string.count = substring_count;
-    return 1;
+    ANANAS_NATIVE_RETURN(ANANAS_FALSE);
 }
 
 ANANAS_DECLARE_NATIVE_FUNCTION(AnanasPrintBuiltin) {
+    (void) arena;
     ANANAS_CHECK_ARGS_COUNT(1);
 
     AnanasValue value = AnanasArgAt(args, 0);
 
-    HeliosStringView string = AnanasPrint(arena, value);
-    printf(HELIOS_SV_FMT "\n", HELIOS_SV_ARG(string));
+    AnanasPrintStdout(value);
     ANANAS_NATIVE_RETURN(value);
 }
 
@@ -593,59 +1652,60 @@ ANANAS_DECLARE_NATIVE_FUNCTION(AnanasPrintString) {
     ANANAS_CHECK_ARG_TYPE(0, String, s);
 
     HeliosStringView s = s_arg.u.string;
-    printf(HELIOS_SV_FMT "\n", HELIOS_SV_ARG(s));
+    AnanasOutputPort *out = AnanasStdout();
+    AnanasOutputPortWrite(out, s);
+    AnanasOutputPortWrite(out, HELIOS_SV_LIT("\n"));
     ANANAS_NATIVE_RETURN(s_arg);
 }
 
-ANANAS_DECLARE_NATIVE_FUNCTION(AnanasRead) {
-    ANANAS_CHECK_ARGS_COUNT(1);
-
-    ANANAS_CHECK_ARG_TYPE(0, String, source);
-
-    HeliosStringView source = source_arg.u.string;
+// NOTE: Writes the string as the whole contents of the file, bypassing stdout altogether. The
+// file is written in place, so it keeps its permissions and symlinks stay symlinks.
+ANANAS_DEFINE_NATIVE_FUNCTION(AnanasWriteFile) {
+    (void) arena;
+    ANANAS_CHECK_ARGS_COUNT(2);
 
-    HeliosString8Stream source_stream;
-    HeliosString8StreamInit(&source_stream, source.data, source.count);
+    ANANAS_CHECK_ARG_TYPE(0, String, file_name);
+    ANANAS_CHECK_ARG_TYPE(1, String, contents);
 
-    AnanasLexer lexer;
-    AnanasLexerInit(&lexer, &source_stream);
+    AnanasPlatformFile file;
+    if (!AnanasPlatformCreateFile(file_name_arg.u.string, &file)) ANANAS_NATIVE_RETURN(ANANAS_FALSE);
 
-    AnanasReaderTable reader_table;
-    AnanasReaderTableInit(&reader_table, arena);
+    HeliosStringView contents = contents_arg.u.string;
+    B32 ok = AnanasPlatformWriteFileGather(file, &contents, 1);
+    AnanasPlatformCloseFile(file);
+    ANANAS_NATIVE_RETURN(ANANAS_BOOL(ok));
+}
 
-    AnanasList *result_list = NULL;
-    AnanasList *current_list = result_list;
+ANANAS_DECLARE_NATIVE_FUNCTION(AnanasRead) {
+    ANANAS_CHECK_ARGS_COUNT(1);
 
-    AnanasValue read_result;
-    while (AnanasReaderNext(&lexer, &reader_table, arena, &read_result, error_ctx)) {
-        AnanasList *list = HeliosAlloc(arena, sizeof(*list));
-        list->car = read_result;
+    ANANAS_CHECK_ARG_TYPE(0, String, source);
 
-        if (result_list == NULL) {
-            result_list = list;
-            current_list = list;
-        } else {
-            current_list->cdr = list;
-            current_list = list;
-        }
-    }
+    HeliosStringView source = source_arg.u.string;
 
-    if (!error_ctx->ok) return 0;
+    AnanasListBuilder forms;
+    AnanasListBuilderInit(&forms);
+    if (!AnanasReadAllForms(source, arena, &forms, error_ctx)) return 0;
 
     result->type = AnanasValueType_List;
-    result->u.list = result_list;
+    result->u.list = forms.head;
     return 1;
 }
 
 static B32 AnanasEqual(AnanasValue lhs, AnanasValue rhs) {
+    lhs = AnanasValueFlatten(lhs);
+    rhs = AnanasValueFlatten(rhs);
+
     if (lhs.type != rhs.type) return 0;
 
     switch (lhs.type) {
+    case AnanasValueType_StringBuilder: HELIOS_UNREACHABLE();
     case AnanasValueType_Int: return lhs.u.integer == rhs.u.integer;
     case AnanasValueType_Bool: return lhs.u.boolean == rhs.u.boolean;
     case AnanasValueType_String: return HeliosStringViewEqual(lhs.u.string, rhs.u.string);
     case AnanasValueType_Function: return lhs.u.function == rhs.u.function;
     case AnanasValueType_Macro: return lhs.u.macro == rhs.u.macro;
+    case AnanasValueType_Table: return lhs.u.table == rhs.u.table;
     case AnanasValueType_Symbol: return HeliosStringViewEqual(lhs.u.symbol, rhs.u.symbol);
     case AnanasValueType_List: {
         AnanasList *lhs_list = lhs.u.list;
@@ -664,6 +1724,34 @@ static B32 AnanasEqual(AnanasValue lhs, AnanasValue rhs) {
 
         return rhs_list == NULL;
     }
+    case AnanasValueType_Vector: {
+        AnanasVector *lhs_vector = lhs.u.vector;
+        AnanasVector *rhs_vector = rhs.u.vector;
+        if (lhs_vector->count != rhs_vector->count) return 0;
+
+        for (UZ i = 0; i < lhs_vector->count; ++i) {
+            if (!AnanasEqual(AnanasVectorGet(lhs_vector, i), AnanasVectorGet(rhs_vector, i))) return 0;
+        }
+
+        return 1;
+    }
+    case AnanasValueType_HashMap: {
+        AnanasHashMap *lhs_map = lhs.u.hash_map;
+        AnanasHashMap *rhs_map = rhs.u.hash_map;
+        if (lhs_map->count != rhs_map->count) return 0;
+        if (lhs_map->root == rhs_map->root) return 1;
+
+        AnanasHashMapIterator it;
+        AnanasHashMapIteratorInit(&it, lhs_map);
+
+        AnanasHashMapEntry entry;
+        while (AnanasHashMapIteratorNext(&it, &entry)) {
+            AnanasValue *rhs_value = AnanasHashMapFind(rhs_map, entry.key);
+            if (rhs_value == NULL || !AnanasEqual(entry.value, *rhs_value)) return 0;
+        }
+
+        return 1;
+    }
     }
 
     HELIOS_UNREACHABLE();
@@ -788,8 +1876,12 @@ B32 AnanasEval(AnanasValue node, HeliosAllocator arena, AnanasEnv *env, AnanasVa
     switch (node.type) {
     case AnanasValueType_Macro:
     case AnanasValueType_Function:
+    case AnanasValueType_Table:
+    case AnanasValueType_HashMap:
+    case AnanasValueType_Vector:
     case AnanasValueType_Bool:
     case AnanasValueType_String:
+    case AnanasValueType_StringBuilder:
     case AnanasValueType_Int: {
         *result = node;
         return 1;
@@ -969,6 +2061,8 @@ B32 AnanasEval(AnanasValue node, HeliosAllocator arena, AnanasEnv *env, AnanasVa
             AnanasParams lambda_params;
             if (!AnanasParseParamsFromList(arena, lambda_params_list, &lambda_params, error_ctx)) return 0;
 
+            AnanasEnvMarkCaptured(env);
+
             AnanasUserFunction lambda = {
                 .params = lambda_params,
                 .body = lambda_body,
@@ -1061,8 +2155,8 @@ B32 AnanasEval(AnanasValue node, HeliosAllocator arena, AnanasEnv *env, AnanasVa
                 return 0;
             }
 
-            AnanasEnv let_env;
-            AnanasEnvInit(&let_env, env, arena);
+            AnanasEnv *let_env = HeliosAlloc(arena, sizeof(*let_env));
+            AnanasEnvInit(let_env, env, arena);
             AnanasList *bindings_list = bindings_value.u.list;
 
             while (bindings_list != NULL) {
@@ -1114,15 +2208,15 @@ B32 AnanasEval(AnanasValue node, HeliosAllocator arena, AnanasEnv *env, AnanasVa
                 AnanasValue binding_pair_given_value = binding_pair->cdr->car;
 
                 AnanasValue binding_pair_value;
-                if (!AnanasEval(binding_pair_given_value, arena, &let_env, &binding_pair_value, error_ctx)) return 0;
+                if (!AnanasEval(binding_pair_given_value, arena, let_env, &binding_pair_value, error_ctx)) return 0;
 
-                AnanasEnvMapInsert(&let_env.map, binding_pair_name, binding_pair_value);
+                AnanasEnvMapInsert(&let_env->map, binding_pair_name, binding_pair_value);
 
                 bindings_list = bindings_list->cdr;
             }
 
             AnanasList *forms_to_eval = args_list->cdr;
-            return AnanasEvalFormList(forms_to_eval, arena, &let_env, error_ctx, result);
+            return AnanasEvalFormList(forms_to_eval, arena, let_env, error_ctx, result);
         } else if (HeliosStringViewEqualCStr(sym_name, "quote")) {
             AnanasList *args_list = list->cdr;
             if (args_list == NULL) {
@@ -1194,6 +2288,8 @@ B32 AnanasEval(AnanasValue node, HeliosAllocator arena, AnanasEnv *env, AnanasVa
 
             AnanasList *macro_body = args_list->cdr;
 
+            AnanasEnvMarkCaptured(env);
+
             AnanasUserMacro user_macro = {
                 .body = macro_body,
                 .enclosing_env = env,
@@ -1288,26 +2384,15 @@ B32 AnanasEval(AnanasValue node, HeliosAllocator arena, AnanasEnv *env, AnanasVa
 
             AnanasFunction *function = fn_arg.u.function;
 
-            AnanasList *args_list = NULL;
-            AnanasList *current_args_list = NULL;
+            AnanasListBuilder args_list;
+            AnanasListBuilderInit(&args_list);
+            AnanasList *last_list = NULL;
 
             apply_args = apply_args->cdr;
 
-#define APPEND(val) do { \
-            AnanasList *car = HeliosAlloc(arena, sizeof(*car)); \
-    car->car = (val); \
-    if (args_list == NULL) { \
-        args_list = (car); \
-        current_args_list = (car); \
-    } else { \
-        current_args_list->cdr = (car); \
-        current_args_list = (car); \
-    } \
-} while (0)
-
             while (apply_args != NULL && apply_args->cdr != NULL) {
                 AnanasValue arg = apply_args->car;
-                APPEND(arg);
+                AnanasListBuilderAppend(&args_list, arena, arg);
                 apply_args = apply_args->cdr;
             }
 
@@ -1325,17 +2410,12 @@ B32 AnanasEval(AnanasValue node, HeliosAllocator arena, AnanasEnv *env, AnanasVa
                     return 0;
                 }
 
-                AnanasList *list = last_arg.u.list;
-                while (list != NULL) {
-                    APPEND(list->car);
-                    list = list->cdr;
-                }
+                last_list = last_arg.u.list;
             }
 
-            #undef APPEND
-
+            // NOTE: The argument list is only read, so the last list is shared instead of copied.
             return AnanasEvalFunctionWithArgumentList(function,
-                                                      args_list,
+                                                      AnanasListBuilderFinish(&args_list, last_list),
                                                       node.token,
                                                       arena,
                                                       env,
@@ -1365,12 +2445,12 @@ B32 AnanasEval(AnanasValue node, HeliosAllocator arena, AnanasEnv *env, AnanasVa
             } else if (callable_node->type == AnanasValueType_Macro) {
                 AnanasMacro *macro = callable_node->u.macro;
                 AnanasValue macro_result;
-                if (!AnanasEvalMacroWithArgumentList(macro,
-                                                     node.token,
-                                                     list->cdr,
-                                                     arena,
-                                                     error_ctx,
-                                                     &macro_result)) return 0;
+                if (!AnanasExpandMacroCallSite(macro,
+                                               node.token,
+                                               list,
+                                               arena,
+                                               error_ctx,
+                                               &macro_result)) return 0;
                 B32 res = AnanasEval(macro_result, arena, env, result, error_ctx);
                 return res;
             } else {
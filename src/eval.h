@@ -9,10 +9,17 @@ ERMIS_DECL_HASHMAP(HeliosStringView, AnanasValue, AnanasEnvMap)
 typedef struct AnanasEnv {
     struct AnanasEnv *parent_env;
     AnanasEnvMap map;
+    // NOTE: Set once a lambda or a macro closes over the env or one of its children.
+    B32 captured;
 } AnanasEnv;
 
 void AnanasEnvInit(AnanasEnv *env, AnanasEnv *parent_env, HeliosAllocator allocator);
 void AnanasRootEnvPopulate(AnanasEnv *env);
+AnanasValue *AnanasEnvLookup(AnanasEnv *env, HeliosStringView name);
+
+// NOTE: Natives are referred to by name wherever a function pointer can not be stored.
+B32 AnanasNativeFunctionName(AnanasNativeFunction func, HeliosStringView *name);
+B32 AnanasNativeFunctionByName(HeliosStringView name, AnanasNativeFunction *func);
 
 B32 AnanasEvalMacroWithArgumentList(AnanasMacro *macro,
                                     AnanasToken where,
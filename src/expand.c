@@ -0,0 +1,300 @@
+#include "expand.h"
+
+// NOTE: Names bound by `let`, the params of a `lambda` and the `var`s and `macro`s of their
+// bodies. A call whose head is one of them is left to the evaluator, even if a macro of the
+// same name is visible in the expansion env.
+typedef struct ExpandBinding {
+    struct ExpandBinding *next;
+    HeliosStringView name;
+} ExpandBinding;
+
+typedef struct ExpandScope {
+    struct ExpandScope *parent;
+    ExpandBinding *bindings;
+} ExpandScope;
+
+static void ExpandScopeBind(ExpandScope *scope, HeliosAllocator allocator, AnanasValue name) {
+    if (scope == NULL || name.type != AnanasValueType_Symbol) return;
+
+    ExpandBinding *binding = HeliosAlloc(allocator, sizeof(*binding));
+    binding->name = name.u.symbol;
+    binding->next = scope->bindings;
+    scope->bindings = binding;
+}
+
+static B32 ExpandScopeIsBound(ExpandScope *scope, HeliosStringView name) {
+    for (; scope != NULL; scope = scope->parent) {
+        for (ExpandBinding *binding = scope->bindings; binding != NULL; binding = binding->next) {
+            if (HeliosStringViewEqual(binding->name, name)) return 1;
+        }
+    }
+
+    return 0;
+}
+
+static AnanasValue ListValueLike(AnanasValue like, AnanasList *list) {
+    AnanasValue value = like;
+    value.type = AnanasValueType_List;
+    value.u.list = list;
+    return value;
+}
+
+static B32 IsForm(AnanasList *list, const char *name) {
+    return list != NULL
+        && list->car.type == AnanasValueType_Symbol
+        && HeliosStringViewEqualCStr(list->car.u.symbol, name);
+}
+
+static B32 ExpandForm(AnanasValue form,
+                      HeliosAllocator allocator,
+                      AnanasEnv *env,
+                      ExpandScope *scope,
+                      AnanasValue *result,
+                      AnanasErrorContext *error_ctx);
+
+static B32 ExpandEach(AnanasList *list,
+                      HeliosAllocator allocator,
+                      AnanasEnv *env,
+                      ExpandScope *scope,
+                      AnanasListBuilder *builder,
+                      AnanasErrorContext *error_ctx) {
+    while (list != NULL) {
+        AnanasValue expanded;
+        if (!ExpandForm(list->car, allocator, env, scope, &expanded, error_ctx)) return 0;
+        AnanasListBuilderAppend(builder, allocator, expanded);
+        list = list->cdr;
+    }
+
+    return 1;
+}
+
+// NOTE: Quoted forms are data, only the parts under `unquote` and `unquote-splice` are
+// evaluated and need expanding.
+static B32 ExpandTemplate(AnanasValue form,
+                          HeliosAllocator allocator,
+                          AnanasEnv *env,
+                          ExpandScope *scope,
+                          AnanasValue *result,
+                          AnanasErrorContext *error_ctx) {
+    if (form.type != AnanasValueType_List || form.u.list == NULL) {
+        *result = form;
+        return 1;
+    }
+
+    AnanasList *list = form.u.list;
+    AnanasListBuilder builder = {0};
+
+    if ((IsForm(list, "unquote") || IsForm(list, "unquote-splice")) && list->cdr != NULL) {
+        AnanasListBuilderAppend(&builder, allocator, list->car);
+
+        AnanasValue expanded;
+        if (!ExpandForm(list->cdr->car, allocator, env, scope, &expanded, error_ctx)) return 0;
+        AnanasListBuilderAppend(&builder, allocator, expanded);
+
+        *result = ListValueLike(form, AnanasListBuilderFinish(&builder, list->cdr->cdr));
+        return 1;
+    }
+
+    while (list != NULL) {
+        AnanasValue expanded;
+        if (!ExpandTemplate(list->car, allocator, env, scope, &expanded, error_ctx)) return 0;
+        AnanasListBuilderAppend(&builder, allocator, expanded);
+        list = list->cdr;
+    }
+
+    *result = ListValueLike(form, builder.head);
+    return 1;
+}
+
+static B32 ExpandForm(AnanasValue form,
+                      HeliosAllocator allocator,
+                      AnanasEnv *env,
+                      ExpandScope *scope,
+                      AnanasValue *result,
+                      AnanasErrorContext *error_ctx) {
+    while (1) {
+        if (form.type != AnanasValueType_List || form.u.list == NULL) {
+            *result = form;
+            return 1;
+        }
+
+        AnanasList *list = form.u.list;
+        if (list->car.type != AnanasValueType_Symbol) break;
+
+        HeliosStringView sym_name = list->car.u.symbol;
+        AnanasListBuilder builder = {0};
+
+        if (HeliosStringViewEqualCStr(sym_name, "quote")) {
+            AnanasListBuilderAppend(&builder, allocator, list->car);
+
+            for (AnanasList *arg = list->cdr; arg != NULL; arg = arg->cdr) {
+                AnanasValue expanded;
+                if (!ExpandTemplate(arg->car, allocator, env, scope, &expanded, error_ctx)) return 0;
+                AnanasListBuilderAppend(&builder, allocator, expanded);
+            }
+
+            *result = ListValueLike(form, builder.head);
+            return 1;
+        } else if (HeliosStringViewEqualCStr(sym_name, "macro") || HeliosStringViewEqualCStr(sym_name, "macroexpand")) {
+            // NOTE: Both take their arguments unevaluated, the evaluator expands them if it ever runs them.
+            if (list->cdr != NULL && HeliosStringViewEqualCStr(sym_name, "macro")) {
+                ExpandScopeBind(scope, allocator, list->cdr->car);
+            }
+
+            *result = form;
+            return 1;
+        } else if (HeliosStringViewEqualCStr(sym_name, "lambda")) {
+            if (list->cdr == NULL) {
+                *result = form;
+                return 1;
+            }
+
+            ExpandScope lambda_scope = {.parent = scope};
+            if (list->cdr->car.type == AnanasValueType_List) {
+                for (AnanasList *param = list->cdr->car.u.list; param != NULL; param = param->cdr) {
+                    ExpandScopeBind(&lambda_scope, allocator, param->car);
+                }
+            }
+
+            // NOTE: The params stay as they are.
+            AnanasListBuilderAppend(&builder, allocator, list->car);
+            AnanasListBuilderAppend(&builder, allocator, list->cdr->car);
+            if (!ExpandEach(list->cdr->cdr, allocator, env, &lambda_scope, &builder, error_ctx)) return 0;
+
+            *result = ListValueLike(form, builder.head);
+            return 1;
+        } else if (HeliosStringViewEqualCStr(sym_name, "var") || HeliosStringViewEqualCStr(sym_name, "set")) {
+            if (list->cdr == NULL) {
+                *result = form;
+                return 1;
+            }
+
+            // NOTE: The name of the variable stays as it is, the value is expanded before
+            // the name is bound, the same way the evaluator runs it.
+            AnanasListBuilderAppend(&builder, allocator, list->car);
+            AnanasListBuilderAppend(&builder, allocator, list->cdr->car);
+            if (!ExpandEach(list->cdr->cdr, allocator, env, scope, &builder, error_ctx)) return 0;
+
+            if (HeliosStringViewEqualCStr(sym_name, "var")) ExpandScopeBind(scope, allocator, list->cdr->car);
+
+            *result = ListValueLike(form, builder.head);
+            return 1;
+        } else if (HeliosStringViewEqualCStr(sym_name, "let")) {
+            if (list->cdr == NULL || list->cdr->car.type != AnanasValueType_List) {
+                *result = form;
+                return 1;
+            }
+
+            // NOTE: Binding values are evaluated in the let env one after another, so every
+            // value already sees the names bound before it.
+            ExpandScope let_scope = {.parent = scope};
+
+            AnanasListBuilder bindings = {0};
+            for (AnanasList *binding = list->cdr->car.u.list; binding != NULL; binding = binding->cdr) {
+                AnanasValue pair_value = binding->car;
+                if (pair_value.type != AnanasValueType_List || pair_value.u.list == NULL) {
+                    AnanasListBuilderAppend(&bindings, allocator, pair_value);
+                    continue;
+                }
+
+                AnanasListBuilder pair = {0};
+                AnanasListBuilderAppend(&pair, allocator, pair_value.u.list->car);
+                if (!ExpandEach(pair_value.u.list->cdr, allocator, env, &let_scope, &pair, error_ctx)) return 0;
+                AnanasListBuilderAppend(&bindings, allocator, ListValueLike(pair_value, pair.head));
+
+                ExpandScopeBind(&let_scope, allocator, pair_value.u.list->car);
+            }
+
+            AnanasListBuilderAppend(&builder, allocator, list->car);
+            AnanasListBuilderAppend(&builder, allocator, ListValueLike(list->cdr->car, bindings.head));
+            if (!ExpandEach(list->cdr->cdr, allocator, env, &let_scope, &builder, error_ctx)) return 0;
+
+            *result = ListValueLike(form, builder.head);
+            return 1;
+        }
+
+        if (ExpandScopeIsBound(scope, sym_name)) break;
+
+        AnanasValue *callable = AnanasEnvLookup(env, sym_name);
+        if (callable == NULL || callable->type != AnanasValueType_Macro) break;
+
+        AnanasValue expansion;
+        if (!AnanasEvalMacroWithArgumentList(callable->u.macro,
+                                             form.token,
+                                             list->cdr,
+                                             allocator,
+                                             error_ctx,
+                                             &expansion)) return 0;
+
+        // NOTE: The expansion may itself be a macro call, keep going until it is not.
+        form = expansion;
+    }
+
+    AnanasListBuilder builder = {0};
+    if (!ExpandEach(form.u.list, allocator, env, scope, &builder, error_ctx)) return 0;
+
+    *result = ListValueLike(form, builder.head);
+    return 1;
+}
+
+static B32 IsMacroDefinition(AnanasValue form) {
+    return form.type == AnanasValueType_List && IsForm(form.u.list, "macro");
+}
+
+B32 AnanasExpand(AnanasValue form,
+                 HeliosAllocator allocator,
+                 AnanasEnv *env,
+                 AnanasValue *result,
+                 AnanasErrorContext *error_ctx) {
+    if (IsMacroDefinition(form)) return AnanasEval(form, allocator, env, result, error_ctx);
+
+    return ExpandForm(form, allocator, env, NULL, result, error_ctx);
+}
+
+// NOTE: Macros of a compiled program may call the functions it defines at the top level, so
+// those definitions are run in the expansion env too. Only definitions whose value can't have
+// side effects qualify: lambdas, quoted forms and self-evaluating atoms. Anything else would
+// run twice, once while expanding and once in the compiled program.
+static B32 IsCompileTimeDefinition(AnanasValue form) {
+    if (form.type != AnanasValueType_List || !IsForm(form.u.list, "var")) return 0;
+
+    AnanasList *args = form.u.list->cdr;
+    if (args == NULL || args->car.type != AnanasValueType_Symbol) return 0;
+    if (args->cdr == NULL || args->cdr->cdr != NULL) return 0;
+
+    AnanasValue value = args->cdr->car;
+    switch (value.type) {
+    case AnanasValueType_Int:
+    case AnanasValueType_String:
+    case AnanasValueType_Bool:
+        return 1;
+    case AnanasValueType_List:
+        return IsForm(value.u.list, "lambda") || IsForm(value.u.list, "quote");
+    default:
+        return 0;
+    }
+}
+
+B32 AnanasExpandProgram(AnanasValueArray program,
+                        HeliosAllocator allocator,
+                        AnanasEnv *env,
+                        AnanasValueArray *expanded,
+                        AnanasErrorContext *error_ctx) {
+    for (UZ i = 0; i < program.count; ++i) {
+        AnanasValue form = program.items[i];
+
+        AnanasValue expanded_form;
+        if (!AnanasExpand(form, allocator, env, &expanded_form, error_ctx)) return 0;
+
+        if (IsMacroDefinition(form)) continue;
+
+        if (IsCompileTimeDefinition(expanded_form)) {
+            AnanasValue defined;
+            if (!AnanasEval(expanded_form, allocator, env, &defined, error_ctx)) return 0;
+        }
+
+        AnanasValueArrayPush(expanded, expanded_form);
+    }
+
+    return 1;
+}
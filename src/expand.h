@@ -0,0 +1,25 @@
+#ifndef ANANAS_EXPAND_H_
+#define ANANAS_EXPAND_H_
+
+#include "eval.h"
+
+// NOTE: Returns `form` with every macro call in it expanded, macro bodies are run by the
+// evaluator in `env`. Calls whose head is bound by an enclosing `let` or `lambda` are not
+// expanded. A top-level `macro` form is evaluated in `env` right away, so that the forms after
+// it can use the macro, and the macro itself is returned in its place.
+B32 AnanasExpand(AnanasValue form,
+                 HeliosAllocator allocator,
+                 AnanasEnv *env,
+                 AnanasValue *result,
+                 AnanasErrorContext *error_ctx);
+
+// NOTE: Expands the forms of a whole program in order. Macro definitions only matter at
+// expansion time, so they are dropped from `expanded`. Top-level function definitions are
+// also evaluated in `env`, so that the macros after them can call them.
+B32 AnanasExpandProgram(AnanasValueArray program,
+                        HeliosAllocator allocator,
+                        AnanasEnv *env,
+                        AnanasValueArray *expanded,
+                        AnanasErrorContext *error_ctx);
+
+#endif // ANANAS_EXPAND_H_
@@ -231,12 +231,7 @@ HELIOS_INLINE char *HeliosStringViewCloneToCStr(HeliosAllocator allocator, Helio
 
 HELIOS_INLINE B32 HeliosStringViewStartsWithSV(HeliosStringView sv, HeliosStringView prefix) {
     if (prefix.count > sv.count) return 0;
-
-    for (UZ i = 0; i < prefix.count; ++i) {
-        if (sv.data[i] != prefix.data[i]) return 0;
-    }
-
-    return 1;
+    return memcmp(sv.data, prefix.data, prefix.count) == 0;
 }
 
 HELIOS_INLINE B32 HeliosStringViewStartsWith(HeliosStringView sv, const char *prefix) {
@@ -276,7 +271,7 @@ HELIOS_INLINE HeliosStringView HeliosString8View(HeliosString8 s) {
 HELIOS_INLINE HeliosString8 HeliosString8FromSV(HeliosAllocator allocator, HeliosStringView sv) {
     U8 *data = (U8 *)HeliosAlloc(allocator, sv.count + 1);
     memcpy(data, sv.data, sv.count);
-    data[sv.count + 1] = '\0';
+    data[sv.count] = '\0';
 
     return (HeliosString8) {
         .data = data,
@@ -653,6 +648,7 @@ HELIOS_DEF HeliosStringView HeliosReadEntireFile(HeliosAllocator allocator, Heli
     struct stat file_stat;
     int ret = fstat(fd, &file_stat);
     if (ret == -1) {
+        close(fd);
         return (HeliosStringView) {.data = NULL, .count = 0};
     }
 
@@ -662,13 +658,15 @@ HELIOS_DEF HeliosStringView HeliosReadEntireFile(HeliosAllocator allocator, Heli
     size_t total_bytes_read = 0;
     while (total_bytes_read != file_size) {
         ssize_t n = read(fd, &file_buf[total_bytes_read], file_size - total_bytes_read);
-        if (n == -1) {
+        if (n <= 0) {
+            close(fd);
             HeliosFree(allocator, file_buf, file_size);
             return (HeliosStringView) {.data = NULL, .count = 0};
         }
         total_bytes_read += (size_t)n;
     }
 
+    close(fd);
     return (HeliosStringView) {.data = file_buf, .count = file_size};
 }
 #endif // HELIOS_PLATFORM_POSIX
@@ -695,6 +693,7 @@ HELIOS_DEF HeliosStringView HeliosReadEntireFile(HeliosAllocator allocator, Heli
     DWORD high_bits = 0;
     DWORD low_bits = GetFileSize(file_handle, &high_bits);
     if (low_bits == INVALID_FILE_SIZE) {
+        CloseHandle(file_handle);
         return (HeliosStringView) {.data = NULL, .count = 0};
     }
 
@@ -707,6 +706,8 @@ HELIOS_DEF HeliosStringView HeliosReadEntireFile(HeliosAllocator allocator, Heli
                        file_size,
                        &n_read,
                        NULL);
+    CloseHandle(file_handle);
+
     if (!ok) {
         HeliosFree(allocator, buffer, file_size);
         return (HeliosStringView) {.data = NULL, .count = 0};
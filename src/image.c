@@ -0,0 +1,696 @@
+#include "image.h"
+#include "platform.h"
+#include "persistent.h"
+
+// NOTE: Layout of an image:
+//
+//     header | objects | relocations | natives | envs | tables | hash maps | vectors
+//
+// Objects are stored with their in-memory layout, every pointer inside them holds an offset
+// from the start of the image instead, and the offset of each such pointer is listed in the
+// relocation table. Offset 0 is the header, so it doubles as NULL. Native functions can not
+// be relocated, they are stored by name and resolved when the image is loaded.
+
+#define IMAGE_MAGIC "ANIM"
+#define IMAGE_VERSION 5
+
+typedef struct {
+    U8 magic[4];
+    U32 version;
+    U32 value_size;
+    U32 pointer_size;
+
+    U64 root_env;
+    U64 relocs_offset;
+    U64 relocs_count;
+    U64 natives_offset;
+    U64 natives_count;
+    U64 envs_offset;
+    U64 envs_count;
+    U64 tables_offset;
+    U64 tables_count;
+    U64 hash_maps_offset;
+    U64 hash_maps_count;
+    U64 vectors_offset;
+    U64 vectors_count;
+} ImageHeader;
+
+typedef struct {
+    U64 field;
+    U64 name_offset;
+    U64 name_count;
+} ImageNative;
+
+// NOTE: The map of the env is not stored, it is rebuilt from the entries on load.
+typedef struct {
+    AnanasEnv env;
+    U64 entries_offset;
+    U64 entries_count;
+} ImageEnv;
+
+typedef struct {
+    HeliosStringView key;
+    AnanasValue value;
+} ImageEnvEntry;
+
+// NOTE: Same as with envs, the map of a table is rebuilt from the entries on load.
+typedef struct {
+    AnanasTable table;
+    U64 entries_offset;
+    U64 entries_count;
+} ImageTable;
+
+typedef struct {
+    AnanasValue key;
+    AnanasValue value;
+} ImageTableEntry;
+
+// NOTE: Persistent collections are stored as their items and rebuilt on load as well, the
+// nodes they shared with other collections are not shared anymore after that.
+typedef struct {
+    AnanasHashMap hash_map;
+    U64 entries_offset;
+    U64 entries_count;
+} ImageHashMap;
+
+typedef struct {
+    AnanasVector vector;
+    U64 items_offset;
+    U64 items_count;
+} ImageVector;
+
+static B32 PointerEqual(UZ lhs, UZ rhs) {
+    return lhs == rhs;
+}
+
+static U64 PointerHash(UZ ptr) {
+    return AnanasPointerHash((const void *)ptr);
+}
+
+ERMIS_DECL_HASHMAP(UZ, U64, AnanasImageObjectMap)
+ERMIS_IMPL_HASHMAP(UZ, U64, AnanasImageObjectMap, PointerEqual, PointerHash)
+
+ERMIS_DECL_HASHMAP(HeliosStringView, U64, AnanasImageStringMap)
+ERMIS_IMPL_HASHMAP(HeliosStringView, U64, AnanasImageStringMap, HeliosStringViewEqual, AnanasFnv1Hash)
+
+ERMIS_DECL_ARRAY(U64, AnanasImageOffsetArray)
+ERMIS_IMPL_ARRAY(U64, AnanasImageOffsetArray)
+
+ERMIS_DECL_ARRAY(ImageNative, AnanasImageNativeArray)
+ERMIS_IMPL_ARRAY(ImageNative, AnanasImageNativeArray)
+
+typedef struct {
+    AnanasDString image;
+    AnanasImageObjectMap objects;
+    AnanasImageStringMap strings;
+    AnanasImageOffsetArray relocs;
+    AnanasImageNativeArray natives;
+    AnanasImageOffsetArray envs;
+    AnanasImageOffsetArray tables;
+    AnanasImageOffsetArray hash_maps;
+    AnanasImageOffsetArray vectors;
+    AnanasErrorContext *error_ctx;
+} Writer;
+
+static U64 Reserve(Writer *w, UZ size) {
+    static const U8 zeros[64] = {0};
+
+    UZ offset = (w->image.count + 7) & ~(UZ)7;
+    UZ to_append = offset - w->image.count + size;
+    while (to_append > 0) {
+        UZ chunk = HELIOS_MIN(to_append, sizeof(zeros));
+        AnanasDStringAppend(&w->image, zeros, chunk);
+        to_append -= chunk;
+    }
+
+    return offset;
+}
+
+static void SetField(Writer *w, U64 at, const void *data, UZ size) {
+    memcpy(w->image.items + at, data, size);
+}
+
+static void SetU64(Writer *w, U64 at, U64 value) {
+    SetField(w, at, &value, sizeof(value));
+}
+
+static void SetPointer(Writer *w, U64 at, U64 target) {
+    UZ value = target;
+    SetField(w, at, &value, sizeof(value));
+    if (target != 0) AnanasImageOffsetArrayPush(&w->relocs, at);
+}
+
+static B32 FindObject(Writer *w, const void *ptr, U64 *offset) {
+    return AnanasImageObjectMapFind(&w->objects, (UZ)ptr, offset);
+}
+
+static void RememberObject(Writer *w, const void *ptr, U64 offset) {
+    AnanasImageObjectMapInsert(&w->objects, (UZ)ptr, offset);
+}
+
+static U64 WriteString(Writer *w, HeliosStringView sv) {
+    if (sv.count == 0) return 0;
+
+    U64 offset;
+    if (AnanasImageStringMapFind(&w->strings, sv, &offset)) return offset;
+
+    offset = Reserve(w, sv.count);
+    SetField(w, offset, sv.data, sv.count);
+    AnanasImageStringMapInsert(&w->strings, sv, offset);
+    return offset;
+}
+
+static void WriteStringView(Writer *w, U64 at, HeliosStringView sv) {
+    HeliosStringView copy = {.data = NULL, .count = sv.count};
+    SetField(w, at, &copy, sizeof(copy));
+    SetPointer(w, at + offsetof(HeliosStringView, data), WriteString(w, sv));
+}
+
+static B32 WriteValue(Writer *w, U64 at, AnanasValue value);
+static B32 WriteEnv(Writer *w, AnanasEnv *env, U64 *out);
+
+static B32 WriteList(Writer *w, AnanasList *list, U64 *out) {
+    *out = 0;
+
+    U64 prev = 0;
+    while (list != NULL) {
+        U64 node;
+        if (FindObject(w, list, &node)) {
+            if (prev != 0) SetPointer(w, prev + offsetof(AnanasList, cdr), node);
+            else *out = node;
+            break;
+        }
+
+        node = Reserve(w, sizeof(AnanasList));
+        RememberObject(w, list, node);
+
+        if (prev != 0) SetPointer(w, prev + offsetof(AnanasList, cdr), node);
+        else *out = node;
+
+        if (!WriteValue(w, node + offsetof(AnanasList, car), list->car)) return 0;
+
+        prev = node;
+        list = list->cdr;
+    }
+
+    return 1;
+}
+
+static void WriteParams(Writer *w, U64 at, AnanasParams params) {
+    U64 names = 0;
+    if (params.count > 0) {
+        names = Reserve(w, sizeof(HeliosStringView) * params.count);
+        for (UZ i = 0; i < params.count; ++i) {
+            WriteStringView(w, names + i * sizeof(HeliosStringView), params.names[i]);
+        }
+    }
+
+    AnanasParams copy = params;
+    copy.names = NULL;
+    SetField(w, at, &copy, sizeof(copy));
+    SetPointer(w, at + offsetof(AnanasParams, names), names);
+}
+
+static B32 WriteNative(Writer *w, U64 field, AnanasNativeFunction native) {
+    HeliosStringView name;
+    if (!AnanasNativeFunctionName(native, &name)) {
+        AnanasErrorContextMessage(w->error_ctx, 0, 0, "can not dump a native function that is not registered");
+        return 0;
+    }
+
+    ImageNative record = {
+        .field = field,
+        .name_offset = WriteString(w, name),
+        .name_count = name.count,
+    };
+    AnanasImageNativeArrayPush(&w->natives, record);
+    return 1;
+}
+
+// NOTE: User functions and user macros share the layout of their fields.
+static B32 WriteUserCallable(Writer *w, U64 at, AnanasParams params, AnanasList *body, AnanasEnv *enclosing_env) {
+    WriteParams(w, at + offsetof(AnanasUserFunction, params), params);
+
+    U64 body_offset;
+    if (!WriteList(w, body, &body_offset)) return 0;
+    SetPointer(w, at + offsetof(AnanasUserFunction, body), body_offset);
+
+    U64 env_offset;
+    if (!WriteEnv(w, enclosing_env, &env_offset)) return 0;
+    SetPointer(w, at + offsetof(AnanasUserFunction, enclosing_env), env_offset);
+
+    return 1;
+}
+
+static B32 WriteFunction(Writer *w, AnanasFunction *function, U64 *out) {
+    if (FindObject(w, function, out)) return 1;
+
+    U64 offset = Reserve(w, sizeof(AnanasFunction));
+    RememberObject(w, function, offset);
+    *out = offset;
+
+    SetField(w, offset + offsetof(AnanasFunction, is_native), &function->is_native, sizeof(function->is_native));
+
+    if (function->is_native) return WriteNative(w, offset + offsetof(AnanasFunction, u.native), function->u.native);
+
+    AnanasUserFunction user = function->u.user;
+    return WriteUserCallable(w, offset + offsetof(AnanasFunction, u.user), user.params, user.body, user.enclosing_env);
+}
+
+static B32 WriteMacro(Writer *w, AnanasMacro *macro, U64 *out) {
+    if (FindObject(w, macro, out)) return 1;
+
+    U64 offset = Reserve(w, sizeof(AnanasMacro));
+    RememberObject(w, macro, offset);
+    *out = offset;
+
+    SetField(w, offset + offsetof(AnanasMacro, is_native), &macro->is_native, sizeof(macro->is_native));
+
+    if (macro->is_native) return WriteNative(w, offset + offsetof(AnanasMacro, u.native), macro->u.native);
+
+    AnanasUserMacro user = macro->u.user;
+    return WriteUserCallable(w, offset + offsetof(AnanasMacro, u.user), user.params, user.body, user.enclosing_env);
+}
+
+static B32 WriteTable(Writer *w, AnanasTable *table, U64 *out) {
+    if (FindObject(w, table, out)) return 1;
+
+    U64 offset = Reserve(w, sizeof(ImageTable));
+    RememberObject(w, table, offset);
+    AnanasImageOffsetArrayPush(&w->tables, offset);
+    *out = offset;
+
+    U64 entries = Reserve(w, sizeof(ImageTableEntry) * table->map.count);
+    SetU64(w, offset + offsetof(ImageTable, entries_offset), entries);
+    SetU64(w, offset + offsetof(ImageTable, entries_count), table->map.count);
+
+    UZ i = 0;
+    ERMIS_HASHMAP_FOREACH(&table->map, key, value, {
+        U64 entry = entries + i * sizeof(ImageTableEntry);
+        if (!WriteValue(w, entry + offsetof(ImageTableEntry, key), key)) return 0;
+        if (!WriteValue(w, entry + offsetof(ImageTableEntry, value), value)) return 0;
+        ++i;
+    })
+
+    return 1;
+}
+
+static B32 WriteHashMap(Writer *w, AnanasHashMap *hash_map, U64 *out) {
+    if (FindObject(w, hash_map, out)) return 1;
+
+    U64 offset = Reserve(w, sizeof(ImageHashMap));
+    RememberObject(w, hash_map, offset);
+    AnanasImageOffsetArrayPush(&w->hash_maps, offset);
+    *out = offset;
+
+    U64 entries = Reserve(w, sizeof(ImageTableEntry) * hash_map->count);
+    SetU64(w, offset + offsetof(ImageHashMap, entries_offset), entries);
+    SetU64(w, offset + offsetof(ImageHashMap, entries_count), hash_map->count);
+
+    AnanasHashMapIterator it;
+    AnanasHashMapIteratorInit(&it, hash_map);
+
+    AnanasHashMapEntry entry;
+    for (UZ i = 0; AnanasHashMapIteratorNext(&it, &entry); ++i) {
+        U64 at = entries + i * sizeof(ImageTableEntry);
+        if (!WriteValue(w, at + offsetof(ImageTableEntry, key), entry.key)) return 0;
+        if (!WriteValue(w, at + offsetof(ImageTableEntry, value), entry.value)) return 0;
+    }
+
+    return 1;
+}
+
+static B32 WriteVector(Writer *w, AnanasVector *vector, U64 *out) {
+    if (FindObject(w, vector, out)) return 1;
+
+    U64 offset = Reserve(w, sizeof(ImageVector));
+    RememberObject(w, vector, offset);
+    AnanasImageOffsetArrayPush(&w->vectors, offset);
+    *out = offset;
+
+    U64 items = Reserve(w, sizeof(AnanasValue) * vector->count);
+    SetU64(w, offset + offsetof(ImageVector, items_offset), items);
+    SetU64(w, offset + offsetof(ImageVector, items_count), vector->count);
+
+    for (UZ i = 0; i < vector->count; ++i) {
+        if (!WriteValue(w, items + i * sizeof(AnanasValue), AnanasVectorGet(vector, i))) return 0;
+    }
+
+    return 1;
+}
+
+static B32 WriteValue(Writer *w, U64 at, AnanasValue value) {
+    // NOTE: String builders are stored as the plain strings they hold.
+    value = AnanasValueFlatten(value);
+
+    // NOTE: Only the position of the token is kept. Values produced by natives never set
+    // the token text, and nothing past the reader looks at it.
+    AnanasValue copy = value;
+    copy.token.value = (HeliosStringView){0};
+    memset(&copy.u, 0, sizeof(copy.u));
+    if (value.type == AnanasValueType_Int || value.type == AnanasValueType_Bool) copy.u = value.u;
+    SetField(w, at, &copy, sizeof(copy));
+
+    U64 u_at = at + offsetof(AnanasValue, u);
+
+    switch (value.type) {
+    case AnanasValueType_Int:
+    case AnanasValueType_Bool:
+        return 1;
+    case AnanasValueType_String:
+    case AnanasValueType_Symbol:
+        // NOTE: Strings and symbols share the same string view in the union.
+        WriteStringView(w, u_at, value.u.string);
+        return 1;
+    case AnanasValueType_List: {
+        U64 list;
+        if (!WriteList(w, value.u.list, &list)) return 0;
+        SetPointer(w, u_at, list);
+        return 1;
+    }
+    case AnanasValueType_Function: {
+        U64 function;
+        if (!WriteFunction(w, value.u.function, &function)) return 0;
+        SetPointer(w, u_at, function);
+        return 1;
+    }
+    case AnanasValueType_Macro: {
+        U64 macro;
+        if (!WriteMacro(w, value.u.macro, &macro)) return 0;
+        SetPointer(w, u_at, macro);
+        return 1;
+    }
+    case AnanasValueType_Table: {
+        U64 table;
+        if (!WriteTable(w, value.u.table, &table)) return 0;
+        SetPointer(w, u_at, table);
+        return 1;
+    }
+    case AnanasValueType_HashMap: {
+        U64 hash_map;
+        if (!WriteHashMap(w, value.u.hash_map, &hash_map)) return 0;
+        SetPointer(w, u_at, hash_map);
+        return 1;
+    }
+    case AnanasValueType_Vector: {
+        U64 vector;
+        if (!WriteVector(w, value.u.vector, &vector)) return 0;
+        SetPointer(w, u_at, vector);
+        return 1;
+    }
+    case AnanasValueType_StringBuilder: HELIOS_UNREACHABLE();
+    }
+
+    HELIOS_UNREACHABLE();
+}
+
+static B32 WriteEnv(Writer *w, AnanasEnv *env, U64 *out) {
+    *out = 0;
+    if (env == NULL) return 1;
+    if (FindObject(w, env, out)) return 1;
+
+    U64 offset = Reserve(w, sizeof(ImageEnv));
+    RememberObject(w, env, offset);
+    AnanasImageOffsetArrayPush(&w->envs, offset);
+    *out = offset;
+
+    U64 parent;
+    if (!WriteEnv(w, env->parent_env, &parent)) return 0;
+    SetPointer(w, offset + offsetof(ImageEnv, env.parent_env), parent);
+
+    U64 entries = Reserve(w, sizeof(ImageEnvEntry) * env->map.count);
+    SetU64(w, offset + offsetof(ImageEnv, entries_offset), entries);
+    SetU64(w, offset + offsetof(ImageEnv, entries_count), env->map.count);
+
+    UZ i = 0;
+    ERMIS_HASHMAP_FOREACH(&env->map, key, value, {
+        U64 entry = entries + i * sizeof(ImageEnvEntry);
+        WriteStringView(w, entry + offsetof(ImageEnvEntry, key), key);
+        if (!WriteValue(w, entry + offsetof(ImageEnvEntry, value), value)) return 0;
+        ++i;
+    })
+
+    return 1;
+}
+
+B32 AnanasImageDump(HeliosAllocator allocator,
+                    AnanasEnv *env,
+                    HeliosStringView path,
+                    AnanasErrorContext *error_ctx) {
+    Writer w = {0};
+    w.error_ctx = error_ctx;
+    AnanasDStringInit(&w.image, allocator, 64 * 1024);
+    AnanasImageObjectMapInit(&w.objects, allocator, 0);
+    AnanasImageStringMapInit(&w.strings, allocator, 0);
+    AnanasImageOffsetArrayInit(&w.relocs, allocator, 1024);
+    AnanasImageNativeArrayInit(&w.natives, allocator, 32);
+    AnanasImageOffsetArrayInit(&w.envs, allocator, 16);
+    AnanasImageOffsetArrayInit(&w.tables, allocator, 16);
+    AnanasImageOffsetArrayInit(&w.hash_maps, allocator, 16);
+    AnanasImageOffsetArrayInit(&w.vectors, allocator, 16);
+
+    U64 header_offset = Reserve(&w, sizeof(ImageHeader));
+    HELIOS_ASSERT(header_offset == 0);
+
+    ImageHeader header = {0};
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.value_size = sizeof(AnanasValue);
+    header.pointer_size = sizeof(void *);
+
+    if (!WriteEnv(&w, env, &header.root_env)) return 0;
+
+    header.relocs_count = w.relocs.count;
+    header.relocs_offset = Reserve(&w, sizeof(U64) * w.relocs.count);
+    SetField(&w, header.relocs_offset, w.relocs.items, sizeof(U64) * w.relocs.count);
+
+    header.natives_count = w.natives.count;
+    header.natives_offset = Reserve(&w, sizeof(ImageNative) * w.natives.count);
+    SetField(&w, header.natives_offset, w.natives.items, sizeof(ImageNative) * w.natives.count);
+
+    header.envs_count = w.envs.count;
+    header.envs_offset = Reserve(&w, sizeof(U64) * w.envs.count);
+    SetField(&w, header.envs_offset, w.envs.items, sizeof(U64) * w.envs.count);
+
+    header.tables_count = w.tables.count;
+    header.tables_offset = Reserve(&w, sizeof(U64) * w.tables.count);
+    SetField(&w, header.tables_offset, w.tables.items, sizeof(U64) * w.tables.count);
+
+    header.hash_maps_count = w.hash_maps.count;
+    header.hash_maps_offset = Reserve(&w, sizeof(U64) * w.hash_maps.count);
+    SetField(&w, header.hash_maps_offset, w.hash_maps.items, sizeof(U64) * w.hash_maps.count);
+
+    header.vectors_count = w.vectors.count;
+    header.vectors_offset = Reserve(&w, sizeof(U64) * w.vectors.count);
+    SetField(&w, header.vectors_offset, w.vectors.items, sizeof(U64) * w.vectors.count);
+
+    SetField(&w, 0, &header, sizeof(header));
+
+    if (!AnanasPlatformWriteEntireFile(path, w.image.items, w.image.count)) {
+        AnanasErrorContextMessage(error_ctx, 0, 0, "failed to write the image");
+        return 0;
+    }
+
+    return 1;
+}
+
+static B32 TableInImage(U64 offset, U64 count, UZ item_size, UZ image_count) {
+    if (offset > image_count || (offset & 7) != 0) return 0;
+    return count <= (image_count - offset) / item_size;
+}
+
+static B32 LoadMappedImage(HeliosAllocator allocator,
+                           U8 *image,
+                           UZ image_count,
+                           AnanasEnv **out_env,
+                           AnanasErrorContext *error_ctx) {
+    if (image_count < sizeof(ImageHeader)) {
+        AnanasErrorContextMessage(error_ctx, 0, 0, "the image is truncated");
+        return 0;
+    }
+
+    ImageHeader header;
+    memcpy(&header, image, sizeof(header));
+
+    if (memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0 || header.version != IMAGE_VERSION) {
+        AnanasErrorContextMessage(error_ctx, 0, 0, "not an image or an image of a different version");
+        return 0;
+    }
+
+    if (header.value_size != sizeof(AnanasValue) || header.pointer_size != sizeof(void *)) {
+        AnanasErrorContextMessage(error_ctx, 0, 0, "the image was dumped by an incompatible build");
+        return 0;
+    }
+
+    if (!TableInImage(header.relocs_offset, header.relocs_count, sizeof(U64), image_count)
+        || !TableInImage(header.natives_offset, header.natives_count, sizeof(ImageNative), image_count)
+        || !TableInImage(header.envs_offset, header.envs_count, sizeof(U64), image_count)
+        || !TableInImage(header.tables_offset, header.tables_count, sizeof(U64), image_count)
+        || !TableInImage(header.hash_maps_offset, header.hash_maps_count, sizeof(U64), image_count)
+        || !TableInImage(header.vectors_offset, header.vectors_count, sizeof(U64), image_count)
+        || header.root_env == 0
+        || !TableInImage(header.root_env, 1, sizeof(ImageEnv), image_count)) {
+        AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+        return 0;
+    }
+
+    U64 *relocs = (U64 *)(image + header.relocs_offset);
+    for (UZ i = 0; i < header.relocs_count; ++i) {
+        U64 field = relocs[i];
+        if (!TableInImage(field, 1, sizeof(UZ), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        UZ *ptr = (UZ *)(image + field);
+        if (*ptr >= image_count) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        *ptr += (UZ)image;
+    }
+
+    ImageNative *natives = (ImageNative *)(image + header.natives_offset);
+    for (UZ i = 0; i < header.natives_count; ++i) {
+        ImageNative native = natives[i];
+        if (!TableInImage(native.field, 1, sizeof(AnanasNativeFunction), image_count)
+            || native.name_offset > image_count
+            || native.name_count > image_count - native.name_offset) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        HeliosStringView name = {.data = image + native.name_offset, .count = native.name_count};
+
+        AnanasNativeFunction func;
+        if (!AnanasNativeFunctionByName(name, &func)) {
+            AnanasErrorContextMessage(error_ctx,
+                                      0,
+                                      0,
+                                      "the image refers to an unknown native function '" HELIOS_SV_FMT "'",
+                                      HELIOS_SV_ARG(name));
+            return 0;
+        }
+
+        memcpy(image + native.field, &func, sizeof(func));
+    }
+
+    U64 *envs = (U64 *)(image + header.envs_offset);
+    for (UZ i = 0; i < header.envs_count; ++i) {
+        if (!TableInImage(envs[i], 1, sizeof(ImageEnv), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        ImageEnv *image_env = (ImageEnv *)(image + envs[i]);
+        if (!TableInImage(image_env->entries_offset, image_env->entries_count, sizeof(ImageEnvEntry), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        ImageEnvEntry *entries = (ImageEnvEntry *)(image + image_env->entries_offset);
+
+        AnanasEnvMapInit(&image_env->env.map, allocator, HELIOS_MAX(37, image_env->entries_count * 2));
+        for (UZ j = 0; j < image_env->entries_count; ++j) {
+            AnanasEnvMapInsert(&image_env->env.map, entries[j].key, entries[j].value);
+        }
+    }
+
+    U64 *tables = (U64 *)(image + header.tables_offset);
+    for (UZ i = 0; i < header.tables_count; ++i) {
+        if (!TableInImage(tables[i], 1, sizeof(ImageTable), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        ImageTable *image_table = (ImageTable *)(image + tables[i]);
+        if (!TableInImage(image_table->entries_offset, image_table->entries_count, sizeof(ImageTableEntry), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        ImageTableEntry *entries = (ImageTableEntry *)(image + image_table->entries_offset);
+
+        AnanasTableMapInit(&image_table->table.map, allocator, HELIOS_MAX(47, image_table->entries_count * 2));
+        for (UZ j = 0; j < image_table->entries_count; ++j) {
+            if (!AnanasValueIsHashable(entries[j].key)) {
+                AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+                return 0;
+            }
+
+            AnanasTableMapInsert(&image_table->table.map, entries[j].key, entries[j].value);
+        }
+    }
+
+    U64 *hash_maps = (U64 *)(image + header.hash_maps_offset);
+    for (UZ i = 0; i < header.hash_maps_count; ++i) {
+        if (!TableInImage(hash_maps[i], 1, sizeof(ImageHashMap), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        ImageHashMap *image_map = (ImageHashMap *)(image + hash_maps[i]);
+        if (!TableInImage(image_map->entries_offset, image_map->entries_count, sizeof(ImageTableEntry), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        ImageTableEntry *entries = (ImageTableEntry *)(image + image_map->entries_offset);
+
+        AnanasHashMap *hash_map = AnanasHashMapEmpty(allocator);
+        for (UZ j = 0; j < image_map->entries_count; ++j) {
+            if (!AnanasValueIsHashable(entries[j].key)) {
+                AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+                return 0;
+            }
+
+            hash_map = AnanasHashMapSet(allocator, hash_map, entries[j].key, entries[j].value);
+        }
+        image_map->hash_map = *hash_map;
+    }
+
+    U64 *vectors = (U64 *)(image + header.vectors_offset);
+    for (UZ i = 0; i < header.vectors_count; ++i) {
+        if (!TableInImage(vectors[i], 1, sizeof(ImageVector), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        ImageVector *image_vector = (ImageVector *)(image + vectors[i]);
+        if (!TableInImage(image_vector->items_offset, image_vector->items_count, sizeof(AnanasValue), image_count)) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "the image is corrupted");
+            return 0;
+        }
+
+        AnanasValue *items = (AnanasValue *)(image + image_vector->items_offset);
+
+        AnanasVector *vector = AnanasVectorEmpty(allocator);
+        for (UZ j = 0; j < image_vector->items_count; ++j) {
+            vector = AnanasVectorPush(allocator, vector, items[j]);
+        }
+        image_vector->vector = *vector;
+    }
+
+    *out_env = &((ImageEnv *)(image + header.root_env))->env;
+    return 1;
+}
+
+B32 AnanasImageLoad(HeliosAllocator allocator,
+                    HeliosStringView path,
+                    AnanasEnv **out_env,
+                    AnanasErrorContext *error_ctx) {
+    U8 *image;
+    UZ image_count;
+    if (!AnanasPlatformMapFile(path, 1, &image, &image_count)) {
+        AnanasErrorContextMessage(error_ctx, 0, 0, "failed to map the image");
+        return 0;
+    }
+
+    if (!LoadMappedImage(allocator, image, image_count, out_env, error_ctx)) {
+        AnanasPlatformUnmapFile(image, image_count);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,20 @@
+#ifndef ANANAS_IMAGE_H_
+#define ANANAS_IMAGE_H_
+
+#include "eval.h"
+
+// NOTE: An image is a relocatable snapshot of an env together with everything reachable
+// from it: values, closures, macros and their enclosing envs.
+B32 AnanasImageDump(HeliosAllocator allocator,
+                    AnanasEnv *env,
+                    HeliosStringView path,
+                    AnanasErrorContext *error_ctx);
+
+// NOTE: The image is mapped copy-on-write and the loaded values point into the mapping,
+// so it must stay alive for as long as they are used. Env maps are rebuilt with `allocator`.
+B32 AnanasImageLoad(HeliosAllocator allocator,
+                    HeliosStringView path,
+                    AnanasEnv **out_env,
+                    AnanasErrorContext *error_ctx);
+
+#endif // ANANAS_IMAGE_H_
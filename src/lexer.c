@@ -2,6 +2,11 @@
 
 #include "common.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ANANAS_LEXER_SSE2
+#endif
+
 static B32 AnanasIsReaderMacroChar(HeliosChar c) {
     return c == '`' ||
            c == '@' ||
@@ -30,157 +35,400 @@ static B32 AnanasIsSymbolChar(HeliosChar c) {
     return AnanasIsFirstSymbolChar(c) || HeliosCharIsDigit(c);
 }
 
-#define ANANAS_LEXER_READ_WHILE(pred) while (1) {                       \
-        if (!HeliosString8StreamNext(lexer->contents, &cur_char)) {     \
-            break;                                                      \
+static B32 AnanasIsBlank(HeliosChar c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// NOTE: Every character class the lexer runs over is ASCII, so the source is scanned byte by
+// byte and any byte with the high bit set ends a run. The lexer never decodes UTF-8 and does
+// not keep the char offset of the stream up to date. With SSE2 the runs are classified 16
+// bytes at a time.
+
+#ifdef ANANAS_LEXER_SSE2
+
+#define ANANAS_LEXER_SCAN_RUN(data, count, in_class_mask, pred) do {     \
+        UZ i = 0;                                                       \
+        for (; i + 16 <= (count); i += 16) {                            \
+            __m128i v = _mm_loadu_si128((const __m128i *)((data) + i)); \
+            U32 mask = (U32)_mm_movemask_epi8(in_class_mask(v));        \
+            if (mask != 0xFFFF) return i + (UZ)__builtin_ctz(~mask);    \
+        }                                                               \
+        for (; i < (count); ++i) {                                      \
+            if (!pred((data)[i])) return i;                             \
         }                                                               \
-        if (!pred(cur_char)) break;                                     \
-        ++lexer->col;                                                   \
+        return (count);                                                 \
+    } while (0)
+
+static inline __m128i AnanasBytesInRange(__m128i v, char lo, char hi) {
+    // NOTE: Signed compares, bytes with the high bit set are negative and never in range.
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static inline __m128i AnanasBytesEqual(__m128i v, char c) {
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+static inline __m128i AnanasBlankMask(__m128i v) {
+    return _mm_or_si128(_mm_or_si128(AnanasBytesEqual(v, ' '), AnanasBytesEqual(v, '\t')), AnanasBytesEqual(v, '\r'));
+}
+
+static inline __m128i AnanasDigitMask(__m128i v) {
+    return AnanasBytesInRange(v, '0', '9');
+}
+
+static inline __m128i AnanasSymbolMask(__m128i v) {
+    __m128i m = _mm_or_si128(AnanasBytesInRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+                             AnanasBytesInRange(v, '0', '9'));
+    m = _mm_or_si128(m, _mm_or_si128(AnanasBytesEqual(v, '-'), AnanasBytesEqual(v, '<')));
+    m = _mm_or_si128(m, _mm_or_si128(AnanasBytesEqual(v, '>'), AnanasBytesEqual(v, '_')));
+    m = _mm_or_si128(m, _mm_or_si128(AnanasBytesEqual(v, '/'), AnanasBytesEqual(v, '+')));
+    m = _mm_or_si128(m, _mm_or_si128(AnanasBytesEqual(v, '*'), AnanasBytesEqual(v, '=')));
+    m = _mm_or_si128(m, _mm_or_si128(AnanasBytesEqual(v, '!'), AnanasBytesEqual(v, '?')));
+    return _mm_or_si128(m, AnanasBytesEqual(v, '.'));
+}
+
+static inline __m128i AnanasNotNewlineMask(__m128i v) {
+    return _mm_xor_si128(AnanasBytesEqual(v, '\n'), _mm_set1_epi8(-1));
+}
+
+#else
+
+#define ANANAS_LEXER_SCAN_RUN(data, count, in_class_mask, pred) do {     \
+        for (UZ i = 0; i < (count); ++i) {                              \
+            if (!pred((data)[i])) return i;                             \
+        }                                                               \
+        return (count);                                                 \
+    } while (0)
+
+#endif // ANANAS_LEXER_SSE2
+
+static B32 AnanasIsNotNewline(HeliosChar c) {
+    return c != '\n';
+}
+
+static UZ AnanasScanBlanks(const U8 *data, UZ count) {
+    ANANAS_LEXER_SCAN_RUN(data, count, AnanasBlankMask, AnanasIsBlank);
+}
+
+static UZ AnanasScanDigits(const U8 *data, UZ count) {
+    ANANAS_LEXER_SCAN_RUN(data, count, AnanasDigitMask, HeliosCharIsDigit);
+}
+
+static UZ AnanasScanSymbolChars(const U8 *data, UZ count) {
+    ANANAS_LEXER_SCAN_RUN(data, count, AnanasSymbolMask, AnanasIsSymbolChar);
+}
+
+static UZ AnanasScanToNewline(const U8 *data, UZ count) {
+    ANANAS_LEXER_SCAN_RUN(data, count, AnanasNotNewlineMask, AnanasIsNotNewline);
+}
+
+static UZ AnanasScanReaderMacroChars(const U8 *data, UZ count) {
+    for (UZ i = 0; i < count; ++i) {
+        if (!AnanasIsReaderMacroChar(data[i])) return i;
     }
 
-B32 AnanasLexerNext(AnanasLexer *lexer, HeliosAllocator allocator, AnanasToken *token) {
-    HeliosChar cur_char;
+    return count;
+}
+
+// NOTE: Only streamed sources refill. The bytes before `keep_from` are dropped, the rest is
+// moved to the front of the buffer and followed by more input. Every offset at or past
+// `keep_from` has to be shifted down by it afterwards. Returns 0 once the input is over.
+static B32 AnanasLexerRefill(AnanasLexer *lexer, UZ keep_from) {
+    AnanasLexerSource *source = lexer->source;
+    if (source == NULL || source->eof) return 0;
+
+    HeliosString8Stream *contents = lexer->contents;
+
+    UZ kept = contents->count - keep_from;
+    memmove(source->buffer, source->buffer + keep_from, kept);
+    contents->byte_offset -= keep_from;
+
+    // NOTE: The buffer only grows when a single token does not fit in it.
+    if (kept == source->capacity) {
+        UZ new_capacity = source->capacity * 2;
+        source->buffer = HeliosRealloc(source->allocator, source->buffer, source->capacity, new_capacity);
+        source->capacity = new_capacity;
+    }
+
+    UZ read_count;
+    if (!AnanasPlatformReadFile(source->file, source->buffer + kept, source->capacity - kept, &read_count)) {
+        read_count = 0;
+    }
+
+    if (read_count == 0) source->eof = 1;
+
+    contents->data = source->buffer;
+    contents->count = kept + read_count;
+
+    return read_count > 0;
+}
+
+static UZ AnanasUtf8SequenceSize(U8 first_byte) {
+    if ((first_byte & 0xE0) == 0xC0) return 2;
+    if ((first_byte & 0xF0) == 0xE0) return 3;
+    if ((first_byte & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+static B32 AnanasLexerScan(AnanasLexer *lexer, HeliosAllocator allocator, AnanasToken *token) {
+    HeliosString8Stream *contents = lexer->contents;
+    UZ pos = HELIOS_MIN(contents->byte_offset + 1, contents->count);
+    B32 in_comment = 0;
 
     while (1) {
-        if (!HeliosString8StreamNext(lexer->contents, &cur_char)) return 0;
-        if (cur_char == ' ' || cur_char == '\t' || cur_char == '\r') {
-            ++lexer->col;
+        if (pos >= contents->count) {
+            if (AnanasLexerRefill(lexer, pos)) {
+                pos = 0;
+                continue;
+            }
+
+            contents->byte_offset = contents->count - 1;
+            return 0;
+        }
+
+        const U8 *data = contents->data;
+
+        if (in_comment) {
+            // NOTE: The newline that ends the comment is counted like any other.
+            pos += AnanasScanToNewline(data + pos, contents->count - pos);
+            if (pos < contents->count) in_comment = 0;
             continue;
-        } else if (cur_char == '\n') {
+        }
+
+        UZ blanks = AnanasScanBlanks(data + pos, contents->count - pos);
+        pos += blanks;
+        lexer->col += blanks;
+
+        if (pos >= contents->count) continue;
+
+        if (data[pos] == '\n') {
+            // NOTE: Columns after a newline start from 1, the numbering error locations have
+            // always used.
             ++lexer->row;
             lexer->col = 1;
-            continue;
+            ++pos;
+        } else if (data[pos] == ';') {
+            in_comment = 1;
         } else {
-            ++lexer->col;
             break;
         }
     }
 
+    const U8 *data = contents->data;
+    U8 cur_char = data[pos];
+
+    contents->byte_offset = pos;
+    contents->last_char_size = 1;
+
+    ++lexer->col;
+
+    token->row = lexer->row;
+    token->col = lexer->col;
+
     switch (cur_char) {
     case '(': {
         token->type = AnanasTokenType_LeftParen;
-        token->value.data = lexer->contents->data + lexer->contents->byte_offset;
+        token->value.data = data + pos;
         token->value.count = 1;
-        token->col = lexer->col;
-        token->row = lexer->row;
         return 1;
     }
     case ')': {
         token->type = AnanasTokenType_RightParen;
-        token->value.data = lexer->contents->data + lexer->contents->byte_offset;
+        token->value.data = data + pos;
         token->value.count = 1;
-        token->col = lexer->col;
-        token->row = lexer->row;
         return 1;
     }
     case '"': {
-        token->row = lexer->row;
-        token->col = lexer->col;
-
+        // NOTE: The literal is scanned byte by byte straight from the source. Without escapes
+        // the token is a slice of the source, otherwise it is unescaped into a buffer of
+        // exactly the right size in a second pass.
+        UZ quote = pos;
+        UZ start = quote + 1;
+        UZ end = start;
+        UZ escapes_count = 0;
         AnanasTokenType token_type = AnanasTokenType_String;
-        AnanasDString string_value;
-        AnanasDStringInit(&string_value, allocator, 7);
 
         while (1) {
-            if (!HeliosString8StreamNext(lexer->contents, &cur_char)) {
-                token_type = AnanasTokenType_UnclosedString;
-                break;
-            }
+            if (end >= contents->count || (data[end] == '\\' && end + 1 >= contents->count)) {
+                if (AnanasLexerRefill(lexer, quote)) {
+                    start -= quote;
+                    end -= quote;
+                    quote = 0;
+                    data = contents->data;
+                    continue;
+                }
 
-            if (cur_char == '\\') {
-                if (!HeliosString8StreamNext(lexer->contents, &cur_char)) {
+                if (end >= contents->count) {
                     token_type = AnanasTokenType_UnclosedString;
                     break;
                 }
+            }
 
-                switch (cur_char) {
-                case 'n': {
-                    AnanasDStringPush(&string_value, '\n');
-                    break;
-                }
-                case 'r': {
-                    AnanasDStringPush(&string_value, '\r');
-                    break;
-                }
-                case 't': {
-                    AnanasDStringPush(&string_value, '\t');
-                    break;
-                }
-                case '\\': {
-                    AnanasDStringPush(&string_value, '\\');
-                    break;
-                }
-                case '"': {
-                    AnanasDStringPush(&string_value, '"');
-                    break;
-                }
-                default: {
+            U8 byte = data[end];
+            if (byte == '"') break;
+
+            if (byte == '\\') {
+                U8 escaped = end + 1 < contents->count ? data[end + 1] : 0;
+                if (escaped != 'n' && escaped != 'r' && escaped != 't' && escaped != '\\' && escaped != '"') {
                     token_type = AnanasTokenType_UnclosedString;
-                    goto loop_end;
-                }
-                }
-            } else if (cur_char == '"') {
-                break;
-            } else {
-                AnanasDStringPush(&string_value, cur_char);
-
-                if (cur_char == '\n') {
-                    ++lexer->row;
-                    lexer->col = 1;
-                } else {
-                    ++lexer->col;
+                    break;
                 }
+
+                ++escapes_count;
+                lexer->col += 2;
+                end += 2;
+                continue;
             }
+
+            if (byte == '\n') {
+                ++lexer->row;
+                lexer->col = 1;
+            } else if ((byte & 0xC0) != 0x80) {
+                ++lexer->col;
+            }
+
+            ++end;
         }
 
-    loop_end:
+        UZ literal_count = end - start;
+
+        // NOTE: Leave the stream on the closing quote, or past the end of an unclosed literal.
+        contents->byte_offset = HELIOS_MIN(end, contents->count);
+        contents->last_char_size = 1;
 
         token->type = token_type;
-        token->value.data = string_value.items;
-        token->value.count = string_value.count;
 
-        return 1;
-    }
-    case ';': {
-        while (HeliosString8StreamNext(lexer->contents, &cur_char)) {
-            if (cur_char == '\n') return AnanasLexerNext(lexer, allocator, token);
+        if (escapes_count == 0) {
+            token->value.data = data + start;
+            token->value.count = literal_count;
+            return 1;
         }
 
-        return 0;
+        UZ value_count = literal_count - escapes_count;
+        U8 *value = HeliosAlloc(allocator, value_count);
+
+        UZ out = 0;
+        for (UZ i = start; i < end; ++i) {
+            U8 byte = data[i];
+            if (byte == '\\') {
+                ++i;
+                switch (data[i]) {
+                case 'n': byte = '\n'; break;
+                case 'r': byte = '\r'; break;
+                case 't': byte = '\t'; break;
+                default:  byte = data[i]; break;
+                }
+            }
+
+            value[out++] = byte;
+        }
+        HELIOS_ASSERT(out == value_count);
+
+        token->value.data = value;
+        token->value.count = value_count;
+
+        return 1;
     }
     default: {
-        token->col = lexer->col;
-        token->row = lexer->row;
-        UZ start = lexer->contents->byte_offset;
+        UZ start = pos;
+        UZ end = pos + 1;
+
+        UZ (*scan_run)(const U8 *, UZ) = NULL;
 
         if (AnanasIsFirstSymbolChar(cur_char)) {
             token->type = AnanasTokenType_Symbol;
-
-            ANANAS_LEXER_READ_WHILE(AnanasIsSymbolChar);
+            scan_run = AnanasScanSymbolChars;
         } else if (HeliosCharIsDigit(cur_char)) {
             token->type = AnanasTokenType_Int;
-
-            ANANAS_LEXER_READ_WHILE(HeliosCharIsDigit);
+            scan_run = AnanasScanDigits;
         } else if (AnanasIsReaderMacroChar(cur_char)) {
             token->type = AnanasTokenType_ReaderMacro;
-
-            ANANAS_LEXER_READ_WHILE(AnanasIsReaderMacroChar);
+            scan_run = AnanasScanReaderMacroChars;
         } else {
+            // NOTE: No token starts with a non-ASCII character, the whole sequence is illegal.
             token->type = AnanasTokenType_Illegal;
+
+            UZ size = AnanasUtf8SequenceSize(cur_char);
+            while (start + size > contents->count && AnanasLexerRefill(lexer, start)) start = 0;
+            end = HELIOS_MIN(start + size, contents->count);
         }
 
-        token->value.data = lexer->contents->data + start;
-        token->value.count = lexer->contents->byte_offset - start;
+        while (scan_run != NULL) {
+            end += scan_run(contents->data + end, contents->count - end);
+            if (end < contents->count || !AnanasLexerRefill(lexer, start)) break;
+
+            end -= start;
+            start = 0;
+        }
+
+        lexer->col += end - start - 1;
+        contents->byte_offset = end - 1;
+        contents->last_char_size = 1;
+
+        token->value.data = contents->data + start;
+        token->value.count = end - start;
+
+        return 1;
+    }
+    }
+}
+
+// NOTE: Refills overwrite the buffer of a streamed source, so tokens that point into it get
+// their own copy.
+static B32 AnanasLexerScanOwned(AnanasLexer *lexer, HeliosAllocator allocator, AnanasToken *token) {
+    if (!AnanasLexerScan(lexer, allocator, token)) return 0;
+
+    AnanasLexerSource *source = lexer->source;
+    if (source != NULL
+        && token->value.count > 0
+        && token->value.data >= source->buffer
+        && token->value.data < source->buffer + source->capacity) {
+        U8 *copy = HeliosAlloc(allocator, token->value.count);
+        memcpy(copy, token->value.data, token->value.count);
+        token->value.data = copy;
+    }
 
-        HeliosString8StreamRetreat(lexer->contents);
+    return 1;
+}
 
+B32 AnanasLexerNext(AnanasLexer *lexer, HeliosAllocator allocator, AnanasToken *token) {
+    if (lexer->has_peeked) {
+        *token = lexer->peeked;
+        lexer->has_peeked = 0;
         return 1;
     }
+
+    return AnanasLexerScanOwned(lexer, allocator, token);
+}
+
+B32 AnanasLexerPeek(AnanasLexer *lexer, HeliosAllocator allocator, AnanasToken *token) {
+    if (!lexer->has_peeked) {
+        if (!AnanasLexerScanOwned(lexer, allocator, &lexer->peeked)) return 0;
+        lexer->has_peeked = 1;
     }
+
+    *token = lexer->peeked;
+    return 1;
 }
 
 void AnanasLexerInit(AnanasLexer *lexer, HeliosString8Stream *contents) {
     lexer->contents = contents;
     lexer->col = 0;
     lexer->row = 1;
+    lexer->has_peeked = 0;
+    lexer->source = NULL;
+}
+
+void AnanasLexerSourceInit(AnanasLexerSource *source, AnanasPlatformFile file, HeliosAllocator allocator, UZ capacity) {
+    source->file = file;
+    source->allocator = allocator;
+    source->buffer = HeliosAlloc(allocator, capacity);
+    source->capacity = capacity;
+    source->eof = 0;
+}
+
+void AnanasLexerInitSource(AnanasLexer *lexer, HeliosString8Stream *contents, AnanasLexerSource *source) {
+    HeliosString8StreamInit(contents, source->buffer, 0);
+    AnanasLexerInit(lexer, contents);
+    lexer->source = source;
 }
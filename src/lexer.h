@@ -2,6 +2,7 @@
 #define ANANAS_LEXER_H_
 
 #include "astron.h"
+#include "platform.h"
 
 #define ANANAS_ENUM_TOKEN_TYPES \
     X(LeftParen) \
@@ -26,14 +27,37 @@ typedef struct {
     U32 col;
 } AnanasToken;
 
+// NOTE: Input read from a file or a pipe in chunks, into a buffer that is reused as the
+// lexer moves on. Memory use is bounded by the biggest token, not by the size of the input.
+typedef struct {
+    AnanasPlatformFile file;
+    HeliosAllocator allocator;
+    U8 *buffer;
+    UZ capacity;
+    B32 eof;
+} AnanasLexerSource;
+
 typedef struct {
     HeliosString8Stream *contents;
+    AnanasLexerSource *source;
     U32 row;
     U32 col;
+
+    B32 has_peeked;
+    AnanasToken peeked;
 } AnanasLexer;
 
 void AnanasLexerInit(AnanasLexer *lexer, HeliosString8Stream *contents);
 
+void AnanasLexerSourceInit(AnanasLexerSource *source, AnanasPlatformFile file, HeliosAllocator allocator, UZ capacity);
+
+// NOTE: `contents` is refilled from `source` as the lexer goes, tokens lexed from it are copied
+// into the allocator passed to `AnanasLexerNext`.
+void AnanasLexerInitSource(AnanasLexer *lexer, HeliosString8Stream *contents, AnanasLexerSource *source);
+
 B32 AnanasLexerNext(AnanasLexer *lexer, HeliosAllocator allocator, AnanasToken *token);
 
+// NOTE: Lexes the next token without consuming it, the following `AnanasLexerNext` returns it.
+B32 AnanasLexerPeek(AnanasLexer *lexer, HeliosAllocator allocator, AnanasToken *token);
+
 #endif // ANANAS_LEXER_H_
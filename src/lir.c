@@ -21,7 +21,7 @@ static void AppendOp(AnanasLIR_CompilerContext *ctx, void *op, UZ op_size) {
         APPEND_OP(x); \
     } while (0)
 
-static void AddLambda(AnanasLIR_CompilerContext *ctx, AnanasLIR_CompiledLambda lam) {
+void AnanasLIR_AddLambda(AnanasLIR_CompilerContext *ctx, AnanasLIR_CompiledLambda lam) {
     if (ctx->lambdas_count >= ctx->lambdas_capacity) {
         UZ new_cap = ERMIS_ARRAY_GROW_FACTOR(ctx->lambdas_capacity);
         ctx->lambdas = HeliosRealloc(ctx->arena,
@@ -38,13 +38,17 @@ static B32 CompileValue(AnanasLIR_CompilerContext *ctx, AnanasValue value) {
     switch (value.type) {
     case AnanasValueType_Function:
     case AnanasValueType_Macro:
+    case AnanasValueType_Table:
+    case AnanasValueType_HashMap:
+    case AnanasValueType_Vector:
         HELIOS_TODO();
     case AnanasValueType_Bool:
     case AnanasValueType_String:
+    case AnanasValueType_StringBuilder:
     case AnanasValueType_Int: {
         AnanasLIR_OpConst cop = {0};
         cop.op = AnanasLIR_Op_Const;
-        cop.value = value;
+        cop.value = AnanasValueFlatten(value);
         APPEND_OP(cop);
         return 1;
     }
@@ -243,7 +247,7 @@ static B32 CompileValue(AnanasLIR_CompilerContext *ctx, AnanasValue value) {
             lop.index = ctx->lambdas_count;
             APPEND_OP(lop);
 
-            AddLambda(ctx, lambda);
+            AnanasLIR_AddLambda(ctx, lambda);
 
             return 1;
         } else {
@@ -19,7 +19,13 @@
     X(PopScope) \
     X(CondJmp) \
     X(Jmp) \
-    X(LoadLambda)
+    X(LoadLambda) \
+    X(LookupCall) \
+    X(AddConst) \
+    X(AddInt) \
+    X(SubInt) \
+    X(MulInt) \
+    X(RemInt)
 
 typedef enum {
     #define X(op) AnanasLIR_Op_##op,
@@ -27,6 +33,10 @@ typedef enum {
     #undef X
 } AnanasLIR_Op;
 
+#define X(op) + 1
+enum { AnanasLIR_OpsCount = 0 ANANAS_LIR_ENUM_OPS };
+#undef X
+
 typedef struct {
     AnanasLIR_Op op;
     AnanasValue value;
@@ -40,6 +50,11 @@ typedef struct {
 typedef struct {
     AnanasLIR_Op op;
     HeliosStringView name;
+
+    // NOTE: Inline cache, owned by the VM. The cached slot is only valid while
+    // `cache_version` matches the version of the VM that filled it.
+    UZ cache_version;
+    void *cache_slot;
 } AnanasLIR_OpLookup;
 
 typedef struct {
@@ -67,6 +82,172 @@ typedef struct {
     U32 args_count;
 } AnanasLIR_OpCall;
 
+typedef struct {
+    AnanasLIR_OpLookup lookup;
+    U32 args_count;
+} AnanasLIR_OpLookupCall;
+
+typedef struct {
+    AnanasLIR_Op op;
+    S64 value;
+} AnanasLIR_OpAddConst;
+
+// NOTE: Register based variant of the LIR. Instead of going through the VM stack, every op
+// works on the slots of the current frame. Named variables still live in envs, registers
+// only hold temporaries.
+#define ANANAS_LIR_ENUM_REG_OPS \
+    X(LoadConst) \
+    X(Move) \
+    X(Add) \
+    X(Sub) \
+    X(Mul) \
+    X(Rem) \
+    X(AddImm) \
+    X(Define) \
+    X(Lookup) \
+    X(Update) \
+    X(LookupCall) \
+    X(Call) \
+    X(Return) \
+    X(PushScope) \
+    X(PopScope) \
+    X(CondJmp) \
+    X(Jmp) \
+    X(LoadLambda)
+
+typedef enum {
+    #define X(op) AnanasLIR_RegOp_##op,
+    ANANAS_LIR_ENUM_REG_OPS
+    #undef X
+} AnanasLIR_RegOp;
+
+#define X(op) + 1
+enum { AnanasLIR_RegOpsCount = 0 ANANAS_LIR_ENUM_REG_OPS };
+#undef X
+
+typedef U16 AnanasLIR_Reg;
+
+#define ANANAS_LIR_REGS_MAX ((UZ)UINT16_MAX)
+
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg dst;
+    AnanasValue value;
+} AnanasLIR_RegOpLoadConst;
+
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg dst;
+    AnanasLIR_Reg src;
+} AnanasLIR_RegOpMove;
+
+// NOTE: Used by Add, Sub, Mul and Rem.
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg dst;
+    AnanasLIR_Reg lhs;
+    AnanasLIR_Reg rhs;
+} AnanasLIR_RegOpBinary;
+
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg dst;
+    AnanasLIR_Reg src;
+    S64 value;
+} AnanasLIR_RegOpAddImm;
+
+// NOTE: Used by Define and Update.
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg src;
+    HeliosStringView name;
+} AnanasLIR_RegOpBind;
+
+typedef struct {
+    AnanasLIR_OpLookup lookup;
+    AnanasLIR_Reg dst;
+} AnanasLIR_RegOpLookup;
+
+// NOTE: Followed by `args_count` registers holding the arguments.
+typedef struct {
+    AnanasLIR_OpLookup lookup;
+    AnanasLIR_Reg dst;
+    U16 args_count;
+} AnanasLIR_RegOpLookupCall;
+
+// NOTE: Followed by `args_count` registers holding the arguments.
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg dst;
+    AnanasLIR_Reg callee;
+    U16 args_count;
+} AnanasLIR_RegOpCall;
+
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg src;
+} AnanasLIR_RegOpReturn;
+
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg cond;
+    UZ ip;
+} AnanasLIR_RegOpCondJmp;
+
+typedef struct {
+    AnanasLIR_RegOp op;
+    UZ ip;
+} AnanasLIR_RegOpJmp;
+
+typedef struct {
+    AnanasLIR_RegOp op;
+    AnanasLIR_Reg dst;
+    U32 index;
+} AnanasLIR_RegOpLoadLambda;
+
+static inline const char *AnanasLIR_RegOpName(AnanasLIR_RegOp op) {
+    switch (op) {
+        #define X(op) case AnanasLIR_RegOp_##op: return #op;
+        ANANAS_LIR_ENUM_REG_OPS
+        #undef X
+    }
+
+    HELIOS_UNREACHABLE();
+}
+
+static inline UZ AnanasLIR_RegOpSize(U8 *bytes) {
+    AnanasLIR_RegOp op = *(AnanasLIR_RegOp *)bytes;
+
+    switch (op) {
+    case AnanasLIR_RegOp_LoadConst:  return sizeof(AnanasLIR_RegOpLoadConst);
+    case AnanasLIR_RegOp_Move:       return sizeof(AnanasLIR_RegOpMove);
+    case AnanasLIR_RegOp_AddImm:     return sizeof(AnanasLIR_RegOpAddImm);
+    case AnanasLIR_RegOp_Lookup:     return sizeof(AnanasLIR_RegOpLookup);
+    case AnanasLIR_RegOp_Return:     return sizeof(AnanasLIR_RegOpReturn);
+    case AnanasLIR_RegOp_CondJmp:    return sizeof(AnanasLIR_RegOpCondJmp);
+    case AnanasLIR_RegOp_Jmp:        return sizeof(AnanasLIR_RegOpJmp);
+    case AnanasLIR_RegOp_LoadLambda: return sizeof(AnanasLIR_RegOpLoadLambda);
+    case AnanasLIR_RegOp_PushScope:
+    case AnanasLIR_RegOp_PopScope:   return sizeof(AnanasLIR_RegOp);
+    case AnanasLIR_RegOp_Define:
+    case AnanasLIR_RegOp_Update:     return sizeof(AnanasLIR_RegOpBind);
+    case AnanasLIR_RegOp_Add:
+    case AnanasLIR_RegOp_Sub:
+    case AnanasLIR_RegOp_Mul:
+    case AnanasLIR_RegOp_Rem:        return sizeof(AnanasLIR_RegOpBinary);
+    case AnanasLIR_RegOp_LookupCall: {
+        AnanasLIR_RegOpLookupCall *lcop = (AnanasLIR_RegOpLookupCall *)bytes;
+        return sizeof(*lcop) + sizeof(AnanasLIR_Reg) * lcop->args_count;
+    }
+    case AnanasLIR_RegOp_Call: {
+        AnanasLIR_RegOpCall *cop = (AnanasLIR_RegOpCall *)bytes;
+        return sizeof(*cop) + sizeof(AnanasLIR_Reg) * cop->args_count;
+    }
+    }
+
+    HELIOS_UNREACHABLE();
+}
+
 typedef struct {
     U8 *bytes;
     UZ count;
@@ -77,6 +258,12 @@ typedef struct {
     U8 *bytecode;
     UZ bytecode_count;
     AnanasParams params;
+
+    // NOTE: Only used by register bytecode, the parameters arrive in the first registers.
+    U32 registers_count;
+
+    // NOTE: Filled in by the verifier, counts the arguments as well.
+    U32 max_stack_depth;
 } AnanasLIR_CompiledLambda;
 
 typedef struct {
@@ -100,6 +287,34 @@ static inline const char *AnanasLIR_OpName(AnanasLIR_Op op) {
     HELIOS_UNREACHABLE();
 }
 
+static inline UZ AnanasLIR_OpSize(AnanasLIR_Op op) {
+    switch (op) {
+    case AnanasLIR_Op_Const:      return sizeof(AnanasLIR_OpConst);
+    case AnanasLIR_Op_Define:     return sizeof(AnanasLIR_OpDefine);
+    case AnanasLIR_Op_Lookup:     return sizeof(AnanasLIR_OpLookup);
+    case AnanasLIR_Op_Update:     return sizeof(AnanasLIR_OpUpdate);
+    case AnanasLIR_Op_Call:       return sizeof(AnanasLIR_OpCall);
+    case AnanasLIR_Op_CondJmp:    return sizeof(AnanasLIR_OpCondJmp);
+    case AnanasLIR_Op_Jmp:        return sizeof(AnanasLIR_OpJmp);
+    case AnanasLIR_Op_LoadLambda: return sizeof(AnanasLIR_OpLoadLambda);
+    case AnanasLIR_Op_LookupCall: return sizeof(AnanasLIR_OpLookupCall);
+    case AnanasLIR_Op_AddConst:   return sizeof(AnanasLIR_OpAddConst);
+    case AnanasLIR_Op_Add:
+    case AnanasLIR_Op_Sub:
+    case AnanasLIR_Op_Mul:
+    case AnanasLIR_Op_Rem:
+    case AnanasLIR_Op_AddInt:
+    case AnanasLIR_Op_SubInt:
+    case AnanasLIR_Op_MulInt:
+    case AnanasLIR_Op_RemInt:
+    case AnanasLIR_Op_Return:
+    case AnanasLIR_Op_PushScope:
+    case AnanasLIR_Op_PopScope:   return sizeof(AnanasLIR_Op);
+    }
+
+    HELIOS_UNREACHABLE();
+}
+
 static inline void AnanasLIR_CompilerContextInit(AnanasLIR_CompilerContext *ctx,
                                                  HeliosAllocator arena,
                                                  AnanasArena *temp) {
@@ -114,10 +329,42 @@ typedef struct {
 
     AnanasLIR_CompiledLambda *lambdas;
     UZ lambdas_count;
+
+    U32 registers_count;
+
+    U32 max_stack_depth;
+    B32 verified;
 } AnanasLIR_CompiledModule;
 
+void AnanasLIR_AddLambda(AnanasLIR_CompilerContext *ctx, AnanasLIR_CompiledLambda lam);
+
 B32 AnanasLIR_CompileProgram(AnanasLIR_CompilerContext *ctx,
                              AnanasValueArray prog,
                              AnanasLIR_CompiledModule *module);
 
+B32 AnanasLIR_CompileProgramReg(AnanasLIR_CompilerContext *ctx,
+                                AnanasValueArray prog,
+                                AnanasLIR_CompiledModule *module);
+
+void AnanasLIR_OptimizeModule(HeliosAllocator allocator, AnanasLIR_CompiledModule *module);
+
+// NOTE: Checks that every op of the stack bytecode sees enough operands and computes the
+// maximum stack depth of each function, so the VM only has to check for overflow once per
+// frame. Arithmetic on operands proven to be integers is rewritten to the Int variants.
+B32 AnanasLIR_VerifyModule(AnanasLIR_CompiledModule *module, AnanasErrorContext *error_ctx);
+
+// NOTE: Serialized stack bytecode, see lir_cache.c for the layout. The loaded module still
+// has to go through the verifier.
+B32 AnanasLIR_WriteModuleCache(HeliosAllocator allocator,
+                               HeliosStringView path,
+                               U64 source_hash,
+                               AnanasLIR_CompiledModule module);
+
+B32 AnanasLIR_LoadModuleCache(HeliosAllocator allocator,
+                              HeliosStringView path,
+                              U64 source_hash,
+                              AnanasLIR_CompiledModule *module);
+
+void AnanasLIR_ModuleHistogram(AnanasLIR_CompiledModule module, UZ histogram[AnanasLIR_OpsCount]);
+
 #endif // ANANAS_LIR_H_
@@ -0,0 +1,366 @@
+#include "lir.h"
+#include "platform.h"
+
+// NOTE: Layout of an .anbc file:
+//
+//     header | module bytecode | lambda records | param name records | string pool
+//
+// Every string referenced by the bytecode lives in the pool, and the `data` pointers of the
+// string views inside the ops hold offsets into it. Loading copies the bytecode out of the
+// mapping and turns the offsets back into pointers, the pool itself is used in place.
+
+#define ANBC_MAGIC "ANBC"
+#define ANBC_VERSION 1
+
+typedef struct {
+    U8 magic[4];
+    U32 version;
+    U64 source_hash;
+
+    // NOTE: Guard against caches written by a build with a different op set or layout.
+    U32 ops_count;
+    U32 value_size;
+    U32 pointer_size;
+    U32 registers_count;
+
+    U64 bytecode_offset;
+    U64 bytecode_count;
+    U64 lambdas_offset;
+    U64 lambdas_count;
+    U64 names_offset;
+    U64 names_count;
+    U64 pool_offset;
+    U64 pool_count;
+} AnbcHeader;
+
+typedef struct {
+    U64 bytecode_offset;
+    U64 bytecode_count;
+    U64 params_index;
+    U64 params_count;
+    U32 params_variable;
+    U32 registers_count;
+} AnbcLambda;
+
+typedef struct {
+    U64 offset;
+    U64 count;
+} AnbcName;
+
+ERMIS_DECL_HASHMAP(HeliosStringView, U64, AnanasLIR_PoolMap)
+ERMIS_IMPL_HASHMAP(HeliosStringView, U64, AnanasLIR_PoolMap, HeliosStringViewEqual, AnanasFnv1Hash)
+
+typedef struct {
+    AnanasDString pool;
+    AnanasLIR_PoolMap pool_offsets;
+} PoolWriter;
+
+static void AlignBytes(AnanasDString *out) {
+    static const U8 zeros[8] = {0};
+    UZ padding = AnanasAlignForward(out->count, 8) - out->count;
+    if (padding != 8) AnanasDStringAppend(out, zeros, padding);
+}
+
+static HeliosStringView InternName(PoolWriter *w, HeliosStringView name) {
+    U64 offset;
+    if (!AnanasLIR_PoolMapFind(&w->pool_offsets, name, &offset)) {
+        offset = w->pool.count;
+        AnanasDStringAppend(&w->pool, name.data, name.count);
+        AnanasLIR_PoolMapInsert(&w->pool_offsets, name, offset);
+    }
+
+    return (HeliosStringView) {.data = (U8 *)(UZ)offset, .count = name.count};
+}
+
+static void ClearLookupCache(AnanasLIR_OpLookup *lop) {
+    lop->cache_version = 0;
+    lop->cache_slot = NULL;
+}
+
+static B32 WriteBytecode(PoolWriter *w, AnanasDString *out, U8 *bytecode, UZ bytecode_count) {
+    UZ start = out->count;
+    AnanasDStringAppend(out, bytecode, bytecode_count);
+
+    U8 *copy = out->items + start;
+    for (UZ ip = 0; ip < bytecode_count; ip += AnanasLIR_OpSize(*(AnanasLIR_Op *)(copy + ip))) {
+        AnanasLIR_Op *op = (AnanasLIR_Op *)(copy + ip);
+
+        switch (*op) {
+        case AnanasLIR_Op_Const: {
+            AnanasLIR_OpConst *cop = (AnanasLIR_OpConst *)op;
+            memset(&cop->value.token, 0, sizeof(cop->value.token));
+
+            switch (cop->value.type) {
+            case AnanasValueType_Int:
+            case AnanasValueType_Bool:
+                break;
+            case AnanasValueType_String:
+                cop->value.u.string = InternName(w, cop->value.u.string);
+                break;
+            default:
+                return 0;
+            }
+            break;
+        }
+        case AnanasLIR_Op_Define: {
+            AnanasLIR_OpDefine *dop = (AnanasLIR_OpDefine *)op;
+            dop->name = InternName(w, dop->name);
+            break;
+        }
+        case AnanasLIR_Op_Update: {
+            AnanasLIR_OpUpdate *uop = (AnanasLIR_OpUpdate *)op;
+            uop->name = InternName(w, uop->name);
+            break;
+        }
+        case AnanasLIR_Op_Lookup: {
+            AnanasLIR_OpLookup *lop = (AnanasLIR_OpLookup *)op;
+            lop->name = InternName(w, lop->name);
+            ClearLookupCache(lop);
+            break;
+        }
+        case AnanasLIR_Op_LookupCall: {
+            AnanasLIR_OpLookupCall *lcop = (AnanasLIR_OpLookupCall *)op;
+            lcop->lookup.name = InternName(w, lcop->lookup.name);
+            ClearLookupCache(&lcop->lookup);
+            break;
+        }
+        default: break;
+        }
+    }
+
+    AlignBytes(out);
+    return 1;
+}
+
+B32 AnanasLIR_WriteModuleCache(HeliosAllocator allocator,
+                               HeliosStringView path,
+                               U64 source_hash,
+                               AnanasLIR_CompiledModule module) {
+    PoolWriter w;
+    AnanasDStringInit(&w.pool, allocator, 1024);
+    AnanasLIR_PoolMapInit(&w.pool_offsets, allocator, 0);
+
+    AnanasDString out;
+    AnanasDStringInit(&out, allocator, module.bytecode_count + 1024);
+
+    AnbcHeader header = {0};
+    memcpy(header.magic, ANBC_MAGIC, sizeof(header.magic));
+    header.version = ANBC_VERSION;
+    header.source_hash = source_hash;
+    header.ops_count = AnanasLIR_OpsCount;
+    header.value_size = sizeof(AnanasValue);
+    header.pointer_size = sizeof(void *);
+    header.registers_count = module.registers_count;
+    AnanasDStringAppend(&out, &header, sizeof(header));
+
+    header.bytecode_offset = out.count;
+    header.bytecode_count = module.bytecode_count;
+    if (!WriteBytecode(&w, &out, module.bytecode, module.bytecode_count)) return 0;
+
+    AnbcLambda *lambdas = HeliosAlloc(allocator, sizeof(AnbcLambda) * (module.lambdas_count + 1));
+    AnbcName *names = NULL;
+    UZ names_count = 0;
+    for (UZ i = 0; i < module.lambdas_count; ++i) names_count += module.lambdas[i].params.count;
+    names = HeliosAlloc(allocator, sizeof(AnbcName) * (names_count + 1));
+
+    UZ names_index = 0;
+    for (UZ i = 0; i < module.lambdas_count; ++i) {
+        AnanasLIR_CompiledLambda lam = module.lambdas[i];
+
+        lambdas[i].bytecode_offset = out.count;
+        lambdas[i].bytecode_count = lam.bytecode_count;
+        lambdas[i].params_index = names_index;
+        lambdas[i].params_count = lam.params.count;
+        lambdas[i].params_variable = lam.params.variable;
+        lambdas[i].registers_count = lam.registers_count;
+
+        if (!WriteBytecode(&w, &out, lam.bytecode, lam.bytecode_count)) return 0;
+
+        for (UZ p = 0; p < lam.params.count; ++p) {
+            HeliosStringView name = InternName(&w, lam.params.names[p]);
+            names[names_index].offset = (U64)(UZ)name.data;
+            names[names_index].count = name.count;
+            ++names_index;
+        }
+    }
+
+    header.lambdas_offset = out.count;
+    header.lambdas_count = module.lambdas_count;
+    AnanasDStringAppend(&out, lambdas, sizeof(AnbcLambda) * module.lambdas_count);
+
+    header.names_offset = out.count;
+    header.names_count = names_count;
+    AnanasDStringAppend(&out, names, sizeof(AnbcName) * names_count);
+
+    header.pool_offset = out.count;
+    header.pool_count = w.pool.count;
+    AnanasDStringAppend(&out, w.pool.items, w.pool.count);
+
+    memcpy(out.items, &header, sizeof(header));
+
+    return AnanasPlatformWriteEntireFile(path, out.items, out.count);
+}
+
+typedef struct {
+    U8 *pool;
+    UZ pool_count;
+} PoolReader;
+
+static B32 RelocateName(PoolReader *r, HeliosStringView *name) {
+    UZ offset = (UZ)name->data;
+    if (offset > r->pool_count || name->count > r->pool_count - offset) return 0;
+
+    name->data = r->pool + offset;
+    return 1;
+}
+
+static B32 RangeInFile(U64 offset, U64 count, U64 item_size, UZ file_count) {
+    if (offset > file_count) return 0;
+    if (item_size != 0 && count > (file_count - offset) / item_size) return 0;
+    return 1;
+}
+
+static B32 LoadBytecode(HeliosAllocator allocator,
+                        PoolReader *r,
+                        U8 *file,
+                        UZ file_count,
+                        U64 offset,
+                        U64 count,
+                        U8 **out_bytecode) {
+    if (!RangeInFile(offset, count, 1, file_count)) return 0;
+
+    U8 *bytecode = HeliosAlloc(allocator, count + 1);
+    memcpy(bytecode, file + offset, count);
+
+    // NOTE: Only decode as far as the ops fit, the verifier takes care of the rest.
+    for (UZ ip = 0; ip < count;) {
+        AnanasLIR_Op *op = (AnanasLIR_Op *)(bytecode + ip);
+        if (count - ip < sizeof(AnanasLIR_Op) || (UZ)*op >= AnanasLIR_OpsCount) return 0;
+
+        UZ size = AnanasLIR_OpSize(*op);
+        if (count - ip < size) return 0;
+
+        switch (*op) {
+        case AnanasLIR_Op_Const: {
+            AnanasLIR_OpConst *cop = (AnanasLIR_OpConst *)op;
+            switch (cop->value.type) {
+            case AnanasValueType_Int:
+            case AnanasValueType_Bool:
+                break;
+            case AnanasValueType_String:
+                if (!RelocateName(r, &cop->value.u.string)) return 0;
+                break;
+            default:
+                return 0;
+            }
+            break;
+        }
+        case AnanasLIR_Op_Define:
+            if (!RelocateName(r, &((AnanasLIR_OpDefine *)op)->name)) return 0;
+            break;
+        case AnanasLIR_Op_Update:
+            if (!RelocateName(r, &((AnanasLIR_OpUpdate *)op)->name)) return 0;
+            break;
+        case AnanasLIR_Op_Lookup:
+            if (!RelocateName(r, &((AnanasLIR_OpLookup *)op)->name)) return 0;
+            break;
+        case AnanasLIR_Op_LookupCall:
+            if (!RelocateName(r, &((AnanasLIR_OpLookupCall *)op)->lookup.name)) return 0;
+            break;
+        default: break;
+        }
+
+        ip += size;
+    }
+
+    *out_bytecode = bytecode;
+    return 1;
+}
+
+static B32 LoadMappedModule(HeliosAllocator allocator,
+                            U8 *file,
+                            UZ file_count,
+                            U64 source_hash,
+                            AnanasLIR_CompiledModule *module) {
+    if (file_count < sizeof(AnbcHeader)) return 0;
+
+    AnbcHeader header;
+    memcpy(&header, file, sizeof(header));
+
+    if (memcmp(header.magic, ANBC_MAGIC, sizeof(header.magic)) != 0) return 0;
+    if (header.version != ANBC_VERSION) return 0;
+    if (header.source_hash != source_hash) return 0;
+    if (header.ops_count != AnanasLIR_OpsCount) return 0;
+    if (header.value_size != sizeof(AnanasValue)) return 0;
+    if (header.pointer_size != sizeof(void *)) return 0;
+
+    if (!RangeInFile(header.lambdas_offset, header.lambdas_count, sizeof(AnbcLambda), file_count)) return 0;
+    if (!RangeInFile(header.names_offset, header.names_count, sizeof(AnbcName), file_count)) return 0;
+    if (!RangeInFile(header.pool_offset, header.pool_count, 1, file_count)) return 0;
+
+    PoolReader r = {.pool = file + header.pool_offset, .pool_count = header.pool_count};
+
+    AnanasLIR_CompiledModule result = {0};
+    result.registers_count = header.registers_count;
+    result.bytecode_count = header.bytecode_count;
+    if (!LoadBytecode(allocator,
+                      &r,
+                      file,
+                      file_count,
+                      header.bytecode_offset,
+                      header.bytecode_count,
+                      &result.bytecode)) {
+        return 0;
+    }
+
+    result.lambdas_count = header.lambdas_count;
+    result.lambdas = HeliosAlloc(allocator, sizeof(AnanasLIR_CompiledLambda) * (header.lambdas_count + 1));
+
+    for (UZ i = 0; i < header.lambdas_count; ++i) {
+        AnbcLambda record;
+        memcpy(&record, file + header.lambdas_offset + i * sizeof(record), sizeof(record));
+
+        AnanasLIR_CompiledLambda *lam = &result.lambdas[i];
+        memset(lam, 0, sizeof(*lam));
+
+        lam->bytecode_count = record.bytecode_count;
+        lam->registers_count = record.registers_count;
+        if (!LoadBytecode(allocator, &r, file, file_count, record.bytecode_offset, record.bytecode_count, &lam->bytecode)) {
+            return 0;
+        }
+
+        if (record.params_index > header.names_count || record.params_count > header.names_count - record.params_index) {
+            return 0;
+        }
+
+        lam->params.count = record.params_count;
+        lam->params.variable = record.params_variable;
+        lam->params.names = HeliosAlloc(allocator, sizeof(HeliosStringView) * (record.params_count + 1));
+
+        for (UZ p = 0; p < record.params_count; ++p) {
+            AnbcName name;
+            memcpy(&name, file + header.names_offset + (record.params_index + p) * sizeof(name), sizeof(name));
+            lam->params.names[p] = (HeliosStringView) {.data = (U8 *)(UZ)name.offset, .count = name.count};
+            if (!RelocateName(&r, &lam->params.names[p])) return 0;
+        }
+    }
+
+    *module = result;
+    return 1;
+}
+
+B32 AnanasLIR_LoadModuleCache(HeliosAllocator allocator,
+                              HeliosStringView path,
+                              U64 source_hash,
+                              AnanasLIR_CompiledModule *module) {
+    U8 *file;
+    UZ file_count;
+    if (!AnanasPlatformMapFile(path, 0, &file, &file_count)) return 0;
+
+    if (!LoadMappedModule(allocator, file, file_count, source_hash, module)) {
+        AnanasPlatformUnmapFile(file, file_count);
+        return 0;
+    }
+
+    return 1;
+}
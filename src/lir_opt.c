@@ -0,0 +1,353 @@
+#include "lir.h"
+
+typedef union {
+    AnanasLIR_Op op;
+    AnanasLIR_OpConst constant;
+    AnanasLIR_OpDefine define;
+    AnanasLIR_OpLookup lookup;
+    AnanasLIR_OpUpdate update;
+    AnanasLIR_OpJmp jmp;
+    AnanasLIR_OpCondJmp cond_jmp;
+    AnanasLIR_OpLoadLambda load_lambda;
+    AnanasLIR_OpCall call;
+    AnanasLIR_OpLookupCall lookup_call;
+    AnanasLIR_OpAddConst add_const;
+} AnyOp;
+
+typedef struct {
+    UZ offset;
+    B32 removed;
+    B32 is_target;
+    AnyOp u;
+} Insn;
+
+typedef struct {
+    Insn *insns;
+    UZ count;
+    // NOTE: Offset one past the last instruction, jumps are allowed to target it.
+    UZ end_offset;
+} InsnList;
+
+static void Decode(HeliosAllocator allocator, U8 *bytecode, UZ bytecode_count, InsnList *list) {
+    UZ count = 0;
+    for (UZ i = 0; i < bytecode_count; i += AnanasLIR_OpSize(*(AnanasLIR_Op *)(bytecode + i))) {
+        ++count;
+    }
+
+    list->insns = HeliosAlloc(allocator, sizeof(Insn) * count);
+    list->count = count;
+    list->end_offset = bytecode_count;
+
+    UZ offset = 0;
+    for (UZ i = 0; i < count; ++i) {
+        AnanasLIR_Op *op = (AnanasLIR_Op *)(bytecode + offset);
+        UZ size = AnanasLIR_OpSize(*op);
+
+        Insn *insn = &list->insns[i];
+        insn->offset = offset;
+        insn->removed = 0;
+        insn->is_target = 0;
+        memcpy(&insn->u, op, size);
+
+        offset += size;
+    }
+}
+
+static B32 IsJump(Insn *insn) {
+    return insn->u.op == AnanasLIR_Op_Jmp || insn->u.op == AnanasLIR_Op_CondJmp;
+}
+
+static UZ *JumpTarget(Insn *insn) {
+    if (insn->u.op == AnanasLIR_Op_Jmp) return &insn->u.jmp.ip;
+    HELIOS_ASSERT(insn->u.op == AnanasLIR_Op_CondJmp);
+    return &insn->u.cond_jmp.ip;
+}
+
+// NOTE: Returns `list->count` for the end offset.
+static UZ FindInsnAt(InsnList *list, UZ offset) {
+    if (offset == list->end_offset) return list->count;
+
+    UZ lo = 0;
+    UZ hi = list->count;
+    while (lo < hi) {
+        UZ mid = lo + (hi - lo) / 2;
+        if (list->insns[mid].offset < offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    HELIOS_VERIFY(lo < list->count && list->insns[lo].offset == offset);
+    return lo;
+}
+
+static UZ NextLive(InsnList *list, UZ idx) {
+    while (idx < list->count && list->insns[idx].removed) ++idx;
+    return idx;
+}
+
+static void ComputeTargets(InsnList *list) {
+    for (UZ i = 0; i < list->count; ++i) list->insns[i].is_target = 0;
+
+    for (UZ i = 0; i < list->count; ++i) {
+        Insn *insn = &list->insns[i];
+        if (insn->removed || !IsJump(insn)) continue;
+
+        UZ target = NextLive(list, FindInsnAt(list, *JumpTarget(insn)));
+        if (target < list->count) list->insns[target].is_target = 1;
+    }
+}
+
+static void ThreadJumps(InsnList *list) {
+    for (UZ i = 0; i < list->count; ++i) {
+        Insn *insn = &list->insns[i];
+        if (insn->removed || !IsJump(insn)) continue;
+
+        UZ *ip = JumpTarget(insn);
+
+        // NOTE: Bounded by the instruction count so that a cycle of jumps can't hang us.
+        for (UZ hops = 0; hops < list->count; ++hops) {
+            UZ target = NextLive(list, FindInsnAt(list, *ip));
+            if (target >= list->count || list->insns[target].u.op != AnanasLIR_Op_Jmp) break;
+            if (target == i) break;
+            *ip = list->insns[target].u.jmp.ip;
+        }
+    }
+}
+
+static void RemoveDeadCode(InsnList *list) {
+    B32 reachable = 1;
+
+    for (UZ i = 0; i < list->count; ++i) {
+        Insn *insn = &list->insns[i];
+        if (insn->removed) continue;
+
+        if (insn->is_target) reachable = 1;
+
+        if (!reachable) {
+            insn->removed = 1;
+            continue;
+        }
+
+        if (insn->u.op == AnanasLIR_Op_Return || insn->u.op == AnanasLIR_Op_Jmp) reachable = 0;
+    }
+
+    for (UZ i = 0; i < list->count; ++i) {
+        Insn *insn = &list->insns[i];
+        if (insn->removed || insn->u.op != AnanasLIR_Op_Jmp) continue;
+
+        UZ next = NextLive(list, i + 1);
+        UZ target = NextLive(list, FindInsnAt(list, insn->u.jmp.ip));
+        if (next == target) insn->removed = 1;
+    }
+}
+
+static B32 IsIntConst(Insn *insn) {
+    return insn->u.op == AnanasLIR_Op_Const && insn->u.constant.value.type == AnanasValueType_Int;
+}
+
+// NOTE: Folds through unsigned arithmetic, which wraps around on overflow the way the VM
+// does at runtime instead of being undefined.
+static B32 FoldArith(AnanasLIR_Op op, S64 lhs, S64 rhs, S64 *result) {
+    switch (op) {
+    case AnanasLIR_Op_Add: *result = (S64)((U64)lhs + (U64)rhs); return 1;
+    case AnanasLIR_Op_Sub: *result = (S64)((U64)lhs - (U64)rhs); return 1;
+    case AnanasLIR_Op_Mul: *result = (S64)((U64)lhs * (U64)rhs); return 1;
+    case AnanasLIR_Op_Rem: {
+        if (rhs == 0) return 0;
+        // NOTE: `INT64_MIN % -1` overflows, the remainder by -1 is always 0.
+        *result = rhs == -1 ? 0 : lhs % rhs;
+        return 1;
+    }
+    default: return 0;
+    }
+}
+
+// NOTE: `window` holds the indices of the live instructions seen so far, so that patterns can
+// be matched against the already rewritten output (e.g. folding `1 + 2 + 3` down to a single
+// Const). It has room for every instruction of the list.
+static void Peephole(InsnList *list, UZ *window) {
+    UZ window_count = 0;
+
+    for (UZ i = 0; i < list->count; ++i) {
+        Insn *insn = &list->insns[i];
+        if (insn->removed) continue;
+
+        Insn *prev = window_count >= 1 ? &list->insns[window[window_count - 1]] : NULL;
+        Insn *prev2 = window_count >= 2 ? &list->insns[window[window_count - 2]] : NULL;
+
+        switch (insn->u.op) {
+        case AnanasLIR_Op_Add:
+        case AnanasLIR_Op_Sub:
+        case AnanasLIR_Op_Mul:
+        case AnanasLIR_Op_Rem: {
+            if (insn->is_target || prev == NULL || prev->is_target) break;
+
+            // NOTE: `Const k; <push>; Add` is the same as `<push>; AddConst k`.
+            if (insn->u.op == AnanasLIR_Op_Add &&
+                prev2 != NULL &&
+                IsIntConst(prev2) &&
+                prev->u.op == AnanasLIR_Op_Lookup) {
+                AnanasLIR_OpAddConst aop = {0};
+                aop.op = AnanasLIR_Op_AddConst;
+                aop.value = prev2->u.constant.value.u.integer;
+                insn->u.add_const = aop;
+                prev2->removed = 1;
+                window[window_count - 2] = window[window_count - 1];
+                --window_count;
+                break;
+            }
+
+            if (!IsIntConst(prev)) break;
+
+            S64 rhs = prev->u.constant.value.u.integer;
+
+            if (prev2 != NULL && IsIntConst(prev2)) {
+                S64 lhs = prev2->u.constant.value.u.integer;
+                S64 folded;
+                if (FoldArith(insn->u.op, lhs, rhs, &folded)) {
+                    prev2->u.constant.value.u.integer = folded;
+                    prev->removed = 1;
+                    insn->removed = 1;
+                    --window_count;
+                    continue;
+                }
+            }
+
+            if (insn->u.op == AnanasLIR_Op_Add || (insn->u.op == AnanasLIR_Op_Sub && rhs != INT64_MIN)) {
+                AnanasLIR_OpAddConst aop = {0};
+                aop.op = AnanasLIR_Op_AddConst;
+                aop.value = insn->u.op == AnanasLIR_Op_Add ? rhs : -rhs;
+                prev->u.add_const = aop;
+                insn->removed = 1;
+                continue;
+            }
+
+            break;
+        }
+        case AnanasLIR_Op_AddConst: {
+            if (insn->is_target || prev == NULL || !IsIntConst(prev)) break;
+
+            S64 *value = &prev->u.constant.value.u.integer;
+            *value = (S64)((U64)*value + (U64)insn->u.add_const.value);
+            insn->removed = 1;
+            continue;
+        }
+        case AnanasLIR_Op_CondJmp: {
+            if (insn->is_target || prev == NULL || !IsIntConst(prev)) break;
+
+            if (prev->u.constant.value.u.integer) {
+                AnanasLIR_OpJmp jop = {0};
+                jop.op = AnanasLIR_Op_Jmp;
+                jop.ip = insn->u.cond_jmp.ip;
+                prev->u.jmp = jop;
+            } else {
+                prev->removed = 1;
+                --window_count;
+            }
+
+            insn->removed = 1;
+            continue;
+        }
+        case AnanasLIR_Op_Call: {
+            if (insn->is_target || prev == NULL || prev->u.op != AnanasLIR_Op_Lookup) break;
+
+            AnanasLIR_OpLookupCall lcop = {0};
+            lcop.lookup = prev->u.lookup;
+            lcop.lookup.op = AnanasLIR_Op_LookupCall;
+            lcop.args_count = insn->u.call.args_count;
+            prev->u.lookup_call = lcop;
+            insn->removed = 1;
+            continue;
+        }
+        default: break;
+        }
+
+        window[window_count++] = i;
+    }
+}
+
+static void Encode(HeliosAllocator allocator, InsnList *list, U8 **out_bytecode, UZ *out_count) {
+    UZ *new_offsets = HeliosAlloc(allocator, sizeof(UZ) * (list->count + 1));
+
+    UZ new_count = 0;
+    for (UZ i = 0; i < list->count; ++i) {
+        new_offsets[i] = new_count;
+        if (!list->insns[i].removed) new_count += AnanasLIR_OpSize(list->insns[i].u.op);
+    }
+    new_offsets[list->count] = new_count;
+
+    U8 *bytecode = HeliosAlloc(allocator, new_count);
+
+    for (UZ i = 0; i < list->count; ++i) {
+        Insn *insn = &list->insns[i];
+        if (insn->removed) continue;
+
+        if (IsJump(insn)) {
+            UZ *ip = JumpTarget(insn);
+            // NOTE: A removed instruction has no effect of its own, so jumping to it
+            // is the same as jumping to whatever comes after it.
+            *ip = new_offsets[NextLive(list, FindInsnAt(list, *ip))];
+        }
+
+        memcpy(bytecode + new_offsets[i], &insn->u, AnanasLIR_OpSize(insn->u.op));
+    }
+
+    *out_bytecode = bytecode;
+    *out_count = new_count;
+}
+
+static void OptimizeBytecode(HeliosAllocator allocator, U8 **bytecode, UZ *bytecode_count) {
+    if (*bytecode_count == 0) return;
+
+    InsnList list;
+    Decode(allocator, *bytecode, *bytecode_count, &list);
+
+    // NOTE: Each pass can expose more work for the others (e.g. a folded CondJmp leaves
+    // dead code behind), so run them until nothing changes.
+    UZ *window = HeliosAlloc(allocator, sizeof(UZ) * list.count);
+
+    UZ live_count = list.count + 1;
+    while (1) {
+        ThreadJumps(&list);
+        ComputeTargets(&list);
+        RemoveDeadCode(&list);
+        ComputeTargets(&list);
+        Peephole(&list, window);
+
+        UZ new_live_count = 0;
+        for (UZ i = 0; i < list.count; ++i) {
+            if (!list.insns[i].removed) ++new_live_count;
+        }
+
+        if (new_live_count == live_count) break;
+        live_count = new_live_count;
+    }
+
+    Encode(allocator, &list, bytecode, bytecode_count);
+}
+
+void AnanasLIR_OptimizeModule(HeliosAllocator allocator, AnanasLIR_CompiledModule *module) {
+    OptimizeBytecode(allocator, &module->bytecode, &module->bytecode_count);
+
+    for (UZ i = 0; i < module->lambdas_count; ++i) {
+        AnanasLIR_CompiledLambda *lam = &module->lambdas[i];
+        OptimizeBytecode(allocator, &lam->bytecode, &lam->bytecode_count);
+    }
+}
+
+static void BytecodeHistogram(U8 *bytecode, UZ bytecode_count, UZ histogram[AnanasLIR_OpsCount]) {
+    for (UZ i = 0; i < bytecode_count;) {
+        AnanasLIR_Op op = *(AnanasLIR_Op *)(bytecode + i);
+        ++histogram[op];
+        i += AnanasLIR_OpSize(op);
+    }
+}
+
+void AnanasLIR_ModuleHistogram(AnanasLIR_CompiledModule module, UZ histogram[AnanasLIR_OpsCount]) {
+    memset(histogram, 0, sizeof(UZ) * AnanasLIR_OpsCount);
+
+    BytecodeHistogram(module.bytecode, module.bytecode_count, histogram);
+
+    for (UZ i = 0; i < module.lambdas_count; ++i) {
+        BytecodeHistogram(module.lambdas[i].bytecode, module.lambdas[i].bytecode_count, histogram);
+    }
+}
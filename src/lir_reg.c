@@ -0,0 +1,595 @@
+#include "lir.h"
+
+// NOTE: Instructions are first emitted on virtual registers, every intermediate value getting
+// a fresh one. Once a function body is done, each virtual register gets a live interval and
+// a linear scan maps them onto as few frame slots as possible.
+
+typedef U32 VReg;
+
+typedef struct {
+    AnanasLIR_RegOp op;
+    VReg dst;
+    VReg lhs;
+    VReg rhs;
+    S64 imm;
+    AnanasValue value;
+    HeliosStringView name;
+    // NOTE: Index of the target instruction for jumps.
+    UZ target;
+    UZ args_start;
+    U16 args_count;
+    U32 lambda_index;
+} VInsn;
+
+ERMIS_DECL_ARRAY(VInsn, AnanasLIR_VInsnArray)
+ERMIS_IMPL_ARRAY(VInsn, AnanasLIR_VInsnArray)
+
+ERMIS_DECL_ARRAY(VReg, AnanasLIR_VRegArray)
+ERMIS_IMPL_ARRAY(VReg, AnanasLIR_VRegArray)
+
+typedef struct {
+    AnanasLIR_VInsnArray insns;
+    AnanasLIR_VRegArray args;
+    VReg vregs_count;
+} Function;
+
+typedef struct {
+    AnanasLIR_CompilerContext *ctx;
+    HeliosAllocator temp;
+    Function *fn;
+} RegCompiler;
+
+static void FunctionInit(Function *fn, HeliosAllocator allocator) {
+    AnanasLIR_VInsnArrayInit(&fn->insns, allocator, 64);
+    AnanasLIR_VRegArrayInit(&fn->args, allocator, 16);
+    fn->vregs_count = 0;
+}
+
+static VReg NewVReg(RegCompiler *c) {
+    return c->fn->vregs_count++;
+}
+
+static UZ Emit(RegCompiler *c, VInsn insn) {
+    AnanasLIR_VInsnArrayPush(&c->fn->insns, insn);
+    return c->fn->insns.count - 1;
+}
+
+static VReg EmitConst(RegCompiler *c, AnanasValue value) {
+    VReg dst = NewVReg(c);
+    Emit(c, (VInsn) {.op = AnanasLIR_RegOp_LoadConst, .dst = dst, .value = value});
+    return dst;
+}
+
+static B32 CompileExpr(RegCompiler *c, AnanasValue value, VReg *out);
+
+static B32 CompileBody(RegCompiler *c, AnanasList *forms, VReg *out) {
+    if (forms == NULL) {
+        *out = EmitConst(c, ANANAS_FALSE);
+        return 1;
+    }
+
+    while (forms != NULL) {
+        if (!CompileExpr(c, forms->car, out)) return 0;
+        forms = forms->cdr;
+    }
+
+    return 1;
+}
+
+static B32 IsIntLiteral(AnanasValue value) {
+    return value.type == AnanasValueType_Int;
+}
+
+static B32 CompileBinary(RegCompiler *c, AnanasLIR_RegOp op, AnanasList *args, VReg *out) {
+    HELIOS_ASSERT(args != NULL);
+    HELIOS_ASSERT(args->cdr != NULL);
+
+    AnanasValue lhs_val = args->car;
+    AnanasValue rhs_val = args->cdr->car;
+
+    VReg lhs;
+    if (!CompileExpr(c, lhs_val, &lhs)) return 0;
+
+    if ((op == AnanasLIR_RegOp_Add || op == AnanasLIR_RegOp_Sub) && IsIntLiteral(rhs_val)) {
+        S64 imm = rhs_val.u.integer;
+        *out = NewVReg(c);
+        Emit(c, (VInsn) {
+            .op = AnanasLIR_RegOp_AddImm,
+            .dst = *out,
+            .lhs = lhs,
+            .imm = op == AnanasLIR_RegOp_Add ? imm : -imm,
+        });
+        return 1;
+    }
+
+    VReg rhs;
+    if (!CompileExpr(c, rhs_val, &rhs)) return 0;
+
+    *out = NewVReg(c);
+    Emit(c, (VInsn) {.op = op, .dst = *out, .lhs = lhs, .rhs = rhs});
+    return 1;
+}
+
+typedef struct {
+    VReg vreg;
+    UZ start;
+    UZ end;
+} Interval;
+
+static void ExtendInterval(Interval *intervals, VReg v, UZ idx) {
+    if (idx < intervals[v].start) intervals[v].start = idx;
+    if (idx > intervals[v].end) intervals[v].end = idx;
+}
+
+static int CompareIntervals(const void *lhs_ptr, const void *rhs_ptr) {
+    const Interval *lhs = lhs_ptr;
+    const Interval *rhs = rhs_ptr;
+    if (lhs->start != rhs->start) return lhs->start < rhs->start ? -1 : 1;
+    if (lhs->vreg != rhs->vreg) return lhs->vreg < rhs->vreg ? -1 : 1;
+    return 0;
+}
+
+// NOTE: The first `params_count` virtual registers are the parameters, they are pinned to
+// the first frame slots since that is where the VM puts the arguments.
+static U32 AllocateRegisters(RegCompiler *c, Function *fn, VReg params_count, AnanasLIR_Reg *assignment) {
+    Interval *intervals = HeliosAlloc(c->temp, sizeof(Interval) * (fn->vregs_count + 1));
+    for (VReg v = 0; v < fn->vregs_count; ++v) {
+        intervals[v].vreg = v;
+        intervals[v].start = v < params_count ? 0 : (UZ)-1;
+        intervals[v].end = 0;
+    }
+
+    for (UZ i = 0; i < fn->insns.count; ++i) {
+        VInsn *insn = &fn->insns.items[i];
+
+        switch (insn->op) {
+        case AnanasLIR_RegOp_LoadConst:
+        case AnanasLIR_RegOp_Lookup:
+        case AnanasLIR_RegOp_LoadLambda:
+            ExtendInterval(intervals, insn->dst, i);
+            break;
+        case AnanasLIR_RegOp_Move:
+        case AnanasLIR_RegOp_AddImm:
+            ExtendInterval(intervals, insn->lhs, i);
+            ExtendInterval(intervals, insn->dst, i);
+            break;
+        case AnanasLIR_RegOp_Add:
+        case AnanasLIR_RegOp_Sub:
+        case AnanasLIR_RegOp_Mul:
+        case AnanasLIR_RegOp_Rem:
+            ExtendInterval(intervals, insn->lhs, i);
+            ExtendInterval(intervals, insn->rhs, i);
+            ExtendInterval(intervals, insn->dst, i);
+            break;
+        case AnanasLIR_RegOp_Define:
+        case AnanasLIR_RegOp_Update:
+        case AnanasLIR_RegOp_Return:
+        case AnanasLIR_RegOp_CondJmp:
+            ExtendInterval(intervals, insn->lhs, i);
+            break;
+        case AnanasLIR_RegOp_Call:
+            ExtendInterval(intervals, insn->lhs, i);
+            // fallthrough
+        case AnanasLIR_RegOp_LookupCall:
+            for (U16 a = 0; a < insn->args_count; ++a) {
+                ExtendInterval(intervals, fn->args.items[insn->args_start + a], i);
+            }
+            ExtendInterval(intervals, insn->dst, i);
+            break;
+        case AnanasLIR_RegOp_PushScope:
+        case AnanasLIR_RegOp_PopScope:
+        case AnanasLIR_RegOp_Jmp:
+            break;
+        }
+    }
+
+    qsort(intervals, fn->vregs_count, sizeof(Interval), CompareIntervals);
+
+    // NOTE: `active_end[r]` is the last instruction that still needs physical register `r`.
+    UZ *active_end = HeliosAlloc(c->temp, sizeof(UZ) * (fn->vregs_count + 1));
+    B32 *active = HeliosAlloc(c->temp, sizeof(B32) * (fn->vregs_count + 1));
+    memset(active, 0, sizeof(B32) * (fn->vregs_count + 1));
+    U32 registers_count = params_count;
+
+    for (VReg p = 0; p < params_count; ++p) {
+        assignment[p] = (AnanasLIR_Reg)p;
+    }
+
+    for (VReg i = 0; i < fn->vregs_count; ++i) {
+        Interval interval = intervals[i];
+        if (interval.vreg < params_count) {
+            active[interval.vreg] = 1;
+            active_end[interval.vreg] = interval.end;
+            continue;
+        }
+
+        U32 chosen = registers_count;
+        for (U32 r = 0; r < registers_count; ++r) {
+            if (active[r] && active_end[r] < interval.start) active[r] = 0;
+            if (!active[r] && chosen == registers_count) chosen = r;
+        }
+
+        if (chosen == registers_count) ++registers_count;
+        HELIOS_VERIFY(registers_count <= ANANAS_LIR_REGS_MAX);
+
+        active[chosen] = 1;
+        active_end[chosen] = interval.end;
+        assignment[interval.vreg] = (AnanasLIR_Reg)chosen;
+    }
+
+    return registers_count;
+}
+
+static UZ VInsnSize(VInsn *insn) {
+    switch (insn->op) {
+    case AnanasLIR_RegOp_LookupCall:
+        return sizeof(AnanasLIR_RegOpLookupCall) + sizeof(AnanasLIR_Reg) * insn->args_count;
+    case AnanasLIR_RegOp_Call:
+        return sizeof(AnanasLIR_RegOpCall) + sizeof(AnanasLIR_Reg) * insn->args_count;
+    default: {
+        AnanasLIR_RegOp op = insn->op;
+        return AnanasLIR_RegOpSize((U8 *)&op);
+    }
+    }
+}
+
+static void Encode(RegCompiler *c,
+                   Function *fn,
+                   AnanasLIR_Reg *assignment,
+                   U8 **out_bytecode,
+                   UZ *out_count) {
+    UZ *offsets = HeliosAlloc(c->temp, sizeof(UZ) * (fn->insns.count + 1));
+
+    UZ count = 0;
+    for (UZ i = 0; i < fn->insns.count; ++i) {
+        offsets[i] = count;
+        count += VInsnSize(&fn->insns.items[i]);
+    }
+    offsets[fn->insns.count] = count;
+
+    U8 *bytecode = HeliosAlloc(c->ctx->arena, count);
+
+#define R(v) (assignment[(v)])
+
+    for (UZ i = 0; i < fn->insns.count; ++i) {
+        VInsn *insn = &fn->insns.items[i];
+        U8 *ptr = bytecode + offsets[i];
+
+        switch (insn->op) {
+        case AnanasLIR_RegOp_LoadConst: {
+            AnanasLIR_RegOpLoadConst *op = (AnanasLIR_RegOpLoadConst *)ptr;
+            op->op = insn->op;
+            op->dst = R(insn->dst);
+            op->value = insn->value;
+            break;
+        }
+        case AnanasLIR_RegOp_Move: {
+            AnanasLIR_RegOpMove *op = (AnanasLIR_RegOpMove *)ptr;
+            op->op = insn->op;
+            op->dst = R(insn->dst);
+            op->src = R(insn->lhs);
+            break;
+        }
+        case AnanasLIR_RegOp_Add:
+        case AnanasLIR_RegOp_Sub:
+        case AnanasLIR_RegOp_Mul:
+        case AnanasLIR_RegOp_Rem: {
+            AnanasLIR_RegOpBinary *op = (AnanasLIR_RegOpBinary *)ptr;
+            op->op = insn->op;
+            op->dst = R(insn->dst);
+            op->lhs = R(insn->lhs);
+            op->rhs = R(insn->rhs);
+            break;
+        }
+        case AnanasLIR_RegOp_AddImm: {
+            AnanasLIR_RegOpAddImm *op = (AnanasLIR_RegOpAddImm *)ptr;
+            op->op = insn->op;
+            op->dst = R(insn->dst);
+            op->src = R(insn->lhs);
+            op->value = insn->imm;
+            break;
+        }
+        case AnanasLIR_RegOp_Define:
+        case AnanasLIR_RegOp_Update: {
+            AnanasLIR_RegOpBind *op = (AnanasLIR_RegOpBind *)ptr;
+            op->op = insn->op;
+            op->src = R(insn->lhs);
+            op->name = insn->name;
+            break;
+        }
+        case AnanasLIR_RegOp_Lookup: {
+            AnanasLIR_RegOpLookup *op = (AnanasLIR_RegOpLookup *)ptr;
+            op->lookup.op = (AnanasLIR_Op)insn->op;
+            op->lookup.name = insn->name;
+            op->dst = R(insn->dst);
+            break;
+        }
+        case AnanasLIR_RegOp_LookupCall: {
+            AnanasLIR_RegOpLookupCall *op = (AnanasLIR_RegOpLookupCall *)ptr;
+            op->lookup.op = (AnanasLIR_Op)insn->op;
+            op->lookup.name = insn->name;
+            op->dst = R(insn->dst);
+            op->args_count = insn->args_count;
+
+            AnanasLIR_Reg *args = (AnanasLIR_Reg *)(op + 1);
+            for (U16 a = 0; a < insn->args_count; ++a) {
+                args[a] = R(fn->args.items[insn->args_start + a]);
+            }
+            break;
+        }
+        case AnanasLIR_RegOp_Call: {
+            AnanasLIR_RegOpCall *op = (AnanasLIR_RegOpCall *)ptr;
+            op->op = insn->op;
+            op->dst = R(insn->dst);
+            op->callee = R(insn->lhs);
+            op->args_count = insn->args_count;
+
+            AnanasLIR_Reg *args = (AnanasLIR_Reg *)(op + 1);
+            for (U16 a = 0; a < insn->args_count; ++a) {
+                args[a] = R(fn->args.items[insn->args_start + a]);
+            }
+            break;
+        }
+        case AnanasLIR_RegOp_Return: {
+            AnanasLIR_RegOpReturn *op = (AnanasLIR_RegOpReturn *)ptr;
+            op->op = insn->op;
+            op->src = R(insn->lhs);
+            break;
+        }
+        case AnanasLIR_RegOp_CondJmp: {
+            AnanasLIR_RegOpCondJmp *op = (AnanasLIR_RegOpCondJmp *)ptr;
+            op->op = insn->op;
+            op->cond = R(insn->lhs);
+            op->ip = offsets[insn->target];
+            break;
+        }
+        case AnanasLIR_RegOp_Jmp: {
+            AnanasLIR_RegOpJmp *op = (AnanasLIR_RegOpJmp *)ptr;
+            op->op = insn->op;
+            op->ip = offsets[insn->target];
+            break;
+        }
+        case AnanasLIR_RegOp_LoadLambda: {
+            AnanasLIR_RegOpLoadLambda *op = (AnanasLIR_RegOpLoadLambda *)ptr;
+            op->op = insn->op;
+            op->dst = R(insn->dst);
+            op->index = insn->lambda_index;
+            break;
+        }
+        case AnanasLIR_RegOp_PushScope:
+        case AnanasLIR_RegOp_PopScope: {
+            *(AnanasLIR_RegOp *)ptr = insn->op;
+            break;
+        }
+        }
+    }
+
+#undef R
+
+    *out_bytecode = bytecode;
+    *out_count = count;
+}
+
+static U32 FinishFunction(RegCompiler *c, Function *fn, VReg params_count, U8 **bytecode, UZ *bytecode_count) {
+    AnanasLIR_Reg *assignment = HeliosAlloc(c->temp, sizeof(AnanasLIR_Reg) * (fn->vregs_count + 1));
+    U32 registers_count = AllocateRegisters(c, fn, params_count, assignment);
+    Encode(c, fn, assignment, bytecode, bytecode_count);
+    return registers_count;
+}
+
+static B32 CompileExpr(RegCompiler *c, AnanasValue value, VReg *out) {
+    switch (value.type) {
+    case AnanasValueType_Function:
+    case AnanasValueType_Macro:
+    case AnanasValueType_Table:
+    case AnanasValueType_HashMap:
+    case AnanasValueType_Vector:
+        HELIOS_TODO();
+    case AnanasValueType_Bool:
+    case AnanasValueType_String:
+    case AnanasValueType_StringBuilder:
+    case AnanasValueType_Int: {
+        *out = EmitConst(c, AnanasValueFlatten(value));
+        return 1;
+    }
+    case AnanasValueType_Symbol: {
+        *out = NewVReg(c);
+        Emit(c, (VInsn) {.op = AnanasLIR_RegOp_Lookup, .dst = *out, .name = value.u.symbol});
+        return 1;
+    }
+    case AnanasValueType_List: {
+        AnanasList *list = value.u.list;
+        HELIOS_ASSERT(list != NULL);
+
+        AnanasValue car_cons = list->car;
+        HELIOS_ASSERT(car_cons.type == AnanasValueType_Symbol);
+
+        HeliosStringView sym_name = car_cons.u.symbol;
+
+        AnanasList *args = list->cdr;
+
+        if (HeliosStringViewEqualCStr(sym_name, "var") || HeliosStringViewEqualCStr(sym_name, "set")) {
+            HELIOS_ASSERT(args != NULL);
+
+            AnanasValue var_name_cons = args->car;
+            HELIOS_ASSERT(var_name_cons.type == AnanasValueType_Symbol);
+
+            HELIOS_ASSERT(args->cdr != NULL);
+
+            if (!CompileExpr(c, args->cdr->car, out)) return 0;
+
+            AnanasLIR_RegOp op = HeliosStringViewEqualCStr(sym_name, "var")
+                ? AnanasLIR_RegOp_Define
+                : AnanasLIR_RegOp_Update;
+            Emit(c, (VInsn) {.op = op, .lhs = *out, .name = var_name_cons.u.symbol});
+            return 1;
+        } else if (HeliosStringViewEqualCStr(sym_name, "do")) {
+            return CompileBody(c, args, out);
+        } else if (HeliosStringViewEqualCStr(sym_name, "+")) {
+            return CompileBinary(c, AnanasLIR_RegOp_Add, args, out);
+        } else if (HeliosStringViewEqualCStr(sym_name, "-")) {
+            return CompileBinary(c, AnanasLIR_RegOp_Sub, args, out);
+        } else if (HeliosStringViewEqualCStr(sym_name, "*")) {
+            return CompileBinary(c, AnanasLIR_RegOp_Mul, args, out);
+        } else if (HeliosStringViewEqualCStr(sym_name, "rem")) {
+            return CompileBinary(c, AnanasLIR_RegOp_Rem, args, out);
+        } else if (HeliosStringViewEqualCStr(sym_name, "let")) {
+            HELIOS_ASSERT(args != NULL);
+
+            AnanasValue bindings_val = args->car;
+            HELIOS_ASSERT(bindings_val.type == AnanasValueType_List);
+
+            Emit(c, (VInsn) {.op = AnanasLIR_RegOp_PushScope});
+
+            AnanasList *bindings = bindings_val.u.list;
+            while (bindings != NULL) {
+                AnanasValue pair_val = bindings->car;
+                HELIOS_ASSERT(pair_val.type == AnanasValueType_List);
+
+                AnanasList *pair = pair_val.u.list;
+                HELIOS_ASSERT(pair != NULL);
+                HELIOS_ASSERT(pair->cdr != NULL);
+
+                AnanasValue binding_name_val = pair->car;
+                HELIOS_ASSERT(binding_name_val.type == AnanasValueType_Symbol);
+
+                VReg binding_value;
+                if (!CompileExpr(c, pair->cdr->car, &binding_value)) return 0;
+
+                Emit(c, (VInsn) {
+                    .op = AnanasLIR_RegOp_Define,
+                    .lhs = binding_value,
+                    .name = binding_name_val.u.symbol,
+                });
+
+                bindings = bindings->cdr;
+            }
+
+            if (!CompileBody(c, args->cdr, out)) return 0;
+
+            Emit(c, (VInsn) {.op = AnanasLIR_RegOp_PopScope});
+            return 1;
+        } else if (HeliosStringViewEqualCStr(sym_name, "if")) {
+            HELIOS_ASSERT(args != NULL);
+            HELIOS_ASSERT(args->cdr != NULL);
+            HELIOS_ASSERT(args->cdr->cdr != NULL);
+
+            VReg cond;
+            if (!CompileExpr(c, args->car, &cond)) return 0;
+
+            UZ cond_jump_consq = Emit(c, (VInsn) {.op = AnanasLIR_RegOp_CondJmp, .lhs = cond});
+
+            VReg result = NewVReg(c);
+
+            VReg alt;
+            if (!CompileExpr(c, args->cdr->cdr->car, &alt)) return 0;
+            Emit(c, (VInsn) {.op = AnanasLIR_RegOp_Move, .dst = result, .lhs = alt});
+
+            UZ jump_end = Emit(c, (VInsn) {.op = AnanasLIR_RegOp_Jmp});
+
+            c->fn->insns.items[cond_jump_consq].target = c->fn->insns.count;
+
+            VReg consq;
+            if (!CompileExpr(c, args->cdr->car, &consq)) return 0;
+            Emit(c, (VInsn) {.op = AnanasLIR_RegOp_Move, .dst = result, .lhs = consq});
+
+            c->fn->insns.items[jump_end].target = c->fn->insns.count;
+
+            *out = result;
+            return 1;
+        } else if (HeliosStringViewEqualCStr(sym_name, "lambda")) {
+            HELIOS_ASSERT(args != NULL);
+
+            AnanasValue params_val = args->car;
+            HELIOS_ASSERT(params_val.type == AnanasValueType_List);
+
+            AnanasLIR_CompiledLambda lambda = {0};
+            HELIOS_ASSERT(AnanasParseParamsFromList(c->ctx->arena, params_val.u.list, &lambda.params, NULL));
+
+            Function *enclosing_fn = c->fn;
+            Function fn;
+            FunctionInit(&fn, c->temp);
+            c->fn = &fn;
+
+            for (UZ i = 0; i < lambda.params.count; ++i) {
+                VReg param = NewVReg(c);
+                Emit(c, (VInsn) {.op = AnanasLIR_RegOp_Define, .lhs = param, .name = lambda.params.names[i]});
+            }
+
+            VReg body_result;
+            if (!CompileBody(c, args->cdr, &body_result)) return 0;
+            Emit(c, (VInsn) {.op = AnanasLIR_RegOp_Return, .lhs = body_result});
+
+            lambda.registers_count = FinishFunction(c,
+                                                    &fn,
+                                                    (VReg)lambda.params.count,
+                                                    &lambda.bytecode,
+                                                    &lambda.bytecode_count);
+            c->fn = enclosing_fn;
+
+            *out = NewVReg(c);
+            Emit(c, (VInsn) {
+                .op = AnanasLIR_RegOp_LoadLambda,
+                .dst = *out,
+                .lambda_index = c->ctx->lambdas_count,
+            });
+
+            AnanasLIR_AddLambda(c->ctx, lambda);
+            return 1;
+        } else {
+            // NOTE: Nested calls append their own arguments while ours are being compiled,
+            // so collect them first and only then copy them into the function's pool.
+            AnanasLIR_VRegArray call_args;
+            AnanasLIR_VRegArrayInit(&call_args, c->temp, 8);
+
+            while (args != NULL) {
+                VReg arg;
+                if (!CompileExpr(c, args->car, &arg)) return 0;
+                AnanasLIR_VRegArrayPush(&call_args, arg);
+                args = args->cdr;
+            }
+
+            HELIOS_VERIFY(call_args.count <= UINT16_MAX);
+            U16 args_count = (U16)call_args.count;
+
+            UZ args_start = c->fn->args.count;
+            AnanasLIR_VRegArrayPushMany(&c->fn->args, call_args.items, call_args.count);
+
+            *out = NewVReg(c);
+            Emit(c, (VInsn) {
+                .op = AnanasLIR_RegOp_LookupCall,
+                .dst = *out,
+                .name = sym_name,
+                .args_start = args_start,
+                .args_count = args_count,
+            });
+            return 1;
+        }
+    }
+    }
+
+    HELIOS_UNREACHABLE();
+}
+
+B32 AnanasLIR_CompileProgramReg(AnanasLIR_CompilerContext *ctx,
+                                AnanasValueArray prog,
+                                AnanasLIR_CompiledModule *module) {
+    RegCompiler c = {0};
+    c.ctx = ctx;
+    c.temp = AnanasArenaToHeliosAllocator(ctx->temp);
+
+    Function fn;
+    FunctionInit(&fn, c.temp);
+    c.fn = &fn;
+
+    for (UZ i = 0; i < prog.count; ++i) {
+        VReg result;
+        if (!CompileExpr(&c, AnanasValueArrayAt(&prog, i), &result)) return 0;
+    }
+
+    module->registers_count = FinishFunction(&c, &fn, 0, &module->bytecode, &module->bytecode_count);
+    module->lambdas = ctx->lambdas;
+    module->lambdas_count = ctx->lambdas_count;
+
+    return 1;
+}
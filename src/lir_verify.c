@@ -0,0 +1,310 @@
+#include "lir.h"
+
+// NOTE: The compiler only ever emits forward jumps, so the state of every instruction is
+// known once all of the instructions before it were visited and a single pass is enough.
+// Only the types of the two topmost slots are tracked, that is all the arithmetic needs.
+
+typedef enum {
+    SlotType_Any,
+    SlotType_Int,
+} SlotType;
+
+typedef struct {
+    B32 reached;
+    UZ min_depth;
+    UZ max_depth;
+    SlotType top[2];
+} State;
+
+static void Merge(State *into, State from) {
+    if (!into->reached) {
+        *into = from;
+        return;
+    }
+
+    B32 same_depth = into->min_depth == into->max_depth
+        && from.min_depth == from.max_depth
+        && into->min_depth == from.min_depth;
+
+    into->min_depth = HELIOS_MIN(into->min_depth, from.min_depth);
+    into->max_depth = HELIOS_MAX(into->max_depth, from.max_depth);
+
+    for (UZ i = 0; i < 2; ++i) {
+        if (!same_depth || into->top[i] != from.top[i]) into->top[i] = SlotType_Any;
+    }
+}
+
+static void PopSlots(State *state, UZ count) {
+    state->min_depth -= count;
+    state->max_depth -= count;
+
+    for (UZ i = 0; i < count; ++i) {
+        state->top[0] = state->top[1];
+        state->top[1] = SlotType_Any;
+    }
+}
+
+static void PushSlot(State *state, SlotType type) {
+    state->min_depth += 1;
+    state->max_depth += 1;
+    state->top[1] = state->top[0];
+    state->top[0] = type;
+}
+
+static AnanasLIR_Op IntVariant(AnanasLIR_Op op) {
+    switch (op) {
+    case AnanasLIR_Op_Add: return AnanasLIR_Op_AddInt;
+    case AnanasLIR_Op_Sub: return AnanasLIR_Op_SubInt;
+    case AnanasLIR_Op_Mul: return AnanasLIR_Op_MulInt;
+    case AnanasLIR_Op_Rem: return AnanasLIR_Op_RemInt;
+    default:               return op;
+    }
+}
+
+static AnanasLIR_Op GenericVariant(AnanasLIR_Op op) {
+    switch (op) {
+    case AnanasLIR_Op_AddInt: return AnanasLIR_Op_Add;
+    case AnanasLIR_Op_SubInt: return AnanasLIR_Op_Sub;
+    case AnanasLIR_Op_MulInt: return AnanasLIR_Op_Mul;
+    case AnanasLIR_Op_RemInt: return AnanasLIR_Op_Rem;
+    default:                  return op;
+    }
+}
+
+// NOTE: Returns `count` for the end offset and when no instruction starts at the offset.
+static UZ FindInsnAt(UZ *offsets, UZ count, UZ end_offset, UZ offset) {
+    if (offset == end_offset) return count;
+
+    UZ lo = 0;
+    UZ hi = count;
+    while (lo < hi) {
+        UZ mid = lo + (hi - lo) / 2;
+        if (offsets[mid] < offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return lo < count && offsets[lo] == offset ? lo : count + 1;
+}
+
+// NOTE: The offsets and the states are only needed while verifying, so they live on the heap
+// and are indexed by instruction instead of taking the arena for every byte of the bytecode.
+static B32 VerifyBytecodeWithScratch(HeliosAllocator scratch,
+                                     U8 *bytecode,
+                                     UZ bytecode_count,
+                                     UZ initial_depth,
+                                     U32 *out_max_depth,
+                                     AnanasErrorContext *error_ctx,
+                                     UZ **out_offsets,
+                                     State **out_states,
+                                     UZ *out_count) {
+    UZ count = 0;
+    for (UZ ip = 0; ip < bytecode_count; ip += AnanasLIR_OpSize(*(AnanasLIR_Op *)(bytecode + ip))) {
+        AnanasLIR_Op op = *(AnanasLIR_Op *)(bytecode + ip);
+        if ((UZ)op >= AnanasLIR_OpsCount) {
+            AnanasErrorContextMessage(error_ctx, 0, 0, "invalid opcode %u at offset %zu", (U32)op, ip);
+            return 0;
+        }
+
+        ++count;
+    }
+
+    UZ *offsets = HeliosAlloc(scratch, sizeof(UZ) * (count + 1));
+    *out_offsets = offsets;
+
+    // NOTE: One extra state for the end of the bytecode.
+    State *states = HeliosAlloc(scratch, sizeof(State) * (count + 1));
+    memset(states, 0, sizeof(State) * (count + 1));
+    *out_states = states;
+    *out_count = count;
+
+    UZ ip = 0;
+    for (UZ i = 0; i < count; ++i) {
+        offsets[i] = ip;
+        ip += AnanasLIR_OpSize(*(AnanasLIR_Op *)(bytecode + ip));
+    }
+    offsets[count] = bytecode_count;
+
+    states[0].reached = 1;
+    states[0].min_depth = initial_depth;
+    states[0].max_depth = initial_depth;
+
+    UZ max_depth = initial_depth;
+
+    for (UZ i = 0; i < count; ++i) {
+        UZ ip = offsets[i];
+        AnanasLIR_Op *op = (AnanasLIR_Op *)(bytecode + ip);
+
+        State state = states[i];
+        if (!state.reached) continue;
+
+        UZ pops = 0;
+        UZ pushes = 0;
+        SlotType pushed_type = SlotType_Any;
+        B32 falls_through = 1;
+        B32 has_target = 0;
+        UZ target = 0;
+
+        switch (*op) {
+        case AnanasLIR_Op_Const: {
+            AnanasLIR_OpConst *cop = (AnanasLIR_OpConst *)op;
+            pushes = 1;
+            if (cop->value.type == AnanasValueType_Int || cop->value.type == AnanasValueType_Bool) {
+                pushed_type = SlotType_Int;
+            }
+            break;
+        }
+        case AnanasLIR_Op_Lookup:
+        case AnanasLIR_Op_LoadLambda:
+            pushes = 1;
+            break;
+        case AnanasLIR_Op_Add:
+        case AnanasLIR_Op_Sub:
+        case AnanasLIR_Op_Mul:
+        case AnanasLIR_Op_Rem:
+        case AnanasLIR_Op_AddInt:
+        case AnanasLIR_Op_SubInt:
+        case AnanasLIR_Op_MulInt:
+        case AnanasLIR_Op_RemInt: {
+            pops = 2;
+            pushes = 1;
+            pushed_type = SlotType_Int;
+
+            // NOTE: Bytecode loaded from a cache may claim Int ops the types do not back up.
+            if (state.min_depth >= 2 && state.top[0] == SlotType_Int && state.top[1] == SlotType_Int) {
+                *op = IntVariant(*op);
+            } else {
+                *op = GenericVariant(*op);
+            }
+            break;
+        }
+        case AnanasLIR_Op_AddConst:
+            pops = 1;
+            pushes = 1;
+            pushed_type = SlotType_Int;
+            break;
+        case AnanasLIR_Op_Define:
+        case AnanasLIR_Op_Update:
+            pops = 1;
+            break;
+        case AnanasLIR_Op_PushScope:
+        case AnanasLIR_Op_PopScope:
+            break;
+        case AnanasLIR_Op_Return:
+            // NOTE: The VM leaves exactly one value for the caller, whatever the depth is.
+            falls_through = 0;
+            break;
+        case AnanasLIR_Op_Jmp: {
+            AnanasLIR_OpJmp *jop = (AnanasLIR_OpJmp *)op;
+            falls_through = 0;
+            has_target = 1;
+            target = jop->ip;
+            break;
+        }
+        case AnanasLIR_Op_CondJmp: {
+            AnanasLIR_OpCondJmp *jop = (AnanasLIR_OpCondJmp *)op;
+            pops = 1;
+            has_target = 1;
+            target = jop->ip;
+            break;
+        }
+        case AnanasLIR_Op_Call: {
+            AnanasLIR_OpCall *cop = (AnanasLIR_OpCall *)op;
+            pops = (UZ)cop->args_count + 1;
+            pushes = 1;
+            break;
+        }
+        case AnanasLIR_Op_LookupCall: {
+            AnanasLIR_OpLookupCall *lcop = (AnanasLIR_OpLookupCall *)op;
+            pops = lcop->args_count;
+            pushes = 1;
+            break;
+        }
+        }
+
+        if (state.min_depth < pops) {
+            AnanasErrorContextMessage(error_ctx,
+                                      0,
+                                      0,
+                                      "stack underflow at offset %zu: %s needs %zu values, only %zu available",
+                                      ip,
+                                      AnanasLIR_OpName(*op),
+                                      pops,
+                                      state.min_depth);
+            return 0;
+        }
+
+        PopSlots(&state, pops);
+        for (UZ i = 0; i < pushes; ++i) PushSlot(&state, pushed_type);
+
+        max_depth = HELIOS_MAX(max_depth, state.max_depth);
+
+        if (has_target) {
+            UZ target_idx = FindInsnAt(offsets, count, bytecode_count, target);
+            if (target <= ip || target_idx > count) {
+                AnanasErrorContextMessage(error_ctx, 0, 0, "invalid jump target %zu at offset %zu", target, ip);
+                return 0;
+            }
+
+            Merge(&states[target_idx], state);
+        }
+
+        if (falls_through) Merge(&states[i + 1], state);
+    }
+
+    if (max_depth > UINT32_MAX) {
+        AnanasErrorContextMessage(error_ctx, 0, 0, "stack depth %zu is too big", max_depth);
+        return 0;
+    }
+
+    *out_max_depth = (U32)max_depth;
+    return 1;
+}
+
+static B32 VerifyBytecode(U8 *bytecode,
+                          UZ bytecode_count,
+                          UZ initial_depth,
+                          U32 *out_max_depth,
+                          AnanasErrorContext *error_ctx) {
+    HeliosAllocator scratch = HeliosNewMallocAllocator();
+
+    UZ *offsets = NULL;
+    State *states = NULL;
+    UZ count = 0;
+    B32 ok = VerifyBytecodeWithScratch(scratch,
+                                       bytecode,
+                                       bytecode_count,
+                                       initial_depth,
+                                       out_max_depth,
+                                       error_ctx,
+                                       &offsets,
+                                       &states,
+                                       &count);
+
+    if (offsets != NULL) HeliosFree(scratch, offsets, sizeof(UZ) * (count + 1));
+    if (states != NULL) HeliosFree(scratch, states, sizeof(State) * (count + 1));
+    return ok;
+}
+
+B32 AnanasLIR_VerifyModule(AnanasLIR_CompiledModule *module, AnanasErrorContext *error_ctx) {
+    if (!VerifyBytecode(module->bytecode,
+                        module->bytecode_count,
+                        0,
+                        &module->max_stack_depth,
+                        error_ctx)) {
+        return 0;
+    }
+
+    for (UZ i = 0; i < module->lambdas_count; ++i) {
+        AnanasLIR_CompiledLambda *lam = &module->lambdas[i];
+        if (!VerifyBytecode(lam->bytecode,
+                            lam->bytecode_count,
+                            lam->params.count,
+                            &lam->max_stack_depth,
+                            error_ctx)) {
+            return 0;
+        }
+    }
+
+    module->verified = 1;
+    return 1;
+}
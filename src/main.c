@@ -7,19 +7,43 @@
 #include "lir.h"
 #include "vm.h"
 #include "platform.h"
+#include "port.h"
+#include "image.h"
+#include "expand.h"
+
+// NOTE: The file is mapped read-only rather than copied into the arena, values read from it
+// point straight into the mapping, which stays alive until the process exits.
+static HeliosStringView AnanasReadFileOrDie(HeliosStringView file_path) {
+    U8 *data;
+    UZ count;
+    if (!AnanasPlatformMapFile(file_path, 0, &data, &count)) {
+        fprintf(stderr, "Failed to read the file\n");
+        exit(1);
+    }
+
+    return (HeliosStringView) {.data = data, .count = count};
+}
+
+#define ANANAS_SOURCE_BUFFER_SIZE (64 * 1024)
 
-static void AnanasEvalFile(HeliosAllocator allocator, HeliosStringView file_path) {
-    HeliosStringView file_contents = HeliosReadEntireFile(allocator, file_path);
-    if (file_contents.data == NULL) {
+// NOTE: The file is streamed through a fixed buffer and every form is evaluated as soon as it
+// is read, so `-` can evaluate an endless stream of forms from stdin.
+static void AnanasEvalFileInEnv(HeliosAllocator allocator, AnanasEnv *env, HeliosStringView file_path) {
+    AnanasPlatformFile file;
+    B32 is_stdin = HeliosStringViewEqualCStr(file_path, "-");
+    if (is_stdin) {
+        file = AnanasPlatformStdin();
+    } else if (!AnanasPlatformOpenFile(file_path, &file)) {
         fprintf(stderr, "Failed to read the file\n");
         exit(1);
     }
 
-    HeliosString8Stream source;
-    HeliosString8StreamInit(&source, file_contents.data, file_contents.count);
+    AnanasLexerSource lexer_source;
+    AnanasLexerSourceInit(&lexer_source, file, HeliosNewMallocAllocator(), ANANAS_SOURCE_BUFFER_SIZE);
 
+    HeliosString8Stream source;
     AnanasLexer lexer;
-    AnanasLexerInit(&lexer, &source);
+    AnanasLexerInitSource(&lexer, &source, &lexer_source);
 
     U8 backing_error_buffer[1024];
     HeliosStringView error_buffer = {.data = backing_error_buffer, .count = sizeof(backing_error_buffer)};
@@ -28,14 +52,16 @@ static void AnanasEvalFile(HeliosAllocator allocator, HeliosStringView file_path
     AnanasReaderTable reader_table;
     AnanasReaderTableInit(&reader_table, allocator);
 
-    AnanasEnv env;
-    AnanasEnvInit(&env, NULL, allocator);
-    AnanasRootEnvPopulate(&env);
-
     AnanasValue node;
     while (AnanasReaderNext(&lexer, &reader_table, allocator, &node, &error_ctx)) {
+        AnanasValue expanded;
+        if (!AnanasExpand(node, allocator, env, &expanded, &error_ctx)) {
+            fprintf(stderr, "Macro expansion error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
+            exit(1);
+        }
+
         AnanasValue result;
-        if (!AnanasEval(node, allocator, &env, &result, &error_ctx)) {
+        if (!AnanasEval(expanded, allocator, env, &result, &error_ctx)) {
             fprintf(stderr, "Eval error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
             exit(1);
         }
@@ -44,20 +70,37 @@ static void AnanasEvalFile(HeliosAllocator allocator, HeliosStringView file_path
     if (!error_ctx.ok) {
         fprintf(stderr, "Reader error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
         exit(1);
-    } else {
-        exit(0);
     }
+
+    if (!is_stdin) AnanasPlatformCloseFile(file);
 }
 
-void AnanasSON_CompileFile(AnanasArena *arena, HeliosStringView file_path) {
-    HeliosAllocator allocator = AnanasArenaToHeliosAllocator(arena);
+static AnanasEnv *AnanasRootEnvCreate(HeliosAllocator allocator, const char *image_path) {
+    if (image_path == NULL) {
+        AnanasEnv *env = HeliosAlloc(allocator, sizeof(AnanasEnv));
+        AnanasEnvInit(env, NULL, allocator);
+        AnanasRootEnvPopulate(env);
+        return env;
+    }
 
-    HeliosStringView file_contents = HeliosReadEntireFile(allocator, file_path);
-    if (file_contents.data == NULL) {
-        fprintf(stderr, "Failed to read the file\n");
+    U8 backing_error_buffer[1024];
+    AnanasErrorContext error_ctx = {0};
+    AnanasErrorContextInit(&error_ctx, backing_error_buffer, sizeof(backing_error_buffer));
+
+    AnanasEnv *env;
+    if (!AnanasImageLoad(allocator, HELIOS_SV_LIT(image_path), &env, &error_ctx)) {
+        fprintf(stderr, "Failed to load the image %s: " HELIOS_SV_FMT "\n", image_path, HELIOS_SV_ARG(error_ctx.error_buffer));
         exit(1);
     }
 
+    return env;
+}
+
+void AnanasSON_CompileFile(AnanasArena *arena, HeliosStringView file_path) {
+    HeliosAllocator allocator = AnanasArenaToHeliosAllocator(arena);
+
+    HeliosStringView file_contents = AnanasReadFileOrDie(file_path);
+
     HeliosString8Stream source;
     HeliosString8StreamInit(&source, file_contents.data, file_contents.count);
 
@@ -168,10 +211,26 @@ static void AnanasLIR_DumpBytecode(U8 *bcode, UZ bcount) {
             i += sizeof(*cop);
             break;
         }
+        case AnanasLIR_Op_LookupCall: {
+            AnanasLIR_OpLookupCall *lcop = (AnanasLIR_OpLookupCall *)op;
+            printf(HELIOS_SV_FMT " %u", HELIOS_SV_ARG(lcop->lookup.name), lcop->args_count);
+            i += sizeof(*lcop);
+            break;
+        }
+        case AnanasLIR_Op_AddConst: {
+            AnanasLIR_OpAddConst *aop = (AnanasLIR_OpAddConst *)op;
+            printf("%lld", (long long)aop->value);
+            i += sizeof(*aop);
+            break;
+        }
         case AnanasLIR_Op_PushScope:
         case AnanasLIR_Op_PopScope:
         case AnanasLIR_Op_Return:
         case AnanasLIR_Op_Rem:
+        case AnanasLIR_Op_AddInt:
+        case AnanasLIR_Op_SubInt:
+        case AnanasLIR_Op_MulInt:
+        case AnanasLIR_Op_RemInt:
         case AnanasLIR_Op_Sub:
         case AnanasLIR_Op_Mul:
         case AnanasLIR_Op_Add: {
@@ -184,53 +243,300 @@ static void AnanasLIR_DumpBytecode(U8 *bcode, UZ bcount) {
     }
 }
 
-static void AnanasLIR_CompileFile(AnanasArena *arena,
-                                  HeliosStringView file_path,
-                                  AnanasLIR_CompiledModule *module) {
-    HeliosAllocator allocator = AnanasArenaToHeliosAllocator(arena);
+static void AnanasLIR_DumpHistogram(UZ before[AnanasLIR_OpsCount], UZ after[AnanasLIR_OpsCount]) {
+    UZ total_before = 0;
+    UZ total_after = 0;
 
-    HeliosStringView file_contents = HeliosReadEntireFile(allocator, file_path);
-    if (file_contents.data == NULL) {
-        fprintf(stderr, "Failed to read the file\n");
-        exit(1);
+    printf("Opcode histogram (before -> after):\n");
+
+    for (UZ op = 0; op < AnanasLIR_OpsCount; ++op) {
+        total_before += before[op];
+        total_after += after[op];
+
+        if (before[op] == 0 && after[op] == 0) continue;
+
+        printf("\t%-12s %6zu -> %zu\n", AnanasLIR_OpName((AnanasLIR_Op)op), before[op], after[op]);
     }
 
-    HeliosString8Stream source;
-    HeliosString8StreamInit(&source, file_contents.data, file_contents.count);
+    printf("\t%-12s %6zu -> %zu\n", "Total", total_before, total_after);
+}
 
-    AnanasLexer lexer;
-    AnanasLexerInit(&lexer, &source);
+static void AnanasLIR_DumpRegBytecode(U8 *bcode, UZ bcount) {
+    HELIOS_ASSERT(bcode != NULL);
+
+    for (UZ i = 0; i < bcount; i += AnanasLIR_RegOpSize(bcode + i)) {
+        U8 *bytes = bcode + i;
+        AnanasLIR_RegOp op = *(AnanasLIR_RegOp *)bytes;
+
+        printf("\t[%4zu] %s ", i, AnanasLIR_RegOpName(op));
+
+        switch (op) {
+        case AnanasLIR_RegOp_LoadConst: {
+            AnanasLIR_RegOpLoadConst *cop = (AnanasLIR_RegOpLoadConst *)bytes;
+            HeliosStringView val = AnanasPrint(HeliosGetTempAllocator(), cop->value);
+            printf("r%u, " HELIOS_SV_FMT, cop->dst, HELIOS_SV_ARG(val));
+            break;
+        }
+        case AnanasLIR_RegOp_Move: {
+            AnanasLIR_RegOpMove *mop = (AnanasLIR_RegOpMove *)bytes;
+            printf("r%u, r%u", mop->dst, mop->src);
+            break;
+        }
+        case AnanasLIR_RegOp_Add:
+        case AnanasLIR_RegOp_Sub:
+        case AnanasLIR_RegOp_Mul:
+        case AnanasLIR_RegOp_Rem: {
+            AnanasLIR_RegOpBinary *bop = (AnanasLIR_RegOpBinary *)bytes;
+            printf("r%u, r%u, r%u", bop->dst, bop->lhs, bop->rhs);
+            break;
+        }
+        case AnanasLIR_RegOp_AddImm: {
+            AnanasLIR_RegOpAddImm *aop = (AnanasLIR_RegOpAddImm *)bytes;
+            printf("r%u, r%u, %lld", aop->dst, aop->src, (long long)aop->value);
+            break;
+        }
+        case AnanasLIR_RegOp_Define:
+        case AnanasLIR_RegOp_Update: {
+            AnanasLIR_RegOpBind *bop = (AnanasLIR_RegOpBind *)bytes;
+            printf(HELIOS_SV_FMT ", r%u", HELIOS_SV_ARG(bop->name), bop->src);
+            break;
+        }
+        case AnanasLIR_RegOp_Lookup: {
+            AnanasLIR_RegOpLookup *lop = (AnanasLIR_RegOpLookup *)bytes;
+            printf("r%u, " HELIOS_SV_FMT, lop->dst, HELIOS_SV_ARG(lop->lookup.name));
+            break;
+        }
+        case AnanasLIR_RegOp_LookupCall: {
+            AnanasLIR_RegOpLookupCall *lcop = (AnanasLIR_RegOpLookupCall *)bytes;
+            printf("r%u, " HELIOS_SV_FMT, lcop->dst, HELIOS_SV_ARG(lcop->lookup.name));
+
+            AnanasLIR_Reg *args = (AnanasLIR_Reg *)(lcop + 1);
+            for (U16 a = 0; a < lcop->args_count; ++a) printf(", r%u", args[a]);
+            break;
+        }
+        case AnanasLIR_RegOp_Call: {
+            AnanasLIR_RegOpCall *cop = (AnanasLIR_RegOpCall *)bytes;
+            printf("r%u, r%u", cop->dst, cop->callee);
+
+            AnanasLIR_Reg *args = (AnanasLIR_Reg *)(cop + 1);
+            for (U16 a = 0; a < cop->args_count; ++a) printf(", r%u", args[a]);
+            break;
+        }
+        case AnanasLIR_RegOp_Return: {
+            AnanasLIR_RegOpReturn *rop = (AnanasLIR_RegOpReturn *)bytes;
+            printf("r%u", rop->src);
+            break;
+        }
+        case AnanasLIR_RegOp_CondJmp: {
+            AnanasLIR_RegOpCondJmp *jop = (AnanasLIR_RegOpCondJmp *)bytes;
+            printf("r%u, @%zu", jop->cond, jop->ip);
+            break;
+        }
+        case AnanasLIR_RegOp_Jmp: {
+            AnanasLIR_RegOpJmp *jop = (AnanasLIR_RegOpJmp *)bytes;
+            printf("@%zu", jop->ip);
+            break;
+        }
+        case AnanasLIR_RegOp_LoadLambda: {
+            AnanasLIR_RegOpLoadLambda *lop = (AnanasLIR_RegOpLoadLambda *)bytes;
+            printf("r%u, [%u]", lop->dst, lop->index);
+            break;
+        }
+        case AnanasLIR_RegOp_PushScope:
+        case AnanasLIR_RegOp_PopScope:
+            break;
+        }
+
+        printf("\n");
+    }
+}
+
+static void AnanasLIR_DumpModule(AnanasLIR_CompiledModule module, B32 registers) {
+    void (*dump)(U8 *, UZ) = registers ? AnanasLIR_DumpRegBytecode : AnanasLIR_DumpBytecode;
+
+    if (registers) printf("Registers: %u\n", module.registers_count);
+    if (module.verified) printf("Max stack depth: %u\n", module.max_stack_depth);
+    dump(module.bytecode, module.bytecode_count);
+
+    for (UZ i = 0; i < module.lambdas_count; ++i) {
+        AnanasLIR_CompiledLambda lam = module.lambdas[i];
+        printf("Lambda %zu:\n", i);
+        if (registers) printf("Registers: %u\n", lam.registers_count);
+        if (module.verified) printf("Max stack depth: %u\n", lam.max_stack_depth);
+        dump(lam.bytecode, lam.bytecode_count);
+    }
+}
+
+static void AnanasLIR_VerifyOrDie(HeliosStringView file_path, AnanasLIR_CompiledModule *module) {
+    U8 error_buffer[1024] = {0};
+    AnanasErrorContext error_ctx = {0};
+    AnanasErrorContextInit(&error_ctx, error_buffer, sizeof(error_buffer));
+    error_ctx.place = file_path;
+
+    if (!AnanasLIR_VerifyModule(module, &error_ctx)) {
+        fprintf(stderr, "Verifier error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
+        exit(1);
+    }
+}
+
+static void AnanasLIR_CompileSource(AnanasArena *arena,
+                                    HeliosStringView file_path,
+                                    HeliosStringView file_contents,
+                                    B32 registers,
+                                    AnanasLIR_CompiledModule *module) {
+    HeliosAllocator allocator = AnanasArenaToHeliosAllocator(arena);
 
     U8 backing_error_buffer[1024];
     HeliosStringView error_buffer = {.data = backing_error_buffer, .count = sizeof(backing_error_buffer)};
     AnanasErrorContext error_ctx = {.ok = 1, .place = file_path, .error_buffer = error_buffer};
 
-    AnanasReaderTable reader_table;
-    AnanasReaderTableInit(&reader_table, allocator);
-
-    AnanasValueArray program;
-    AnanasValueArrayInit(&program, allocator, 333);
-    AnanasValue value;
-    while (AnanasReaderNext(&lexer, &reader_table, allocator, &value, &error_ctx)) {
-        AnanasValueArrayPush(&program, value);
+    AnanasListBuilder forms;
+    AnanasListBuilderInit(&forms);
+    if (!AnanasReadAllForms(file_contents, allocator, &forms, &error_ctx)) {
+        fprintf(stderr, "Reader error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
+        exit(1);
     }
 
-    if (!error_ctx.ok) {
-        fprintf(stderr, "Reader error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
+    UZ forms_count = 0;
+    for (AnanasList *form = forms.head; form != NULL; form = form->cdr) ++forms_count;
+
+    AnanasValueArray program;
+    AnanasValueArrayInit(&program, allocator, forms_count + 1);
+    for (AnanasList *form = forms.head; form != NULL; form = form->cdr) AnanasValueArrayPush(&program, form->car);
+
+    // NOTE: Macros are run by the evaluator at compile time, the compiler only sees their expansions.
+    AnanasEnv expansion_env;
+    AnanasEnvInit(&expansion_env, NULL, allocator);
+    AnanasRootEnvPopulate(&expansion_env);
+
+    AnanasValueArray expanded_program;
+    AnanasValueArrayInit(&expanded_program, allocator, program.count + 1);
+    if (!AnanasExpandProgram(program, allocator, &expansion_env, &expanded_program, &error_ctx)) {
+        fprintf(stderr, "Macro expansion error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
         exit(1);
     }
 
     AnanasLIR_CompilerContext ctx = {0};
     AnanasLIR_CompilerContextInit(&ctx, allocator, arena);
 
-    B32 ok = AnanasLIR_CompileProgram(&ctx, program, module);
+    B32 ok = registers
+        ? AnanasLIR_CompileProgramReg(&ctx, expanded_program, module)
+        : AnanasLIR_CompileProgram(&ctx, expanded_program, module);
     HELIOS_ASSERT(ok);
 }
 
+static void AnanasLIR_CompileFile(AnanasArena *arena,
+                                  HeliosStringView file_path,
+                                  B32 registers,
+                                  AnanasLIR_CompiledModule *module) {
+    HeliosStringView file_contents = AnanasReadFileOrDie(file_path);
+    AnanasLIR_CompileSource(arena, file_path, file_contents, registers, module);
+}
+
+// NOTE: `foo.ans` is cached in `foo.anbc`, any other name just gets the extension appended.
+static HeliosStringView AnanasLIR_CachePath(HeliosAllocator allocator, HeliosStringView file_path) {
+    HeliosStringView stem = file_path;
+    if (stem.count >= 4 && memcmp(stem.data + stem.count - 4, ".ans", 4) == 0) stem.count -= 4;
+
+    UZ count = stem.count + sizeof(".anbc") - 1;
+    U8 *data = HeliosAlloc(allocator, count);
+    memcpy(data, stem.data, stem.count);
+    memcpy(data + stem.count, ".anbc", sizeof(".anbc") - 1);
+
+    return (HeliosStringView) {.data = data, .count = count};
+}
+
+// NOTE: Produces an optimized and verified stack module. The cache is keyed by the hash of
+// the source, so a stale cache is simply recompiled and overwritten.
+static void AnanasLIR_LoadOrCompileFile(AnanasArena *arena,
+                                        HeliosStringView file_path,
+                                        AnanasLIR_CompiledModule *module) {
+    HeliosAllocator allocator = AnanasArenaToHeliosAllocator(arena);
+
+    HeliosStringView file_contents = AnanasReadFileOrDie(file_path);
+    U64 source_hash = AnanasFnv1Hash(file_contents);
+    HeliosStringView cache_path = AnanasLIR_CachePath(allocator, file_path);
+
+    if (AnanasLIR_LoadModuleCache(allocator, cache_path, source_hash, module)) {
+        AnanasLIR_VerifyOrDie(cache_path, module);
+        return;
+    }
+
+    AnanasLIR_CompileSource(arena, file_path, file_contents, 0, module);
+    AnanasLIR_OptimizeModule(allocator, module);
+    AnanasLIR_VerifyOrDie(file_path, module);
+
+    if (!AnanasLIR_WriteModuleCache(allocator, cache_path, source_hash, *module)) {
+        fprintf(stderr, "Failed to write the bytecode cache " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(cache_path));
+    }
+}
+
+// NOTE: Runs the same file on the stack VM and on the register VM. Each VM keeps its
+// globals between iterations, so the benchmarked program should be safe to rerun.
+static void AnanasLIR_BenchFile(AnanasArena *arena, HeliosStringView file_path, UZ iterations) {
+    HeliosAllocator arena_allocator = AnanasArenaToHeliosAllocator(arena);
+
+    AnanasLIR_CompiledModule stack_module = {0};
+    AnanasLIR_CompileFile(arena, file_path, 0, &stack_module);
+    AnanasLIR_OptimizeModule(arena_allocator, &stack_module);
+    AnanasLIR_VerifyOrDie(file_path, &stack_module);
+
+    AnanasLIR_CompiledModule reg_module = {0};
+    AnanasLIR_CompileFile(arena, file_path, 1, &reg_module);
+
+    struct {
+        const char *name;
+        AnanasLIR_CompiledModule module;
+        B32 (*exec)(AnanasVM *, AnanasLIR_CompiledModule);
+        UZ bytecode_count;
+        UZ ops_executed;
+        U64 elapsed_ns;
+    } runs[] = {
+        {"stack", stack_module, AnanasVM_ExecModule, 0, 0, 0},
+        {"register", reg_module, AnanasVM_ExecRegModule, 0, 0, 0},
+    };
+
+    for (UZ r = 0; r < sizeof(runs) / sizeof(runs[0]); ++r) {
+        runs[r].bytecode_count = runs[r].module.bytecode_count;
+        for (UZ i = 0; i < runs[r].module.lambdas_count; ++i) {
+            runs[r].bytecode_count += runs[r].module.lambdas[i].bytecode_count;
+        }
+
+        AnanasVM vm = {0};
+        AnanasVM_Init(&vm, HeliosNewMallocAllocator());
+
+        U64 start = AnanasPlatformNanoTime();
+        for (UZ i = 0; i < iterations; ++i) {
+            if (!runs[r].exec(&vm, runs[r].module)) {
+                fprintf(stderr, "Runtime error: %s\n", vm.error);
+                exit(1);
+            }
+        }
+        runs[r].elapsed_ns = AnanasPlatformNanoTime() - start;
+        runs[r].ops_executed = vm.ops_executed;
+    }
+
+    printf("%-10s %12s %14s %14s %12s\n", "VM", "Code bytes", "Ops executed", "Total ms", "ns/op");
+    for (UZ r = 0; r < sizeof(runs) / sizeof(runs[0]); ++r) {
+        double ms = (double)runs[r].elapsed_ns / 1e6;
+        double ns_per_op = runs[r].ops_executed ? (double)runs[r].elapsed_ns / (double)runs[r].ops_executed : 0.0;
+        printf("%-10s %12zu %14zu %14.3f %12.2f\n",
+               runs[r].name, runs[r].bytecode_count, runs[r].ops_executed, ms, ns_per_op);
+    }
+}
+
 int main(int argc, char **argv) {
     AnanasArena arena;
     AnanasArenaInit(&arena, 64 * 1024 * 1024);
 
+    // NOTE: `--image <path>` starts from a dumped root env instead of a freshly populated one.
+    const char *image_path = NULL;
+    if (argc >= 3 && strcmp(argv[1], "--image") == 0) {
+        image_path = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+
     if (argc == 2) {
         fprintf(stderr, "not enough arguments");
         return 1;
@@ -242,41 +548,101 @@ int main(int argc, char **argv) {
         const char *subcommand = argv[1];
         if (strcmp(subcommand, "run") == 0) {
             HeliosStringView file_path = HELIOS_SV_LIT(argv[2]);
-            AnanasEvalFile(arena_allocator, file_path);
-        } else if (strcmp(subcommand, "com") == 0) {
+            AnanasEnv *env = AnanasRootEnvCreate(arena_allocator, image_path);
+            AnanasEvalFileInEnv(arena_allocator, env, file_path);
+            exit(0);
+        } else if (strcmp(subcommand, "dump-image") == 0) {
+            if (argc < 4) {
+                fprintf(stderr, "not enough arguments");
+                return 1;
+            }
+
             HeliosStringView file_path = HELIOS_SV_LIT(argv[2]);
-            AnanasLIR_CompiledModule module = {0};
-            AnanasLIR_CompileFile(&arena, file_path, &module);
+            HeliosStringView out_path = HELIOS_SV_LIT(argv[3]);
 
-            AnanasLIR_DumpBytecode(module.bytecode, module.bytecode_count);
+            AnanasEnv *env = AnanasRootEnvCreate(arena_allocator, image_path);
+            AnanasEvalFileInEnv(arena_allocator, env, file_path);
 
-            for (UZ i = 0; i < module.lambdas_count; ++i) {
-                AnanasLIR_CompiledLambda lam = module.lambdas[i];
-                printf("Lambda %zu:\n", i);
-                AnanasLIR_DumpBytecode(lam.bytecode, lam.bytecode_count);
+            U8 backing_error_buffer[1024];
+            AnanasErrorContext error_ctx = {0};
+            AnanasErrorContextInit(&error_ctx, backing_error_buffer, sizeof(backing_error_buffer));
+
+            if (!AnanasImageDump(arena_allocator, env, out_path, &error_ctx)) {
+                fprintf(stderr, "Failed to dump the image: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
+                return 1;
             }
 
             exit(0);
-        } else if (strcmp(subcommand, "brun") == 0) {
-            HeliosStringView file_path = HELIOS_SV_LIT(argv[2]);
+        } else if (strcmp(subcommand, "com") == 0) {
+            // NOTE: `com --cache <file>` also writes the module to the bytecode cache that
+            // `brun` loads, plain `com` only dumps the compiled module.
+            B32 write_cache = strcmp(argv[2], "--cache") == 0;
+            if (write_cache && argc < 4) {
+                fprintf(stderr, "not enough arguments");
+                return 1;
+            }
+
+            HeliosStringView file_path = HELIOS_SV_LIT(argv[write_cache ? 3 : 2]);
+            HeliosStringView file_contents = AnanasReadFileOrDie(file_path);
+
             AnanasLIR_CompiledModule module = {0};
-            AnanasLIR_CompileFile(&arena, file_path, &module);
+            AnanasLIR_CompileSource(&arena, file_path, file_contents, 0, &module);
+
+            UZ histogram_before[AnanasLIR_OpsCount];
+            AnanasLIR_ModuleHistogram(module, histogram_before);
+
+            AnanasLIR_OptimizeModule(arena_allocator, &module);
+            AnanasLIR_VerifyOrDie(file_path, &module);
 
-            AnanasLIR_DumpBytecode(module.bytecode, module.bytecode_count);
+            UZ histogram_after[AnanasLIR_OpsCount];
+            AnanasLIR_ModuleHistogram(module, histogram_after);
 
-            for (UZ i = 0; i < module.lambdas_count; ++i) {
-                AnanasLIR_CompiledLambda lam = module.lambdas[i];
-                printf("Lambda %zu:\n", i);
-                AnanasLIR_DumpBytecode(lam.bytecode, lam.bytecode_count);
+            AnanasLIR_DumpModule(module, 0);
+
+            AnanasLIR_DumpHistogram(histogram_before, histogram_after);
+
+            if (write_cache) {
+                HeliosStringView cache_path = AnanasLIR_CachePath(arena_allocator, file_path);
+                if (!AnanasLIR_WriteModuleCache(arena_allocator, cache_path, AnanasFnv1Hash(file_contents), module)) {
+                    fprintf(stderr, "Failed to write the bytecode cache " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(cache_path));
+                }
             }
 
+            exit(0);
+        } else if (strcmp(subcommand, "brun") == 0) {
+            B32 registers = strcmp(argv[2], "--reg") == 0;
+            if (registers && argc < 4) {
+                fprintf(stderr, "not enough arguments");
+                return 1;
+            }
+
+            HeliosStringView file_path = HELIOS_SV_LIT(argv[registers ? 3 : 2]);
+            AnanasLIR_CompiledModule module = {0};
+            if (registers) {
+                AnanasLIR_CompileFile(&arena, file_path, 1, &module);
+            } else {
+                AnanasLIR_LoadOrCompileFile(&arena, file_path, &module);
+            }
+
+            AnanasLIR_DumpModule(module, registers);
+            fflush(stdout);
+
             HeliosAllocator allocator = HeliosNewMallocAllocator();
 
             AnanasVM vm = {0};
             AnanasVM_Init(&vm, allocator);
 
-            HELIOS_VERIFY(AnanasVM_ExecModule(&vm, module));
+            B32 ok = registers ? AnanasVM_ExecRegModule(&vm, module) : AnanasVM_ExecModule(&vm, module);
+            if (!ok) {
+                fprintf(stderr, "Runtime error: %s\n", vm.error);
+                exit(1);
+            }
 
+            exit(0);
+        } else if (strcmp(subcommand, "bench") == 0) {
+            HeliosStringView file_path = HELIOS_SV_LIT(argv[2]);
+            UZ iterations = argc >= 4 ? strtoull(argv[3], NULL, 10) : 1000;
+            AnanasLIR_BenchFile(&arena, file_path, iterations);
             exit(0);
         } else {
             fprintf(stderr, "unknown subcommand %s", subcommand);
@@ -286,54 +652,52 @@ int main(int argc, char **argv) {
         HELIOS_UNREACHABLE();
     }
 
-    HeliosAllocator malloc_allocator = HeliosNewMallocAllocator();
-
-    AnanasEnv env;
-    AnanasEnvInit(&env, NULL, arena_allocator);
-    AnanasRootEnvPopulate(&env);
+    AnanasEnv *env = AnanasRootEnvCreate(arena_allocator, image_path);
 
     AnanasReaderTable reader_table;
     AnanasReaderTableInit(&reader_table, arena_allocator);
 
+    // NOTE: Stdin is read as one stream, a form may span as many lines as it needs.
+    AnanasLexerSource lexer_source;
+    AnanasLexerSourceInit(&lexer_source, AnanasPlatformStdin(), HeliosNewMallocAllocator(), ANANAS_SOURCE_BUFFER_SIZE);
+
+    HeliosString8Stream source;
+    AnanasLexer lexer;
+    AnanasLexerInitSource(&lexer, &source, &lexer_source);
+
     while (1) {
         U8 error_buffer[1024] = {0};
         AnanasErrorContext error_ctx = {0};
         AnanasErrorContextInit(&error_ctx, error_buffer, sizeof(error_buffer));
 
+        // NOTE: Echoed values sit in the stdout port, they have to come out before the prompt.
+        AnanasOutputPortFlush(AnanasStdout());
         printf("> ");
-
-        U8 *line_buffer = NULL;
-        UZ line_count = 0;
-
-        if (!AnanasPlatformGetLine(malloc_allocator, &line_buffer, &line_count)) {
-            printf("\n");
-            break;
-        }
-
-        HeliosStringView line = {.data = line_buffer, .count = line_count};
-
-        HeliosString8Stream source;
-        HeliosString8StreamInit(&source, (U8 *)line.data, line.count);
-
-        AnanasLexer lexer;
-        AnanasLexerInit(&lexer, &source);
+        fflush(stdout);
 
         AnanasValue node;
         if (!AnanasReaderNext(&lexer, &reader_table, arena_allocator, &node, &error_ctx)) {
             if (!error_ctx.ok) {
                 printf("Reader error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
+                continue;
             }
 
+            printf("\n");
+            break;
+        }
+
+        AnanasValue expanded;
+        if (!AnanasExpand(node, arena_allocator, env, &expanded, &error_ctx)) {
+            printf("Macro expansion error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
             continue;
         }
 
         AnanasValue result;
-        if (!AnanasEval(node, arena_allocator, &env, &result, &error_ctx)) {
+        if (!AnanasEval(expanded, arena_allocator, env, &result, &error_ctx)) {
             printf("Eval error: " HELIOS_SV_FMT "\n", HELIOS_SV_ARG(error_ctx.error_buffer));
             continue;
         }
 
-        HeliosStringView printed_value = AnanasPrint(arena_allocator, result);
-        printf(HELIOS_SV_FMT "\n", HELIOS_SV_ARG(printed_value));
+        AnanasPrintStdout(result);
     }
 }
@@ -0,0 +1,509 @@
+#include "persistent.h"
+
+static U32 AnanasPopCount(U32 x) {
+    return (U32)__builtin_popcount(x);
+}
+
+static U32 AnanasHashMapEntriesCount(AnanasHashMapNode *node) {
+    return node->collision_count != 0 ? node->collision_count : AnanasPopCount(node->entry_bitmap);
+}
+
+static U32 AnanasHashMapChildrenCount(AnanasHashMapNode *node) {
+    return AnanasPopCount(node->child_bitmap);
+}
+
+static U32 AnanasHashFragment(U64 hash, U32 shift) {
+    return (U32)(hash >> shift) & ANANAS_PERSISTENT_MASK;
+}
+
+static AnanasHashMapNode *AnanasHashMapNodeAlloc(HeliosAllocator allocator,
+                                                 U32 entry_bitmap,
+                                                 U32 child_bitmap,
+                                                 U32 entries_count,
+                                                 U32 children_count) {
+    UZ size = sizeof(AnanasHashMapNode)
+        + sizeof(AnanasHashMapEntry) * entries_count
+        + sizeof(AnanasHashMapNode *) * children_count;
+
+    AnanasHashMapNode *node = HeliosAlloc(allocator, size);
+    node->entry_bitmap = entry_bitmap;
+    node->child_bitmap = child_bitmap;
+    node->collision_count = 0;
+    node->entries = (AnanasHashMapEntry *)(node + 1);
+    node->children = (AnanasHashMapNode **)(node->entries + entries_count);
+    return node;
+}
+
+static AnanasHashMapNode *AnanasHashMapNodeCopy(HeliosAllocator allocator, AnanasHashMapNode *node) {
+    U32 entries_count = AnanasHashMapEntriesCount(node);
+    U32 children_count = AnanasHashMapChildrenCount(node);
+
+    AnanasHashMapNode *copy = AnanasHashMapNodeAlloc(allocator,
+                                                     node->entry_bitmap,
+                                                     node->child_bitmap,
+                                                     entries_count,
+                                                     children_count);
+    copy->collision_count = node->collision_count;
+    memcpy(copy->entries, node->entries, sizeof(*node->entries) * entries_count);
+    memcpy(copy->children, node->children, sizeof(*node->children) * children_count);
+    return copy;
+}
+
+static AnanasHashMapNode *AnanasHashMapCollisionNode(HeliosAllocator allocator,
+                                                     AnanasHashMapEntry *entries,
+                                                     U32 count) {
+    AnanasHashMapNode *node = AnanasHashMapNodeAlloc(allocator, 0, 0, count, 0);
+    node->collision_count = count;
+    memcpy(node->entries, entries, sizeof(*entries) * count);
+    return node;
+}
+
+// NOTE: Builds the smallest subtree that tells apart two entries which landed in the same slot.
+static AnanasHashMapNode *AnanasHashMapMergeEntries(HeliosAllocator allocator,
+                                                    U32 shift,
+                                                    AnanasHashMapEntry lhs,
+                                                    U64 lhs_hash,
+                                                    AnanasHashMapEntry rhs,
+                                                    U64 rhs_hash) {
+    if (shift >= 64) {
+        AnanasHashMapEntry entries[2] = {lhs, rhs};
+        return AnanasHashMapCollisionNode(allocator, entries, 2);
+    }
+
+    U32 lhs_fragment = AnanasHashFragment(lhs_hash, shift);
+    U32 rhs_fragment = AnanasHashFragment(rhs_hash, shift);
+
+    if (lhs_fragment == rhs_fragment) {
+        AnanasHashMapNode *node = AnanasHashMapNodeAlloc(allocator, 0, 1u << lhs_fragment, 0, 1);
+        node->children[0] = AnanasHashMapMergeEntries(allocator,
+                                                      shift + ANANAS_PERSISTENT_BITS,
+                                                      lhs,
+                                                      lhs_hash,
+                                                      rhs,
+                                                      rhs_hash);
+        return node;
+    }
+
+    U32 entry_bitmap = (1u << lhs_fragment) | (1u << rhs_fragment);
+    AnanasHashMapNode *node = AnanasHashMapNodeAlloc(allocator, entry_bitmap, 0, 2, 0);
+    node->entries[0] = lhs_fragment < rhs_fragment ? lhs : rhs;
+    node->entries[1] = lhs_fragment < rhs_fragment ? rhs : lhs;
+    return node;
+}
+
+AnanasHashMap *AnanasHashMapEmpty(HeliosAllocator allocator) {
+    AnanasHashMap *map = HeliosAlloc(allocator, sizeof(*map));
+    map->root = NULL;
+    map->count = 0;
+    return map;
+}
+
+AnanasValue *AnanasHashMapFind(AnanasHashMap *map, AnanasValue key) {
+    U64 hash = AnanasValueKeyHash(key);
+
+    AnanasHashMapNode *node = map->root;
+    U32 shift = 0;
+    while (node != NULL) {
+        if (node->collision_count != 0) {
+            for (U32 i = 0; i < node->collision_count; ++i) {
+                if (AnanasValueKeyEqual(node->entries[i].key, key)) return &node->entries[i].value;
+            }
+            return NULL;
+        }
+
+        U32 bit = 1u << AnanasHashFragment(hash, shift);
+        if (node->entry_bitmap & bit) {
+            AnanasHashMapEntry *entry = &node->entries[AnanasPopCount(node->entry_bitmap & (bit - 1))];
+            return AnanasValueKeyEqual(entry->key, key) ? &entry->value : NULL;
+        }
+
+        if ((node->child_bitmap & bit) == 0) return NULL;
+
+        node = node->children[AnanasPopCount(node->child_bitmap & (bit - 1))];
+        shift += ANANAS_PERSISTENT_BITS;
+    }
+
+    return NULL;
+}
+
+static AnanasHashMapNode *AnanasHashMapNodeSet(HeliosAllocator allocator,
+                                               AnanasHashMapNode *node,
+                                               U32 shift,
+                                               U64 hash,
+                                               AnanasHashMapEntry entry,
+                                               B32 *added) {
+    if (node->collision_count != 0) {
+        for (U32 i = 0; i < node->collision_count; ++i) {
+            if (AnanasValueKeyEqual(node->entries[i].key, entry.key)) {
+                AnanasHashMapNode *copy = AnanasHashMapNodeCopy(allocator, node);
+                copy->entries[i] = entry;
+                return copy;
+            }
+        }
+
+        AnanasHashMapNode *grown = AnanasHashMapNodeAlloc(allocator, 0, 0, node->collision_count + 1, 0);
+        grown->collision_count = node->collision_count + 1;
+        memcpy(grown->entries, node->entries, sizeof(*node->entries) * node->collision_count);
+        grown->entries[node->collision_count] = entry;
+        *added = 1;
+        return grown;
+    }
+
+    U32 bit = 1u << AnanasHashFragment(hash, shift);
+    U32 entries_count = AnanasHashMapEntriesCount(node);
+    U32 children_count = AnanasHashMapChildrenCount(node);
+    U32 entry_index = AnanasPopCount(node->entry_bitmap & (bit - 1));
+    U32 child_index = AnanasPopCount(node->child_bitmap & (bit - 1));
+
+    if (node->entry_bitmap & bit) {
+        AnanasHashMapEntry existing = node->entries[entry_index];
+        if (AnanasValueKeyEqual(existing.key, entry.key)) {
+            AnanasHashMapNode *copy = AnanasHashMapNodeCopy(allocator, node);
+            copy->entries[entry_index] = entry;
+            return copy;
+        }
+
+        // NOTE: The slot turns from an entry into a child holding both the old and the new entry.
+        AnanasHashMapNode *child = AnanasHashMapMergeEntries(allocator,
+                                                             shift + ANANAS_PERSISTENT_BITS,
+                                                             existing,
+                                                             AnanasValueKeyHash(existing.key),
+                                                             entry,
+                                                             hash);
+
+        AnanasHashMapNode *copy = AnanasHashMapNodeAlloc(allocator,
+                                                         node->entry_bitmap & ~bit,
+                                                         node->child_bitmap | bit,
+                                                         entries_count - 1,
+                                                         children_count + 1);
+        memcpy(copy->entries, node->entries, sizeof(*node->entries) * entry_index);
+        memcpy(copy->entries + entry_index,
+               node->entries + entry_index + 1,
+               sizeof(*node->entries) * (entries_count - entry_index - 1));
+        memcpy(copy->children, node->children, sizeof(*node->children) * child_index);
+        copy->children[child_index] = child;
+        memcpy(copy->children + child_index + 1,
+               node->children + child_index,
+               sizeof(*node->children) * (children_count - child_index));
+
+        *added = 1;
+        return copy;
+    }
+
+    if (node->child_bitmap & bit) {
+        AnanasHashMapNode *child = AnanasHashMapNodeSet(allocator,
+                                                        node->children[child_index],
+                                                        shift + ANANAS_PERSISTENT_BITS,
+                                                        hash,
+                                                        entry,
+                                                        added);
+
+        AnanasHashMapNode *copy = AnanasHashMapNodeCopy(allocator, node);
+        copy->children[child_index] = child;
+        return copy;
+    }
+
+    AnanasHashMapNode *copy = AnanasHashMapNodeAlloc(allocator,
+                                                     node->entry_bitmap | bit,
+                                                     node->child_bitmap,
+                                                     entries_count + 1,
+                                                     children_count);
+    memcpy(copy->entries, node->entries, sizeof(*node->entries) * entry_index);
+    copy->entries[entry_index] = entry;
+    memcpy(copy->entries + entry_index + 1,
+           node->entries + entry_index,
+           sizeof(*node->entries) * (entries_count - entry_index));
+    memcpy(copy->children, node->children, sizeof(*node->children) * children_count);
+
+    *added = 1;
+    return copy;
+}
+
+AnanasHashMap *AnanasHashMapSet(HeliosAllocator allocator, AnanasHashMap *map, AnanasValue key, AnanasValue value) {
+    AnanasHashMapEntry entry = {.key = key, .value = value};
+    U64 hash = AnanasValueKeyHash(key);
+
+    AnanasHashMap *result = HeliosAlloc(allocator, sizeof(*result));
+
+    if (map->root == NULL) {
+        result->root = AnanasHashMapNodeAlloc(allocator, 1u << AnanasHashFragment(hash, 0), 0, 1, 0);
+        result->root->entries[0] = entry;
+        result->count = 1;
+        return result;
+    }
+
+    B32 added = 0;
+    result->root = AnanasHashMapNodeSet(allocator, map->root, 0, hash, entry, &added);
+    result->count = map->count + (added ? 1 : 0);
+    return result;
+}
+
+// NOTE: Returns the node itself when the key is not there and NULL when the node is left
+// empty. A child left with a single entry is folded back into its parent, which keeps the
+// trie as shallow as the keys allow.
+static AnanasHashMapNode *AnanasHashMapNodeRemove(HeliosAllocator allocator,
+                                                  AnanasHashMapNode *node,
+                                                  U32 shift,
+                                                  U64 hash,
+                                                  AnanasValue key) {
+    U32 entries_count = AnanasHashMapEntriesCount(node);
+    U32 children_count = AnanasHashMapChildrenCount(node);
+
+    if (node->collision_count != 0) {
+        for (U32 i = 0; i < node->collision_count; ++i) {
+            if (!AnanasValueKeyEqual(node->entries[i].key, key)) continue;
+
+            AnanasHashMapNode *shrunk = AnanasHashMapNodeAlloc(allocator, 0, 0, entries_count - 1, 0);
+            shrunk->collision_count = entries_count - 1;
+            memcpy(shrunk->entries, node->entries, sizeof(*node->entries) * i);
+            memcpy(shrunk->entries + i, node->entries + i + 1, sizeof(*node->entries) * (entries_count - i - 1));
+            return shrunk;
+        }
+
+        return node;
+    }
+
+    U32 bit = 1u << AnanasHashFragment(hash, shift);
+    U32 entry_index = AnanasPopCount(node->entry_bitmap & (bit - 1));
+    U32 child_index = AnanasPopCount(node->child_bitmap & (bit - 1));
+
+    if (node->entry_bitmap & bit) {
+        if (!AnanasValueKeyEqual(node->entries[entry_index].key, key)) return node;
+        if (entries_count == 1 && children_count == 0) return NULL;
+
+        AnanasHashMapNode *copy = AnanasHashMapNodeAlloc(allocator,
+                                                         node->entry_bitmap & ~bit,
+                                                         node->child_bitmap,
+                                                         entries_count - 1,
+                                                         children_count);
+        memcpy(copy->entries, node->entries, sizeof(*node->entries) * entry_index);
+        memcpy(copy->entries + entry_index,
+               node->entries + entry_index + 1,
+               sizeof(*node->entries) * (entries_count - entry_index - 1));
+        memcpy(copy->children, node->children, sizeof(*node->children) * children_count);
+        return copy;
+    }
+
+    if ((node->child_bitmap & bit) == 0) return node;
+
+    AnanasHashMapNode *child = node->children[child_index];
+    AnanasHashMapNode *new_child = AnanasHashMapNodeRemove(allocator,
+                                                           child,
+                                                           shift + ANANAS_PERSISTENT_BITS,
+                                                           hash,
+                                                           key);
+    if (new_child == child) return node;
+
+    // NOTE: Children always hold at least two entries, so a removal never leaves one empty.
+    HELIOS_ASSERT(new_child != NULL);
+
+    if (AnanasHashMapChildrenCount(new_child) == 0 && AnanasHashMapEntriesCount(new_child) == 1) {
+        U32 new_entry_index = AnanasPopCount(node->entry_bitmap & (bit - 1));
+
+        AnanasHashMapNode *copy = AnanasHashMapNodeAlloc(allocator,
+                                                         node->entry_bitmap | bit,
+                                                         node->child_bitmap & ~bit,
+                                                         entries_count + 1,
+                                                         children_count - 1);
+        memcpy(copy->entries, node->entries, sizeof(*node->entries) * new_entry_index);
+        copy->entries[new_entry_index] = new_child->entries[0];
+        memcpy(copy->entries + new_entry_index + 1,
+               node->entries + new_entry_index,
+               sizeof(*node->entries) * (entries_count - new_entry_index));
+        memcpy(copy->children, node->children, sizeof(*node->children) * child_index);
+        memcpy(copy->children + child_index,
+               node->children + child_index + 1,
+               sizeof(*node->children) * (children_count - child_index - 1));
+        return copy;
+    }
+
+    AnanasHashMapNode *copy = AnanasHashMapNodeCopy(allocator, node);
+    copy->children[child_index] = new_child;
+    return copy;
+}
+
+AnanasHashMap *AnanasHashMapRemove(HeliosAllocator allocator, AnanasHashMap *map, AnanasValue key) {
+    if (map->root == NULL) return map;
+
+    AnanasHashMapNode *root = AnanasHashMapNodeRemove(allocator, map->root, 0, AnanasValueKeyHash(key), key);
+    if (root == map->root) return map;
+
+    AnanasHashMap *result = HeliosAlloc(allocator, sizeof(*result));
+    result->root = root;
+    result->count = map->count - 1;
+    return result;
+}
+
+void AnanasHashMapIteratorInit(AnanasHashMapIterator *it, AnanasHashMap *map) {
+    it->depth = 0;
+    if (map->root == NULL) return;
+
+    it->nodes[0] = map->root;
+    it->positions[0] = 0;
+    it->depth = 1;
+}
+
+B32 AnanasHashMapIteratorNext(AnanasHashMapIterator *it, AnanasHashMapEntry *entry) {
+    while (it->depth > 0) {
+        AnanasHashMapNode *node = it->nodes[it->depth - 1];
+        U32 position = it->positions[it->depth - 1]++;
+
+        U32 entries_count = AnanasHashMapEntriesCount(node);
+        if (position < entries_count) {
+            *entry = node->entries[position];
+            return 1;
+        }
+
+        position -= entries_count;
+        if (position < AnanasHashMapChildrenCount(node)) {
+            HELIOS_ASSERT(it->depth < ANANAS_HASH_MAP_MAX_DEPTH);
+            it->nodes[it->depth] = node->children[position];
+            it->positions[it->depth] = 0;
+            ++it->depth;
+            continue;
+        }
+
+        --it->depth;
+    }
+
+    return 0;
+}
+
+static UZ AnanasVectorTailOffset(AnanasVector *vector) {
+    if (vector->count < ANANAS_PERSISTENT_WIDTH) return 0;
+    return ((vector->count - 1) >> ANANAS_PERSISTENT_BITS) << ANANAS_PERSISTENT_BITS;
+}
+
+static AnanasVectorNode *AnanasVectorNodeCopy(HeliosAllocator allocator, AnanasVectorNode *node) {
+    AnanasVectorNode *copy = HeliosAlloc(allocator, sizeof(*copy));
+    if (node != NULL) memcpy(copy, node, sizeof(*copy));
+    else memset(copy, 0, sizeof(*copy));
+    return copy;
+}
+
+static AnanasVectorLeaf *AnanasVectorLeafCopy(HeliosAllocator allocator, AnanasVectorLeaf *leaf, UZ count) {
+    AnanasVectorLeaf *copy = HeliosAlloc(allocator, sizeof(*copy));
+    if (count > 0) memcpy(copy->items, leaf->items, sizeof(*leaf->items) * count);
+    copy->used = count;
+    return copy;
+}
+
+AnanasVector *AnanasVectorEmpty(HeliosAllocator allocator) {
+    AnanasVector *vector = HeliosAlloc(allocator, sizeof(*vector));
+    vector->count = 0;
+    vector->shift = ANANAS_PERSISTENT_BITS;
+    vector->root = NULL;
+    vector->tail = NULL;
+    return vector;
+}
+
+static AnanasVectorLeaf *AnanasVectorLeafFor(AnanasVector *vector, UZ index) {
+    if (index >= AnanasVectorTailOffset(vector)) return vector->tail;
+
+    void *node = vector->root;
+    for (U32 level = vector->shift; level > 0; level -= ANANAS_PERSISTENT_BITS) {
+        node = ((AnanasVectorNode *)node)->children[(index >> level) & ANANAS_PERSISTENT_MASK];
+    }
+
+    return node;
+}
+
+AnanasValue AnanasVectorGet(AnanasVector *vector, UZ index) {
+    HELIOS_VERIFY(index < vector->count);
+    return AnanasVectorLeafFor(vector, index)->items[index & ANANAS_PERSISTENT_MASK];
+}
+
+static void *AnanasVectorNodeSet(HeliosAllocator allocator, void *node, U32 level, UZ index, AnanasValue value) {
+    if (level == 0) {
+        AnanasVectorLeaf *leaf = AnanasVectorLeafCopy(allocator, node, ANANAS_PERSISTENT_WIDTH);
+        leaf->items[index & ANANAS_PERSISTENT_MASK] = value;
+        return leaf;
+    }
+
+    AnanasVectorNode *copy = AnanasVectorNodeCopy(allocator, node);
+    UZ child_index = (index >> level) & ANANAS_PERSISTENT_MASK;
+    copy->children[child_index] = AnanasVectorNodeSet(allocator,
+                                                      copy->children[child_index],
+                                                      level - ANANAS_PERSISTENT_BITS,
+                                                      index,
+                                                      value);
+    return copy;
+}
+
+AnanasVector *AnanasVectorSet(HeliosAllocator allocator, AnanasVector *vector, UZ index, AnanasValue value) {
+    HELIOS_VERIFY(index < vector->count);
+
+    AnanasVector *result = HeliosAlloc(allocator, sizeof(*result));
+    *result = *vector;
+
+    UZ tail_offset = AnanasVectorTailOffset(vector);
+    if (index >= tail_offset) {
+        result->tail = AnanasVectorLeafCopy(allocator, vector->tail, vector->count - tail_offset);
+        result->tail->items[index & ANANAS_PERSISTENT_MASK] = value;
+    } else {
+        result->root = AnanasVectorNodeSet(allocator, vector->root, vector->shift, index, value);
+    }
+
+    return result;
+}
+
+static void *AnanasVectorNewPath(HeliosAllocator allocator, U32 level, AnanasVectorLeaf *leaf) {
+    if (level == 0) return leaf;
+
+    AnanasVectorNode *node = AnanasVectorNodeCopy(allocator, NULL);
+    node->children[0] = AnanasVectorNewPath(allocator, level - ANANAS_PERSISTENT_BITS, leaf);
+    return node;
+}
+
+// NOTE: `count` is the count of the vector before the push, the full tail holds its last 32 items.
+static AnanasVectorNode *AnanasVectorPushTail(HeliosAllocator allocator,
+                                              UZ count,
+                                              U32 level,
+                                              AnanasVectorNode *parent,
+                                              AnanasVectorLeaf *tail) {
+    UZ child_index = ((count - 1) >> level) & ANANAS_PERSISTENT_MASK;
+    AnanasVectorNode *node = AnanasVectorNodeCopy(allocator, parent);
+
+    if (level == ANANAS_PERSISTENT_BITS) {
+        node->children[child_index] = tail;
+    } else {
+        AnanasVectorNode *child = node->children[child_index];
+        node->children[child_index] = child != NULL
+            ? (void *)AnanasVectorPushTail(allocator, count, level - ANANAS_PERSISTENT_BITS, child, tail)
+            : AnanasVectorNewPath(allocator, level - ANANAS_PERSISTENT_BITS, tail);
+    }
+
+    return node;
+}
+
+AnanasVector *AnanasVectorPush(HeliosAllocator allocator, AnanasVector *vector, AnanasValue value) {
+    AnanasVector *result = HeliosAlloc(allocator, sizeof(*result));
+    *result = *vector;
+    result->count = vector->count + 1;
+
+    UZ tail_count = vector->count - AnanasVectorTailOffset(vector);
+    if (tail_count < ANANAS_PERSISTENT_WIDTH) {
+        // NOTE: Nothing past the end of this vector was pushed into its tail yet, so the new
+        // item can go right into it. Every other vector sharing the tail only sees its prefix.
+        AnanasVectorLeaf *tail = vector->tail;
+        if (tail == NULL || tail->used != tail_count) tail = AnanasVectorLeafCopy(allocator, tail, tail_count);
+
+        tail->items[tail->used++] = value;
+        result->tail = tail;
+        return result;
+    }
+
+    if ((vector->count >> ANANAS_PERSISTENT_BITS) > ((UZ)1 << vector->shift)) {
+        AnanasVectorNode *root = AnanasVectorNodeCopy(allocator, NULL);
+        root->children[0] = vector->root;
+        root->children[1] = AnanasVectorNewPath(allocator, vector->shift, vector->tail);
+        result->root = root;
+        result->shift = vector->shift + ANANAS_PERSISTENT_BITS;
+    } else {
+        result->root = AnanasVectorPushTail(allocator, vector->count, vector->shift, vector->root, vector->tail);
+    }
+
+    result->tail = AnanasVectorLeafCopy(allocator, NULL, 0);
+    result->tail->items[result->tail->used++] = value;
+    return result;
+}
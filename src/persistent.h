@@ -0,0 +1,77 @@
+#ifndef ANANAS_PERSISTENT_H_
+#define ANANAS_PERSISTENT_H_
+
+#include "value.h"
+
+// NOTE: Persistent hash maps and vectors. Both are tries with 32-way nodes, an update copies
+// only the path from the root to the changed slot and shares every other node with the
+// collection it was made from, which stays valid and unchanged.
+
+#define ANANAS_PERSISTENT_BITS 5
+#define ANANAS_PERSISTENT_WIDTH (1 << ANANAS_PERSISTENT_BITS)
+#define ANANAS_PERSISTENT_MASK (ANANAS_PERSISTENT_WIDTH - 1)
+
+typedef struct {
+    AnanasValue key;
+    AnanasValue value;
+} AnanasHashMapEntry;
+
+// NOTE: The slots of a node are split in two bitmaps, one for the entries stored in the node
+// itself and one for its children, both kept in bitmap order. Keys whose hashes are equal in
+// all of their 64 bits end up in a collision node, which is a plain array of entries.
+typedef struct AnanasHashMapNode {
+    U32 entry_bitmap;
+    U32 child_bitmap;
+    U32 collision_count;
+    AnanasHashMapEntry *entries;
+    struct AnanasHashMapNode **children;
+} AnanasHashMapNode;
+
+struct AnanasHashMap {
+    AnanasHashMapNode *root;
+    UZ count;
+};
+
+// NOTE: Keys are restricted to the same types as table keys, see `AnanasValueIsHashable`.
+AnanasHashMap *AnanasHashMapEmpty(HeliosAllocator);
+AnanasValue *AnanasHashMapFind(AnanasHashMap *, AnanasValue key);
+AnanasHashMap *AnanasHashMapSet(HeliosAllocator, AnanasHashMap *, AnanasValue key, AnanasValue value);
+AnanasHashMap *AnanasHashMapRemove(HeliosAllocator, AnanasHashMap *, AnanasValue key);
+
+// NOTE: 13 levels use up the 64 bits of the hash, the collision nodes sit one level below.
+#define ANANAS_HASH_MAP_MAX_DEPTH 14
+
+typedef struct {
+    AnanasHashMapNode *nodes[ANANAS_HASH_MAP_MAX_DEPTH];
+    U32 positions[ANANAS_HASH_MAP_MAX_DEPTH];
+    U32 depth;
+} AnanasHashMapIterator;
+
+void AnanasHashMapIteratorInit(AnanasHashMapIterator *, AnanasHashMap *);
+B32 AnanasHashMapIteratorNext(AnanasHashMapIterator *, AnanasHashMapEntry *);
+
+typedef struct {
+    // NOTE: How many of the items are filled in, only looked at for the tail.
+    UZ used;
+    AnanasValue items[ANANAS_PERSISTENT_WIDTH];
+} AnanasVectorLeaf;
+
+typedef struct {
+    void *children[ANANAS_PERSISTENT_WIDTH];
+} AnanasVectorNode;
+
+// NOTE: The last 1 to 32 items live in the tail instead of the trie, so pushing only touches
+// the trie once every 32 items.
+struct AnanasVector {
+    UZ count;
+    U32 shift;
+    AnanasVectorNode *root;
+    AnanasVectorLeaf *tail;
+};
+
+AnanasVector *AnanasVectorEmpty(HeliosAllocator);
+AnanasValue AnanasVectorGet(AnanasVector *, UZ index);
+AnanasVector *AnanasVectorSet(HeliosAllocator, AnanasVector *, UZ index, AnanasValue value);
+AnanasVector *AnanasVectorPush(HeliosAllocator, AnanasVector *, AnanasValue value);
+
+#endif // ANANAS_PERSISTENT_H_
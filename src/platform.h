@@ -7,4 +7,58 @@ B32 AnanasPlatformGetLine(HeliosAllocator, U8 **, UZ *);
 
 void *AnanasPlatformAllocPages(UZ);
 
+U64 AnanasPlatformNanoTime(void);
+
+// NOTE: A writable mapping is private, writes to it never reach the file.
+B32 AnanasPlatformMapFile(HeliosStringView path, B32 writable, U8 **out_data, UZ *out_count);
+
+void AnanasPlatformUnmapFile(U8 *data, UZ count);
+
+// NOTE: Writes into a temporary file first and renames it over `path`, so readers never
+// observe a partially written file.
+B32 AnanasPlatformWriteEntireFile(HeliosStringView path, U8 *data, UZ count);
+
+// NOTE: An open file, pipe or console. The handle is a file descriptor on POSIX and a
+// `HANDLE` on Windows.
+typedef struct {
+    UZ handle;
+} AnanasPlatformFile;
+
+B32 AnanasPlatformOpenFile(HeliosStringView path, AnanasPlatformFile *out_file);
+
+// NOTE: Opens `path` for writing, creating it if needed and truncating it otherwise. An
+// existing file keeps its permissions and a symlink is written through.
+B32 AnanasPlatformCreateFile(HeliosStringView path, AnanasPlatformFile *out_file);
+
+AnanasPlatformFile AnanasPlatformStdin(void);
+
+// NOTE: Reads whatever is available, up to `capacity` bytes. A count of 0 means the end of the file.
+B32 AnanasPlatformReadFile(AnanasPlatformFile file, U8 *buffer, UZ capacity, UZ *out_count);
+
+void AnanasPlatformCloseFile(AnanasPlatformFile file);
+
+AnanasPlatformFile AnanasPlatformStdout(void);
+
+B32 AnanasPlatformFileIsTerminal(AnanasPlatformFile file);
+
+// NOTE: Writes all of the views one after another, with a single system call where the
+// platform allows it. Short writes are retried until everything is out.
+B32 AnanasPlatformWriteFileGather(AnanasPlatformFile file, HeliosStringView *views, UZ views_count);
+
+typedef void (*AnanasPlatformThreadProc)(void *arg);
+
+// NOTE: The handle is a `pthread_t` on POSIX and a `HANDLE` on Windows. The thread keeps a
+// pointer to this struct, so it has to stay in place until the thread is joined.
+typedef struct {
+    UZ handle;
+    AnanasPlatformThreadProc proc;
+    void *arg;
+} AnanasPlatformThread;
+
+B32 AnanasPlatformThreadStart(AnanasPlatformThread *thread, AnanasPlatformThreadProc proc, void *arg);
+
+void AnanasPlatformThreadJoin(AnanasPlatformThread *thread);
+
+U32 AnanasPlatformCoreCount(void);
+
 #endif // ANANAS_PLATFORM_H_
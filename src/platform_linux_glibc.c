@@ -1,5 +1,11 @@
 #include "platform.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+
 B32 AnanasPlatformGetLine(HeliosAllocator allocator, U8 **out_buffer, UZ *out_count) {
     B32 result = 1;
 
@@ -23,3 +29,197 @@ defer:
 void *AnanasPlatformAllocPages(UZ size) {
     return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
 }
+
+U64 AnanasPlatformNanoTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64)ts.tv_sec * 1000000000ull + (U64)ts.tv_nsec;
+}
+
+B32 AnanasPlatformMapFile(HeliosStringView path, B32 writable, U8 **out_data, UZ *out_count) {
+    char *path_cstr = HeliosStringViewCloneToCStr(HeliosGetTempAllocator(), path);
+
+    int fd = open(path_cstr, O_RDONLY);
+    if (fd == -1) return 0;
+
+    B32 result = 0;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) goto defer;
+
+    *out_count = file_stat.st_size;
+    if (*out_count == 0) {
+        *out_data = NULL;
+        result = 1;
+        goto defer;
+    }
+
+    // NOTE: Every caller goes through the whole file front to back right away, so the pages
+    // are faulted in up front and the kernel is told to read ahead aggressively.
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *data = mmap(NULL, *out_count, prot, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (data == MAP_FAILED) goto defer;
+
+    madvise(data, *out_count, MADV_SEQUENTIAL);
+
+    *out_data = data;
+    result = 1;
+
+defer:
+    close(fd);
+    return result;
+}
+
+void AnanasPlatformUnmapFile(U8 *data, UZ count) {
+    if (data != NULL) munmap(data, count);
+}
+
+B32 AnanasPlatformWriteEntireFile(HeliosStringView path, U8 *data, UZ count) {
+    HeliosAllocator temp = HeliosGetTempAllocator();
+    char *path_cstr = HeliosStringViewCloneToCStr(temp, path);
+
+    // NOTE: The temporary file gets a unique name next to `path`, so that concurrent writers
+    // of the same file never share it and the rename stays on one file system.
+    UZ tmp_path_count = path.count + sizeof(".XXXXXX");
+    char *tmp_path_cstr = HeliosAlloc(temp, tmp_path_count);
+    snprintf(tmp_path_cstr, tmp_path_count, "%s.XXXXXX", path_cstr);
+
+    int fd = mkstemp(tmp_path_cstr);
+    if (fd == -1) return 0;
+
+    // NOTE: mkstemp creates the file readable only by its owner.
+    if (fchmod(fd, 0644) == -1) {
+        close(fd);
+        unlink(tmp_path_cstr);
+        return 0;
+    }
+
+    UZ written = 0;
+    while (written < count) {
+        SZ n = write(fd, data + written, count - written);
+        if (n == -1) {
+            close(fd);
+            unlink(tmp_path_cstr);
+            return 0;
+        }
+        written += n;
+    }
+
+    if (close(fd) == -1 || rename(tmp_path_cstr, path_cstr) == -1) {
+        unlink(tmp_path_cstr);
+        return 0;
+    }
+
+    return 1;
+}
+
+B32 AnanasPlatformOpenFile(HeliosStringView path, AnanasPlatformFile *out_file) {
+    char *path_cstr = HeliosStringViewCloneToCStr(HeliosGetTempAllocator(), path);
+
+    int fd = open(path_cstr, O_RDONLY);
+    if (fd == -1) return 0;
+
+    out_file->handle = (UZ)fd;
+    return 1;
+}
+
+B32 AnanasPlatformCreateFile(HeliosStringView path, AnanasPlatformFile *out_file) {
+    char *path_cstr = HeliosStringViewCloneToCStr(HeliosGetTempAllocator(), path);
+
+    int fd = open(path_cstr, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) return 0;
+
+    out_file->handle = (UZ)fd;
+    return 1;
+}
+
+AnanasPlatformFile AnanasPlatformStdin(void) {
+    return (AnanasPlatformFile) {.handle = STDIN_FILENO};
+}
+
+B32 AnanasPlatformReadFile(AnanasPlatformFile file, U8 *buffer, UZ capacity, UZ *out_count) {
+    while (1) {
+        SZ n = read((int)file.handle, buffer, capacity);
+        if (n >= 0) {
+            *out_count = (UZ)n;
+            return 1;
+        }
+
+        if (errno != EINTR) return 0;
+    }
+}
+
+void AnanasPlatformCloseFile(AnanasPlatformFile file) {
+    close((int)file.handle);
+}
+
+AnanasPlatformFile AnanasPlatformStdout(void) {
+    return (AnanasPlatformFile) {.handle = STDOUT_FILENO};
+}
+
+B32 AnanasPlatformFileIsTerminal(AnanasPlatformFile file) {
+    return isatty((int)file.handle);
+}
+
+#define ANANAS_PLATFORM_MAX_GATHER_VIEWS 16
+
+B32 AnanasPlatformWriteFileGather(AnanasPlatformFile file, HeliosStringView *views, UZ views_count) {
+    HELIOS_VERIFY(views_count <= ANANAS_PLATFORM_MAX_GATHER_VIEWS);
+
+    struct iovec iov[ANANAS_PLATFORM_MAX_GATHER_VIEWS];
+    UZ iov_count = 0;
+    for (UZ i = 0; i < views_count; ++i) {
+        if (views[i].count == 0) continue;
+        iov[iov_count].iov_base = (void *)views[i].data;
+        iov[iov_count].iov_len = views[i].count;
+        ++iov_count;
+    }
+
+    struct iovec *pending = iov;
+    while (iov_count > 0) {
+        SZ n = writev((int)file.handle, pending, (int)iov_count);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+
+        while (iov_count > 0 && (UZ)n >= pending->iov_len) {
+            n -= pending->iov_len;
+            ++pending;
+            --iov_count;
+        }
+
+        if (iov_count > 0) {
+            pending->iov_base = (U8 *)pending->iov_base + n;
+            pending->iov_len -= n;
+        }
+    }
+
+    return 1;
+}
+
+static void *AnanasPlatformThreadEntry(void *arg) {
+    AnanasPlatformThread *thread = arg;
+    thread->proc(thread->arg);
+    return NULL;
+}
+
+B32 AnanasPlatformThreadStart(AnanasPlatformThread *thread, AnanasPlatformThreadProc proc, void *arg) {
+    thread->proc = proc;
+    thread->arg = arg;
+
+    pthread_t handle;
+    if (pthread_create(&handle, NULL, AnanasPlatformThreadEntry, thread) != 0) return 0;
+
+    thread->handle = (UZ)handle;
+    return 1;
+}
+
+void AnanasPlatformThreadJoin(AnanasPlatformThread *thread) {
+    pthread_join((pthread_t)thread->handle, NULL);
+}
+
+U32 AnanasPlatformCoreCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count < 1 ? 1 : (U32)count;
+}
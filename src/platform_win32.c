@@ -23,3 +23,192 @@ B32 AnanasPlatformGetLine(HeliosAllocator allocator, U8 **out_buffer, UZ *out_co
 void *AnanasPlatformAllocPages(UZ size) {
     return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
 }
+
+U64 AnanasPlatformNanoTime(void) {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (U64)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+}
+
+B32 AnanasPlatformMapFile(HeliosStringView path, B32 writable, U8 **out_data, UZ *out_count) {
+    char *path_cstr = HeliosStringViewCloneToCStr(HeliosGetTempAllocator(), path);
+
+    HANDLE file = CreateFileA(path_cstr, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    B32 result = 0;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) goto defer;
+
+    *out_count = (UZ)size.QuadPart;
+    if (*out_count == 0) {
+        *out_data = NULL;
+        result = 1;
+        goto defer;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) goto defer;
+
+    void *data = MapViewOfFile(mapping, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL) goto defer;
+
+    *out_data = data;
+    result = 1;
+
+defer:
+    CloseHandle(file);
+    return result;
+}
+
+void AnanasPlatformUnmapFile(U8 *data, UZ count) {
+    HELIOS_UNUSED(count);
+    if (data != NULL) UnmapViewOfFile(data);
+}
+
+B32 AnanasPlatformWriteEntireFile(HeliosStringView path, U8 *data, UZ count) {
+    HeliosAllocator temp = HeliosGetTempAllocator();
+    char *path_cstr = HeliosStringViewCloneToCStr(temp, path);
+
+    // NOTE: The temporary file gets a unique name next to `path`, so that concurrent writers
+    // of the same file never share it.
+    static volatile LONG tmp_counter = 0;
+    UZ tmp_path_count = path.count + 32;
+    char *tmp_path_cstr = HeliosAlloc(temp, tmp_path_count);
+
+    HANDLE file = INVALID_HANDLE_VALUE;
+    for (int attempt = 0; attempt < 16 && file == INVALID_HANDLE_VALUE; ++attempt) {
+        StringCchPrintfA(tmp_path_cstr,
+                         tmp_path_count,
+                         "%s.%lu.%ld.tmp",
+                         path_cstr,
+                         GetCurrentProcessId(),
+                         InterlockedIncrement(&tmp_counter));
+        file = CreateFileA(tmp_path_cstr, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE && GetLastError() != ERROR_FILE_EXISTS) return 0;
+    }
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    UZ written = 0;
+    while (written < count) {
+        DWORD chunk = (DWORD)HELIOS_MIN(count - written, (UZ)1 << 30);
+        DWORD n = 0;
+        if (!WriteFile(file, data + written, chunk, &n, NULL)) {
+            CloseHandle(file);
+            DeleteFileA(tmp_path_cstr);
+            return 0;
+        }
+        written += n;
+    }
+
+    CloseHandle(file);
+
+    if (!MoveFileExA(tmp_path_cstr, path_cstr, MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(tmp_path_cstr);
+        return 0;
+    }
+
+    return 1;
+}
+
+B32 AnanasPlatformOpenFile(HeliosStringView path, AnanasPlatformFile *out_file) {
+    char *path_cstr = HeliosStringViewCloneToCStr(HeliosGetTempAllocator(), path);
+
+    HANDLE file = CreateFileA(path_cstr, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    out_file->handle = (UZ)file;
+    return 1;
+}
+
+B32 AnanasPlatformCreateFile(HeliosStringView path, AnanasPlatformFile *out_file) {
+    char *path_cstr = HeliosStringViewCloneToCStr(HeliosGetTempAllocator(), path);
+
+    // NOTE: CREATE_ALWAYS would reset the attributes of an existing file, so it is opened as
+    // is and truncated instead.
+    HANDLE file = CreateFileA(path_cstr, GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    if (!SetEndOfFile(file)) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    out_file->handle = (UZ)file;
+    return 1;
+}
+
+AnanasPlatformFile AnanasPlatformStdin(void) {
+    return (AnanasPlatformFile) {.handle = (UZ)GetStdHandle(STD_INPUT_HANDLE)};
+}
+
+B32 AnanasPlatformReadFile(AnanasPlatformFile file, U8 *buffer, UZ capacity, UZ *out_count) {
+    DWORD n = 0;
+    if (!ReadFile((HANDLE)file.handle, buffer, (DWORD)HELIOS_MIN(capacity, (UZ)1 << 30), &n, NULL)) {
+        // NOTE: The writing end of a pipe was closed, that is the end of the input.
+        if (GetLastError() != ERROR_BROKEN_PIPE) return 0;
+        n = 0;
+    }
+
+    *out_count = n;
+    return 1;
+}
+
+void AnanasPlatformCloseFile(AnanasPlatformFile file) {
+    CloseHandle((HANDLE)file.handle);
+}
+
+AnanasPlatformFile AnanasPlatformStdout(void) {
+    return (AnanasPlatformFile) {.handle = (UZ)GetStdHandle(STD_OUTPUT_HANDLE)};
+}
+
+B32 AnanasPlatformFileIsTerminal(AnanasPlatformFile file) {
+    DWORD mode;
+    return GetConsoleMode((HANDLE)file.handle, &mode) != 0;
+}
+
+// NOTE: There is no gathering write for ordinary handles, the views go out one by one.
+B32 AnanasPlatformWriteFileGather(AnanasPlatformFile file, HeliosStringView *views, UZ views_count) {
+    for (UZ i = 0; i < views_count; ++i) {
+        UZ written = 0;
+        while (written < views[i].count) {
+            DWORD chunk = (DWORD)HELIOS_MIN(views[i].count - written, (UZ)1 << 30);
+            DWORD n = 0;
+            if (!WriteFile((HANDLE)file.handle, views[i].data + written, chunk, &n, NULL)) return 0;
+            written += n;
+        }
+    }
+
+    return 1;
+}
+
+static DWORD WINAPI AnanasPlatformThreadEntry(LPVOID arg) {
+    AnanasPlatformThread *thread = arg;
+    thread->proc(thread->arg);
+    return 0;
+}
+
+B32 AnanasPlatformThreadStart(AnanasPlatformThread *thread, AnanasPlatformThreadProc proc, void *arg) {
+    thread->proc = proc;
+    thread->arg = arg;
+
+    HANDLE handle = CreateThread(NULL, 0, AnanasPlatformThreadEntry, thread, 0, NULL);
+    if (handle == NULL) return 0;
+
+    thread->handle = (UZ)handle;
+    return 1;
+}
+
+void AnanasPlatformThreadJoin(AnanasPlatformThread *thread) {
+    WaitForSingleObject((HANDLE)thread->handle, INFINITE);
+    CloseHandle((HANDLE)thread->handle);
+}
+
+U32 AnanasPlatformCoreCount(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors < 1 ? 1 : (U32)info.dwNumberOfProcessors;
+}
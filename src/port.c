@@ -0,0 +1,80 @@
+#include "port.h"
+
+#include <signal.h>
+
+#define ANANAS_STDOUT_BUFFER_SIZE (64 * 1024)
+
+void AnanasOutputPortInit(AnanasOutputPort *port, AnanasPlatformFile file, HeliosAllocator allocator, UZ capacity) {
+    port->file = file;
+    port->buffer = HeliosAlloc(allocator, capacity);
+    port->capacity = capacity;
+    port->count = 0;
+    port->line_buffered = AnanasPlatformFileIsTerminal(file);
+}
+
+B32 AnanasOutputPortFlush(AnanasOutputPort *port) {
+    if (port->count == 0) return 1;
+
+    HeliosStringView pending = {.data = port->buffer, .count = port->count};
+    port->count = 0;
+    return AnanasPlatformWriteFileGather(port->file, &pending, 1);
+}
+
+B32 AnanasOutputPortWrite(AnanasOutputPort *port, HeliosStringView data) {
+    if (data.count > port->capacity - port->count) {
+        HeliosStringView views[2] = {
+            {.data = port->buffer, .count = port->count},
+            data,
+        };
+        port->count = 0;
+
+        // NOTE: Whatever is too big to buffer goes out right away, along with the buffer.
+        if (data.count >= port->capacity) return AnanasPlatformWriteFileGather(port->file, views, 2);
+        if (!AnanasPlatformWriteFileGather(port->file, views, 1)) return 0;
+    }
+
+    memcpy(port->buffer + port->count, data.data, data.count);
+    port->count += data.count;
+
+    if (port->line_buffered) return AnanasOutputPortFlush(port);
+    return 1;
+}
+
+U8 *AnanasOutputPortReserve(AnanasOutputPort *port, UZ count) {
+    if (count > port->capacity) return NULL;
+    if (count > port->capacity - port->count && !AnanasOutputPortFlush(port)) return NULL;
+
+    return port->buffer + port->count;
+}
+
+void AnanasOutputPortCommit(AnanasOutputPort *port, UZ count) {
+    HELIOS_ASSERT(count <= port->capacity - port->count);
+    port->count += count;
+
+    if (port->line_buffered) AnanasOutputPortFlush(port);
+}
+
+static AnanasOutputPort ananas_stdout;
+static B32 ananas_stdout_initialized;
+
+static void AnanasStdoutFlushAtExit(void) {
+    AnanasOutputPortFlush(&ananas_stdout);
+}
+
+// NOTE: Failed verifications and panics abort, which skips `atexit`. Whatever was printed
+// before that still comes out, the default action runs once the handler returns.
+static void AnanasStdoutFlushOnAbort(int signal_number) {
+    HELIOS_UNUSED(signal_number);
+    AnanasOutputPortFlush(&ananas_stdout);
+}
+
+AnanasOutputPort *AnanasStdout(void) {
+    if (!ananas_stdout_initialized) {
+        AnanasOutputPortInit(&ananas_stdout, AnanasPlatformStdout(), HeliosNewMallocAllocator(), ANANAS_STDOUT_BUFFER_SIZE);
+        atexit(AnanasStdoutFlushAtExit);
+        signal(SIGABRT, AnanasStdoutFlushOnAbort);
+        ananas_stdout_initialized = 1;
+    }
+
+    return &ananas_stdout;
+}
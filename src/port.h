@@ -0,0 +1,33 @@
+#ifndef ANANAS_PORT_H_
+#define ANANAS_PORT_H_
+
+#include "platform.h"
+
+// NOTE: A buffered writer over a platform file. Small writes are gathered in the buffer,
+// a write that does not fit goes out together with the buffered bytes in a single gathering
+// write instead of being copied. A port over a terminal is flushed after every write.
+typedef struct {
+    AnanasPlatformFile file;
+    U8 *buffer;
+    UZ capacity;
+    UZ count;
+    B32 line_buffered;
+} AnanasOutputPort;
+
+void AnanasOutputPortInit(AnanasOutputPort *port, AnanasPlatformFile file, HeliosAllocator allocator, UZ capacity);
+
+B32 AnanasOutputPortWrite(AnanasOutputPort *port, HeliosStringView data);
+
+// NOTE: Returns room for `count` bytes in the buffer, flushing it first if needed, or NULL
+// when `count` is more than the whole buffer holds. The bytes are written with `AnanasOutputPortCommit`.
+U8 *AnanasOutputPortReserve(AnanasOutputPort *port, UZ count);
+
+void AnanasOutputPortCommit(AnanasOutputPort *port, UZ count);
+
+B32 AnanasOutputPortFlush(AnanasOutputPort *port);
+
+// NOTE: The port every print goes through. It is flushed when the process exits or aborts, anything
+// written to `stdout` through stdio in between has to flush this port first.
+AnanasOutputPort *AnanasStdout(void);
+
+#endif // ANANAS_PORT_H_
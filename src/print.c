@@ -1,86 +1,210 @@
 #include "print.h"
+#include "port.h"
+#include "persistent.h"
 
-HeliosStringView AnanasPrint(HeliosAllocator allocator, AnanasValue node) {
-    switch (node.type) {
-    case AnanasValueType_Int: {
-        int required_bytes = snprintf(NULL, 0, HELIOS_UZ_FMT, node.u.integer);
-        U8 *buffer = HeliosAlloc(allocator, required_bytes + 1);
-        sprintf((char *)buffer, HELIOS_UZ_FMT, node.u.integer);
-        return (HeliosStringView) {.data = buffer, .count = required_bytes};
+// NOTE: Enough for the digits of any S64 and its sign.
+#define ANANAS_PRINT_INT_MAX_COUNT 20
+
+static UZ AnanasFormatInt(U8 *buffer, S64 integer) {
+    U64 magnitude = integer < 0 ? (U64)0 - (U64)integer : (U64)integer;
+
+    U8 digits[ANANAS_PRINT_INT_MAX_COUNT];
+    UZ digits_count = 0;
+    do {
+        digits[digits_count++] = '0' + (U8)(magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    UZ count = 0;
+    if (integer < 0) buffer[count++] = '-';
+    while (digits_count > 0) buffer[count++] = digits[--digits_count];
+
+    return count;
+}
+
+static UZ AnanasPrintedIntCount(S64 integer) {
+    U64 magnitude = integer < 0 ? (U64)0 - (U64)integer : (U64)integer;
+
+    UZ count = integer < 0 ? 2 : 1;
+    while (magnitude >= 10) {
+        magnitude /= 10;
+        ++count;
     }
-    case AnanasValueType_String: {
-        int required_bytes = snprintf(NULL, 0, "\"" HELIOS_SV_FMT "\"", HELIOS_SV_ARG(node.u.string));
-        U8 *buffer = HeliosAlloc(allocator, required_bytes + 1);
-        sprintf((char *)buffer, "\"" HELIOS_SV_FMT "\"", HELIOS_SV_ARG(node.u.string));
-        return (HeliosStringView) {.data = buffer, .count = required_bytes};
 
+    return count;
+}
+
+UZ AnanasPrintedCount(AnanasValue value) {
+    switch (value.type) {
+    case AnanasValueType_Int: return AnanasPrintedIntCount(value.u.integer);
+    case AnanasValueType_String: return value.u.string.count + 2;
+    case AnanasValueType_StringBuilder: return value.u.string_builder->string.count + 2;
+    case AnanasValueType_Bool: return value.u.boolean ? 4 : 5;
+    case AnanasValueType_Symbol: return value.u.symbol.count;
+    case AnanasValueType_Macro: return sizeof("<macro>") - 1;
+    case AnanasValueType_Function: return sizeof("<function>") - 1;
+    case AnanasValueType_Table: return sizeof("<table>") - 1;
+    case AnanasValueType_List: {
+        UZ count = 2;
+        for (AnanasList *list = value.u.list; list != NULL; list = list->cdr) {
+            count += AnanasPrintedCount(list->car);
+            if (list->cdr != NULL) ++count;
+        }
+        return count;
+    }
+    case AnanasValueType_Vector: {
+        AnanasVector *vector = value.u.vector;
+        UZ count = vector->count > 0 ? vector->count + 1 : 2;
+        for (UZ i = 0; i < vector->count; ++i) count += AnanasPrintedCount(AnanasVectorGet(vector, i));
+        return count;
+    }
+    case AnanasValueType_HashMap: {
+        AnanasHashMap *map = value.u.hash_map;
+        UZ count = map->count > 0 ? map->count * 2 + 1 : 2;
+
+        AnanasHashMapIterator it;
+        AnanasHashMapIteratorInit(&it, map);
+
+        AnanasHashMapEntry entry;
+        while (AnanasHashMapIteratorNext(&it, &entry)) {
+            count += AnanasPrintedCount(entry.key) + AnanasPrintedCount(entry.value);
+        }
+        return count;
+    }
+    }
+
+    HELIOS_UNREACHABLE();
+}
+
+// NOTE: The caller makes sure there is room for `AnanasPrintedCount(value)` more bytes.
+static U8 *AnanasPrintUnchecked(U8 *out, AnanasValue value) {
+    switch (value.type) {
+    case AnanasValueType_Int: return out + AnanasFormatInt(out, value.u.integer);
+    case AnanasValueType_StringBuilder: return AnanasPrintUnchecked(out, AnanasValueFlatten(value));
+    case AnanasValueType_String: {
+        *out++ = '"';
+        memcpy(out, value.u.string.data, value.u.string.count);
+        out += value.u.string.count;
+        *out++ = '"';
+        return out;
     }
     case AnanasValueType_Bool: {
-        if (node.u.boolean) {
-            return HELIOS_SV_LIT("true");
-        } else {
-            return HELIOS_SV_LIT("false");
-        }
+        HeliosStringView name = value.u.boolean ? HELIOS_SV_LIT("true") : HELIOS_SV_LIT("false");
+        memcpy(out, name.data, name.count);
+        return out + name.count;
     }
     case AnanasValueType_Symbol: {
-        int required_bytes = snprintf(NULL, 0, HELIOS_SV_FMT, HELIOS_SV_ARG(node.u.symbol));
-        U8 *buffer = HeliosAlloc(allocator, required_bytes + 1);
-        sprintf((char *)buffer, HELIOS_SV_FMT, HELIOS_SV_ARG(node.u.symbol));
-        return (HeliosStringView) {.data = buffer, .count = required_bytes};
+        memcpy(out, value.u.symbol.data, value.u.symbol.count);
+        return out + value.u.symbol.count;
     }
     case AnanasValueType_Macro: {
-        return HELIOS_SV_LIT("<macro>");
+        memcpy(out, "<macro>", sizeof("<macro>") - 1);
+        return out + sizeof("<macro>") - 1;
     }
     case AnanasValueType_Function: {
-        /* int required_bytes = snprintf(NULL, 0, "", HELIOS_SV_ARG(node.u.symbol)); */
-        /* U8 *buffer = HeliosAlloc(allocator, required_bytes + 1); */
-        /* sprintf((char *)buffer, HELIOS_SV_FMT, HELIOS_SV_ARG(node.u.symbol)); */
-        /* return (HeliosStringView) {.data = buffer, .count = required_bytes}; */
-        return HELIOS_SV_LIT("<function>");
+        memcpy(out, "<function>", sizeof("<function>") - 1);
+        return out + sizeof("<function>") - 1;
+    }
+    case AnanasValueType_Table: {
+        memcpy(out, "<table>", sizeof("<table>") - 1);
+        return out + sizeof("<table>") - 1;
     }
     case AnanasValueType_List: {
-        UZ buffer_cap = 32;
-        U8 *buffer = HeliosAlloc(allocator, buffer_cap);
-
-        buffer[0] = '(';
-
-        UZ offset = 1;
-
-        AnanasList *list = node.u.list;
-        while (list != NULL) {
-            HeliosStringView car = AnanasPrint(allocator, list->car);
-            UZ bytes_needed = car.count + offset + 1;
-            if (bytes_needed >= buffer_cap) {
-                UZ new_buffer_cap = bytes_needed > buffer_cap * 2 ? bytes_needed : buffer_cap * 2;
-                buffer = HeliosRealloc(allocator, buffer, buffer_cap, new_buffer_cap);
-                buffer_cap = new_buffer_cap;
-            }
-
-            for (UZ i = 0; i < car.count; ++i) {
-                buffer[i + offset] = car.data[i];
-            }
-
-            if (list->cdr != NULL) {
-                buffer[car.count + offset] = ' ';
-                offset += car.count + 1;
-            } else {
-                offset += car.count;
-            }
-
-            list = list->cdr;
+        *out++ = '(';
+        for (AnanasList *list = value.u.list; list != NULL; list = list->cdr) {
+            out = AnanasPrintUnchecked(out, list->car);
+            if (list->cdr != NULL) *out++ = ' ';
+        }
+        *out++ = ')';
+        return out;
+    }
+    case AnanasValueType_Vector: {
+        AnanasVector *vector = value.u.vector;
+        *out++ = '[';
+        for (UZ i = 0; i < vector->count; ++i) {
+            if (i > 0) *out++ = ' ';
+            out = AnanasPrintUnchecked(out, AnanasVectorGet(vector, i));
+        }
+        *out++ = ']';
+        return out;
+    }
+    case AnanasValueType_HashMap: {
+        AnanasHashMapIterator it;
+        AnanasHashMapIteratorInit(&it, value.u.hash_map);
+
+        *out++ = '{';
+        AnanasHashMapEntry entry;
+        for (B32 first = 1; AnanasHashMapIteratorNext(&it, &entry); first = 0) {
+            if (!first) *out++ = ' ';
+            out = AnanasPrintUnchecked(out, entry.key);
+            *out++ = ' ';
+            out = AnanasPrintUnchecked(out, entry.value);
         }
+        *out++ = '}';
+        return out;
+    }
+    }
+
+    HELIOS_UNREACHABLE();
+}
 
-        HELIOS_VERIFY(offset < buffer_cap);
+void AnanasPrintInto(HeliosString8 *out, AnanasValue value) {
+    UZ count = AnanasPrintedCount(value);
+    HeliosString8GrowIfNeeded(out, out->count + count);
 
-        buffer[offset] = ')';
+    U8 *end = AnanasPrintUnchecked(out->data + out->count, value);
+    HELIOS_ASSERT((UZ)(end - out->data) == out->count + count);
+    out->count += count;
+}
 
-        return (HeliosStringView) {.data = buffer, .count = offset + 1};
-    }
+void AnanasPrintIntInto(HeliosString8 *out, S64 integer) {
+    HeliosString8GrowIfNeeded(out, out->count + ANANAS_PRINT_INT_MAX_COUNT);
+    out->count += AnanasFormatInt(out->data + out->count, integer);
+}
+
+// NOTE: The size of the output is worked out up front, so the whole value is printed into
+// a single allocation of exactly the right size.
+HeliosStringView AnanasPrint(HeliosAllocator allocator, AnanasValue value) {
+    switch (value.type) {
+    case AnanasValueType_Bool: return value.u.boolean ? HELIOS_SV_LIT("true") : HELIOS_SV_LIT("false");
+    case AnanasValueType_Macro: return HELIOS_SV_LIT("<macro>");
+    case AnanasValueType_Function: return HELIOS_SV_LIT("<function>");
+    case AnanasValueType_Table: return HELIOS_SV_LIT("<table>");
+    default: break;
     }
+
+    UZ count = AnanasPrintedCount(value);
+    U8 *buffer = HeliosAlloc(allocator, count);
+
+    U8 *end = AnanasPrintUnchecked(buffer, value);
+    HELIOS_ASSERT((UZ)(end - buffer) == count);
+
+    return (HeliosStringView) {.data = buffer, .count = count};
 }
 
+// NOTE: Lines are printed straight into the buffer of the stdout port, only a line that is
+// bigger than the whole port buffer is printed into a separate one first.
+static HeliosString8 ananas_print_stdout_buffer;
+
 void AnanasPrintStdout(AnanasValue value) {
-    HeliosAllocator temp = HeliosGetTempAllocator();
-    HeliosStringView string = AnanasPrint(temp, value);
-    printf(HELIOS_SV_FMT "\n", HELIOS_SV_ARG(string));
+    AnanasOutputPort *out = AnanasStdout();
+
+    UZ count = AnanasPrintedCount(value) + 1;
+    U8 *line = AnanasOutputPortReserve(out, count);
+    if (line != NULL) {
+        U8 *end = AnanasPrintUnchecked(line, value);
+        *end = '\n';
+        AnanasOutputPortCommit(out, count);
+        return;
+    }
+
+    HeliosString8 *buffer = &ananas_print_stdout_buffer;
+    if (buffer->allocator.vtable.alloc == NULL) buffer->allocator = HeliosNewMallocAllocator();
+
+    buffer->count = 0;
+    AnanasPrintInto(buffer, value);
+    HeliosString8GrowIfNeeded(buffer, buffer->count + 1);
+    buffer->data[buffer->count++] = '\n';
+
+    AnanasOutputPortWrite(out, HeliosString8View(*buffer));
 }
@@ -4,6 +4,14 @@
 #include "helios.h"
 #include "read.h"
 
+// NOTE: The exact number of bytes `AnanasPrint` produces for `value`.
+UZ AnanasPrintedCount(AnanasValue value);
+
+// NOTE: Appends the printed form of `value` to `out`, growing it at most once.
+void AnanasPrintInto(HeliosString8 *out, AnanasValue value);
+
+void AnanasPrintIntInto(HeliosString8 *out, S64 integer);
+
 HeliosStringView AnanasPrint(HeliosAllocator allocator, AnanasValue value);
 
 void AnanasPrintStdout(AnanasValue value);
@@ -1,5 +1,6 @@
 #include "read.h"
 #include "eval.h"
+#include "platform.h"
 
 static const char *token_type_str_table[] = {
 #define X(t) #t,
@@ -62,9 +63,11 @@ ANANAS_DECLARE_NATIVE_MACRO(AnanasUnquoteSpliceMacro) {
 }
 
 ERMIS_IMPL_HASHMAP(HeliosStringView, AnanasMacro *, AnanasReaderMacroTable, HeliosStringViewEqual, AnanasFnv1Hash)
+ERMIS_IMPL_ARRAY(AnanasReaderFrame, AnanasReaderFrameStack)
 
 void AnanasReaderTableInit(AnanasReaderTable *table, HeliosAllocator allocator) {
     AnanasReaderMacroTableInit(&table->reader_macros, allocator, 30);
+    AnanasReaderFrameStackInit(&table->frames, allocator, 16);
 
 #define X(name, macro_proc) { \
     AnanasMacro *macro = HeliosAlloc(allocator, sizeof(AnanasMacro)); \
@@ -76,100 +79,384 @@ ANANAS_ENUM_READER_MACROS
 #undef X
 }
 
+// NOTE: Nesting lives on the explicit frame stack of the table instead of the C stack, every
+// finished value is handed to the innermost frame until one is left with no frame to take it.
 B32 AnanasReaderNext(AnanasLexer *lexer,
                      AnanasReaderTable *table,
                      HeliosAllocator allocator,
                      AnanasValue *result,
                      AnanasErrorContext *error_ctx) {
-    AnanasToken token;
-    if (!AnanasLexerNext(lexer, allocator, &token)) return 0;
-
-    switch (token.type) {
-    case AnanasTokenType_Int: {
-        HELIOS_ASSERT(HeliosParseS64DetectBase(token.value, &result->u.integer));
-        result->type = AnanasValueType_Int;
-        result->token = token;
-        return 1;
-    }
-    case AnanasTokenType_String: {
-        result->type = AnanasValueType_String;
-        result->u.string = token.value;
-        result->token = token;
-        return 1;
-    }
-    case AnanasTokenType_Symbol: {
-        result->type = AnanasValueType_Symbol;
-        result->u.symbol = token.value;
-        result->token = token;
-        return 1;
-    }
-    case AnanasTokenType_LeftParen: {
-        AnanasList *result_list = NULL;
-        AnanasList *list = result_list;
-        result->token = token;
+    AnanasReaderFrameStack *frames = &table->frames;
+    frames->count = 0;
 
-        while (1) {
-            AnanasLexer prev_lexer = *lexer;
-            HeliosString8Stream prev_contents = *lexer->contents;
-            if (!AnanasLexerNext(lexer, allocator, &token)) {
-                AnanasErrorContextMessage(error_ctx, token.row, token.col + token.value.count, "EOF while expecting ')'");
-                return 0;
+    while (1) {
+        AnanasToken token;
+        if (!AnanasLexerNext(lexer, allocator, &token)) {
+            if (frames->count == 0) return 0;
+
+            AnanasReaderFrame *frame = &frames->items[frames->count - 1];
+            if (frame->reader_macro != NULL) {
+                AnanasErrorContextMessage(error_ctx, frame->token.row, frame->token.col, "EOF while expecting an argument for reader macro");
+            } else {
+                AnanasErrorContextMessage(error_ctx, lexer->row, lexer->col, "EOF while expecting ')'");
             }
+            return 0;
+        }
 
-            if (token.type == AnanasTokenType_RightParen) {
+        AnanasValue value = {0};
+        value.token = token;
+
+        switch (token.type) {
+        case AnanasTokenType_Int: {
+            HELIOS_ASSERT(HeliosParseS64DetectBase(token.value, &value.u.integer));
+            value.type = AnanasValueType_Int;
+            break;
+        }
+        case AnanasTokenType_String: {
+            value.type = AnanasValueType_String;
+            value.u.string = token.value;
+            break;
+        }
+        case AnanasTokenType_Symbol: {
+            value.type = AnanasValueType_Symbol;
+            value.u.symbol = token.value;
+            break;
+        }
+        case AnanasTokenType_LeftParen: {
+            // NOTE: An empty list is finished right away, it never needs a frame.
+            AnanasToken next;
+            if (AnanasLexerPeek(lexer, allocator, &next) && next.type == AnanasTokenType_RightParen) {
+                AnanasLexerNext(lexer, allocator, &next);
+                value.type = AnanasValueType_List;
+                value.u.list = NULL;
                 break;
             }
 
-            *lexer = prev_lexer;
-            *lexer->contents = prev_contents;
+            AnanasReaderFrame frame = {.token = token};
+            AnanasReaderFrameStackPush(frames, frame);
+            continue;
+        }
+        case AnanasTokenType_ReaderMacro: {
+            AnanasMacro *reader_macro = NULL;
 
-            AnanasList *list_car = HeliosAlloc(allocator, sizeof(*list_car));
-            if (!AnanasReaderNext(lexer, table, allocator, &list_car->car, error_ctx)) {
-                HELIOS_ASSERT(!error_ctx->ok);
+            if (!AnanasReaderMacroTableFind(&table->reader_macros, token.value, &reader_macro)) {
+                AnanasErrorContextMessage(error_ctx,
+                                          token.row,
+                                          token.col,
+                                          "undefined reader macro '" HELIOS_SV_FMT "'",
+                                          HELIOS_SV_ARG(token.value));
                 return 0;
             }
 
-            if (result_list == NULL) {
-                result_list = list_car;
-                list = result_list;
-            } else {
-                list->cdr = list_car;
-                list = list->cdr;
+            AnanasReaderFrame frame = {.token = token, .reader_macro = reader_macro};
+            AnanasReaderFrameStackPush(frames, frame);
+            continue;
+        }
+        case AnanasTokenType_RightParen: {
+            if (frames->count > 0 && frames->items[frames->count - 1].reader_macro == NULL) {
+                AnanasReaderFrame frame = frames->items[--frames->count];
+                value.type = AnanasValueType_List;
+                value.token = frame.token;
+                value.u.list = frame.list.head;
+                break;
             }
+        } // fallthrough
+        default: {
+            const char *token_type_str = token_type_str_table[token.type];
+            AnanasErrorContextMessage(error_ctx, token.row, token.col, "unexpected token '%s'", token_type_str);
+            return 0;
         }
+        }
+
+        while (1) {
+            if (frames->count == 0) {
+                *result = value;
+                return 1;
+            }
+
+            AnanasReaderFrame *frame = &frames->items[frames->count - 1];
+
+            if (frame->reader_macro != NULL) {
+                AnanasList *macro_arg = HeliosAlloc(allocator, sizeof(*macro_arg));
+                macro_arg->car = value;
+                macro_arg->cdr = NULL;
 
-        result->type = AnanasValueType_List;
-        result->u.list = result_list;
+                AnanasReaderFrame macro_frame = *frame;
+                --frames->count;
 
-        return 1;
+                if (!AnanasEvalMacroWithArgumentList(macro_frame.reader_macro,
+                                                     macro_frame.token,
+                                                     macro_arg,
+                                                     allocator,
+                                                     error_ctx,
+                                                     &value)) return 0;
+                continue;
+            }
+
+            AnanasListBuilderAppend(&frame->list, allocator, value);
+            break;
+        }
     }
-    case AnanasTokenType_ReaderMacro: {
-        AnanasMacro *reader_macro = NULL;
-
-        if (!AnanasReaderMacroTableFind(&table->reader_macros, token.value, &reader_macro)) {
-            AnanasErrorContextMessage(error_ctx,
-                                      token.row,
-                                      token.col,
-                                      "undefined reader macro '" HELIOS_SV_FMT "'",
-                                      HELIOS_SV_ARG(token.value));
-            return 0;
+}
+
+static B32 AnanasReadFormsFrom(HeliosStringView source,
+                               U32 row,
+                               HeliosAllocator allocator,
+                               AnanasListBuilder *forms,
+                               AnanasErrorContext *error_ctx) {
+    HeliosString8Stream stream;
+    HeliosString8StreamInit(&stream, source.data, source.count);
+
+    AnanasLexer lexer;
+    AnanasLexerInit(&lexer, &stream);
+    lexer.row = row;
+
+    AnanasReaderTable reader_table;
+    AnanasReaderTableInit(&reader_table, allocator);
+
+    AnanasValue value;
+    while (AnanasReaderNext(&lexer, &reader_table, allocator, &value, error_ctx)) {
+        AnanasListBuilderAppend(forms, allocator, value);
+    }
+
+    return error_ctx->ok;
+}
+
+// NOTE: Splitting only pays off once every thread gets a decent amount of work.
+#define ANANAS_PARALLEL_READ_MIN_CHUNK_SIZE (256 * 1024)
+#define ANANAS_PARALLEL_READ_MAX_CHUNKS 64
+
+// NOTE: Every thread allocates from blocks of its own and starts a new block once the current
+// one is full, so nothing has to guess up front how much a chunk needs. Once every chunk is
+// read the forms are copied into the caller's allocator and the blocks are freed.
+#define ANANAS_PARALLEL_READ_BLOCK_SIZE (4 * 1024 * 1024)
+
+typedef struct AnanasReadBlock {
+    struct AnanasReadBlock *prev;
+    UZ capacity;
+    UZ offset;
+    U8 data[];
+} AnanasReadBlock;
+
+typedef struct {
+    HeliosStringView source;
+    U32 row;
+    AnanasReadBlock *blocks;
+    AnanasListBuilder forms;
+    AnanasErrorContext error_ctx;
+    U8 error_buffer[1024];
+    AnanasPlatformThread thread;
+    B32 threaded;
+} AnanasReadChunk;
+
+static void *AnanasReadBlockAlloc(void *data, UZ count) {
+    AnanasReadChunk *chunk = data;
+    AnanasReadBlock *block = chunk->blocks;
+
+    count = AnanasAlignForward(count, sizeof(void *));
+    if (block == NULL || block->capacity - block->offset < count) {
+        UZ capacity = HELIOS_MAX((UZ)ANANAS_PARALLEL_READ_BLOCK_SIZE, count);
+        block = HeliosAlloc(HeliosNewMallocAllocator(), sizeof(*block) + capacity);
+        block->prev = chunk->blocks;
+        block->capacity = capacity;
+        block->offset = 0;
+        chunk->blocks = block;
+    }
+
+    void *ptr = block->data + block->offset;
+    block->offset += count;
+    return memset(ptr, 0, count);
+}
+
+static void AnanasReadBlockFree(void *data, void *ptr, UZ count) {
+    HELIOS_UNUSED(data);
+    HELIOS_UNUSED(ptr);
+    HELIOS_UNUSED(count);
+}
+
+static void AnanasReadChunkFreeBlocks(AnanasReadChunk *chunk) {
+    while (chunk->blocks != NULL) {
+        AnanasReadBlock *block = chunk->blocks;
+        chunk->blocks = block->prev;
+        HeliosFree(HeliosNewMallocAllocator(), block, sizeof(*block) + block->capacity);
+    }
+}
+
+static void AnanasReadChunkProc(void *arg) {
+    AnanasReadChunk *chunk = arg;
+    HeliosAllocator allocator = {
+        .data = chunk,
+        .vtable = {
+            .alloc = AnanasReadBlockAlloc,
+            .free = AnanasReadBlockFree,
+            .realloc = NULL,
+        },
+    };
+
+    AnanasListBuilderInit(&chunk->forms);
+    AnanasReadFormsFrom(chunk->source, chunk->row, allocator, &chunk->forms, &chunk->error_ctx);
+}
+
+// NOTE: Walks the source once, tracking parens, strings and comments, and cuts it at the first
+// newline outside of any form past each of the `chunks_count - 1` evenly spaced targets. A
+// newline right after a reader macro is skipped, the macro needs the form that follows it.
+// Returns how many chunks were actually made.
+static UZ AnanasSplitTopLevelForms(HeliosStringView source, AnanasReadChunk *chunks, UZ chunks_count) {
+    const U8 *data = source.data;
+    UZ target_size = source.count / chunks_count;
+
+    UZ made = 0;
+    UZ chunk_start = 0;
+    U32 chunk_row = 1;
+    UZ next_target = target_size;
+
+    U32 row = 1;
+    SZ depth = 0;
+    B32 after_reader_macro = 0;
+
+    for (UZ i = 0; i < source.count && made + 1 < chunks_count; ++i) {
+        U8 c = data[i];
+
+        switch (c) {
+        case '(': ++depth; after_reader_macro = 0; break;
+        case ')': --depth; after_reader_macro = 0; break;
+        case ' ': case '\t': case '\r': break;
+        case '`': case '@': case ',': case '#': case '~': case '\'': after_reader_macro = 1; break;
+        case '"': {
+            for (++i; i < source.count && data[i] != '"'; ++i) {
+                if (data[i] == '\\') ++i;
+                if (i < source.count && data[i] == '\n') ++row;
+            }
+            after_reader_macro = 0;
+            break;
         }
+        case ';': {
+            const U8 *newline = memchr(data + i, '\n', source.count - i);
+            if (newline == NULL) i = source.count;
+            else i = (newline - data) - 1;
+            break;
+        }
+        case '\n': {
+            ++row;
+            if (depth != 0 || after_reader_macro || i + 1 < next_target) break;
+
+            chunks[made].source = (HeliosStringView) {.data = (U8 *)data + chunk_start, .count = i + 1 - chunk_start};
+            chunks[made].row = chunk_row;
+            ++made;
+
+            chunk_start = i + 1;
+            chunk_row = row;
+            next_target = chunk_start + target_size;
+            break;
+        }
+        default: after_reader_macro = 0; break;
+        }
+    }
+
+    chunks[made].source = (HeliosStringView) {.data = (U8 *)data + chunk_start, .count = source.count - chunk_start};
+    chunks[made].row = chunk_row;
+    return made + 1;
+}
+
+static HeliosStringView AnanasCopyOutsideSource(HeliosStringView sv, HeliosStringView source, HeliosAllocator allocator) {
+    if (sv.count == 0 || (sv.data >= source.data && sv.data < source.data + source.count)) return sv;
+
+    U8 *copy = HeliosAlloc(allocator, sv.count);
+    memcpy(copy, sv.data, sv.count);
+    return (HeliosStringView) {.data = copy, .count = sv.count};
+}
+
+ERMIS_DECL_ARRAY(AnanasValue *, AnanasValueSlotStack)
+ERMIS_IMPL_ARRAY(AnanasValue *, AnanasValueSlotStack)
 
-        AnanasList *macro_arg = HeliosAlloc(allocator, sizeof(*macro_arg));
+// NOTE: Copies the conses of `forms`, and the strings that do not point into `source`, such as
+// unescaped literals, into `allocator`. The values still to be copied are kept on an explicit
+// stack, the same way the reader handles nesting.
+static void AnanasCopyForms(AnanasListBuilder *forms,
+                            AnanasList *chunk_forms,
+                            HeliosStringView source,
+                            HeliosAllocator allocator) {
+    HeliosAllocator scratch = HeliosNewMallocAllocator();
+    AnanasValueSlotStack pending;
+    AnanasValueSlotStackInit(&pending, scratch, 64);
 
-        if (!AnanasReaderNext(lexer, table, allocator, &macro_arg->car, error_ctx)) return 0;
+    for (; chunk_forms != NULL; chunk_forms = chunk_forms->cdr) {
+        AnanasListBuilderAppend(forms, allocator, chunk_forms->car);
+        AnanasValueSlotStackPush(&pending, &forms->tail->car);
 
-        return AnanasEvalMacroWithArgumentList(reader_macro,
-                                               token,
-                                               macro_arg,
-                                               allocator,
-                                               error_ctx,
-                                               result);
+        while (pending.count > 0) {
+            AnanasValue *value = pending.items[--pending.count];
+            value->token.value = AnanasCopyOutsideSource(value->token.value, source, allocator);
+
+            switch (value->type) {
+            case AnanasValueType_String: value->u.string = AnanasCopyOutsideSource(value->u.string, source, allocator); break;
+            case AnanasValueType_Symbol: value->u.symbol = AnanasCopyOutsideSource(value->u.symbol, source, allocator); break;
+            case AnanasValueType_List: {
+                AnanasListBuilder copy;
+                AnanasListBuilderInit(&copy);
+
+                for (AnanasList *list = value->u.list; list != NULL; list = list->cdr) {
+                    AnanasListBuilderAppend(&copy, allocator, list->car);
+                    AnanasValueSlotStackPush(&pending, &copy.tail->car);
+                }
+
+                value->u.list = copy.head;
+                break;
+            }
+            default: break;
+            }
+        }
     }
-    default: {
-        const char *token_type_str = token_type_str_table[token.type];
-        AnanasErrorContextMessage(error_ctx, token.row, token.col, "unexpected token '%s'", token_type_str);
-        return 0;
+
+    HeliosFree(scratch, pending.items, sizeof(*pending.items) * pending.capacity);
+}
+
+B32 AnanasReadAllForms(HeliosStringView source,
+                       HeliosAllocator allocator,
+                       AnanasListBuilder *forms,
+                       AnanasErrorContext *error_ctx) {
+    UZ chunks_count = source.count / ANANAS_PARALLEL_READ_MIN_CHUNK_SIZE;
+    chunks_count = HELIOS_MIN(chunks_count, (UZ)AnanasPlatformCoreCount());
+    chunks_count = HELIOS_MIN(chunks_count, (UZ)ANANAS_PARALLEL_READ_MAX_CHUNKS);
+
+    if (chunks_count <= 1) return AnanasReadFormsFrom(source, 1, allocator, forms, error_ctx);
+
+    AnanasReadChunk *chunks = HeliosAlloc(allocator, sizeof(*chunks) * chunks_count);
+    chunks_count = AnanasSplitTopLevelForms(source, chunks, chunks_count);
+
+    for (UZ i = 0; i < chunks_count; ++i) {
+        AnanasReadChunk *chunk = &chunks[i];
+        chunk->blocks = NULL;
+        AnanasErrorContextInit(&chunk->error_ctx, chunk->error_buffer, sizeof(chunk->error_buffer));
+        chunk->error_ctx.place = error_ctx->place;
+
+        // NOTE: The first chunk is read on the calling thread, and so is any chunk that
+        // did not get a thread of its own.
+        chunk->threaded = i != 0 && AnanasPlatformThreadStart(&chunk->thread, AnanasReadChunkProc, chunk);
+    }
+
+    for (UZ i = 0; i < chunks_count; ++i) {
+        if (!chunks[i].threaded) AnanasReadChunkProc(&chunks[i]);
     }
+
+    for (UZ i = 0; i < chunks_count; ++i) {
+        if (chunks[i].threaded) AnanasPlatformThreadJoin(&chunks[i].thread);
     }
+
+    B32 ok = 1;
+    for (UZ i = 0; i < chunks_count; ++i) {
+        AnanasReadChunk *chunk = &chunks[i];
+
+        if (ok && !chunk->error_ctx.ok) {
+            ok = 0;
+            error_ctx->ok = 0;
+            UZ count = HELIOS_MIN(error_ctx->error_buffer.count, sizeof(chunk->error_buffer));
+            memcpy((U8 *)error_ctx->error_buffer.data, chunk->error_buffer, count);
+        }
+
+        if (ok) AnanasCopyForms(forms, chunk->forms.head, source, allocator);
+        AnanasReadChunkFreeBlocks(chunk);
+    }
+
+    return ok;
 }
@@ -5,8 +5,18 @@
 
 ERMIS_DECL_HASHMAP(HeliosStringView, AnanasMacro *, AnanasReaderMacroTable)
 
+// NOTE: A list that is still being read, or a reader macro waiting for its argument.
+typedef struct {
+    AnanasToken token;
+    AnanasMacro *reader_macro;
+    AnanasListBuilder list;
+} AnanasReaderFrame;
+
+ERMIS_DECL_ARRAY(AnanasReaderFrame, AnanasReaderFrameStack)
+
 typedef struct {
     AnanasReaderMacroTable reader_macros;
+    AnanasReaderFrameStack frames;
 } AnanasReaderTable;
 
 void AnanasReaderTableInit(AnanasReaderTable *, HeliosAllocator);
@@ -17,4 +27,13 @@ B32 AnanasReaderNext(AnanasLexer *lexer,
                      AnanasValue *value,
                      AnanasErrorContext *error_ctx);
 
+// NOTE: Reads every top-level form of `source` and appends them to `forms` in order. Big
+// inputs are split at top-level form boundaries and the pieces are read on several threads,
+// every thread allocating from blocks of its own that are freed once the forms are copied into
+// `allocator`. Strings and symbols of the forms point into `source`, so it has to outlive them.
+B32 AnanasReadAllForms(HeliosStringView source,
+                       HeliosAllocator allocator,
+                       AnanasListBuilder *forms,
+                       AnanasErrorContext *error_ctx);
+
 #endif // ANANAS_READER_H_
@@ -211,8 +211,12 @@ return Peephole(cstate, node); \
     case AnanasValueType_Int: return Peephole(cstate, NewConstantNode(cstate, value.u.integer));
     case AnanasValueType_Function:
     case AnanasValueType_Macro:
+    case AnanasValueType_Table:
+    case AnanasValueType_HashMap:
+    case AnanasValueType_Vector:
     case AnanasValueType_Bool:
-    case AnanasValueType_String: HELIOS_TODO();
+    case AnanasValueType_String:
+    case AnanasValueType_StringBuilder: HELIOS_TODO();
     case AnanasValueType_Symbol: {
         HeliosStringView sym_name = value.u.symbol;
         AnanasSON_NodeType node_type = {0};
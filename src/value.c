@@ -2,6 +2,31 @@
 
 ERMIS_IMPL_ARRAY(AnanasValue, AnanasValueArray)
 
+B32 AnanasValueKeyEqual(AnanasValue lhs, AnanasValue rhs) {
+    if (lhs.type != rhs.type) return 0;
+
+    switch (lhs.type) {
+    case AnanasValueType_String: return HeliosStringViewEqual(lhs.u.string, rhs.u.string);
+    case AnanasValueType_Symbol: return HeliosStringViewEqual(lhs.u.symbol, rhs.u.symbol);
+    case AnanasValueType_Int: return lhs.u.integer == rhs.u.integer;
+    case AnanasValueType_Bool: return lhs.u.boolean == rhs.u.boolean;
+    default: HELIOS_UNREACHABLE();
+    }
+}
+
+U64 AnanasValueKeyHash(AnanasValue key) {
+    switch (key.type) {
+    // NOTE: The type is mixed in so that a string and a symbol with the same name don't collide.
+    case AnanasValueType_String: return AnanasFnv1Hash(key.u.string);
+    case AnanasValueType_Symbol: return AnanasFnv1Hash(key.u.symbol) ^ 0x9E3779B97F4A7C15ull;
+    case AnanasValueType_Int: return (U64)key.u.integer;
+    case AnanasValueType_Bool: return (U64)key.u.boolean;
+    default: HELIOS_UNREACHABLE();
+    }
+}
+
+ERMIS_IMPL_HASHMAP(AnanasValue, AnanasValue, AnanasTableMap, AnanasValueKeyEqual, AnanasValueKeyHash)
+
 ERMIS_DECL_ARRAY(HeliosStringView, AnanasParamsArray)
 ERMIS_IMPL_ARRAY(HeliosStringView, AnanasParamsArray)
 
@@ -13,6 +13,10 @@ typedef enum {
     AnanasValueType_List,
     AnanasValueType_Function,
     AnanasValueType_Macro,
+    AnanasValueType_Table,
+    AnanasValueType_HashMap,
+    AnanasValueType_Vector,
+    AnanasValueType_StringBuilder,
 } AnanasValueType;
 
 struct AnanasList;
@@ -24,6 +28,18 @@ typedef struct AnanasFunction AnanasFunction;
 struct AnanasMacro;
 typedef struct AnanasMacro AnanasMacro;
 
+struct AnanasTable;
+typedef struct AnanasTable AnanasTable;
+
+struct AnanasHashMap;
+typedef struct AnanasHashMap AnanasHashMap;
+
+struct AnanasVector;
+typedef struct AnanasVector AnanasVector;
+
+struct AnanasStringBuilder;
+typedef struct AnanasStringBuilder AnanasStringBuilder;
+
 typedef struct {
     AnanasValueType type;
     AnanasToken token;
@@ -35,41 +51,114 @@ typedef struct {
         AnanasList *list;
         AnanasFunction *function;
         AnanasMacro *macro;
+        AnanasTable *table;
+        AnanasHashMap *hash_map;
+        AnanasVector *vector;
+        AnanasStringBuilder *string_builder;
     } u;
 } AnanasValue;
 
+// NOTE: A string that `concat` returns for long results. Builders appended to one another
+// share a buffer with spare room at its end, a concat whose first argument is the builder
+// that filled the buffer so far appends in place, doubling the buffer when it runs out.
+// Every builder keeps its own view of the buffer, bytes are only ever added past the views,
+// so all of them stay valid. Natives, printing and comparisons see it as a plain string.
+typedef struct {
+    U8 *data;
+    UZ capacity;
+    UZ count;
+} AnanasStringBuffer;
+
+struct AnanasStringBuilder {
+    AnanasStringBuffer *buffer;
+    HeliosStringView string;
+};
+
+static inline AnanasValue AnanasValueFlatten(AnanasValue value) {
+    if (value.type == AnanasValueType_StringBuilder) {
+        HeliosStringView string = value.u.string_builder->string;
+        value.type = AnanasValueType_String;
+        value.u.string = string;
+    }
+
+    return value;
+}
+
+// NOTE: Only strings, symbols, ints and bools can be used as table keys, they are hashed and
+// compared by their contents.
+static inline B32 AnanasValueIsHashable(AnanasValue value) {
+    switch (value.type) {
+    case AnanasValueType_String:
+    case AnanasValueType_Symbol:
+    case AnanasValueType_Int:
+    case AnanasValueType_Bool:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+B32 AnanasValueKeyEqual(AnanasValue, AnanasValue);
+U64 AnanasValueKeyHash(AnanasValue);
+
+ERMIS_DECL_HASHMAP(AnanasValue, AnanasValue, AnanasTableMap)
+
+struct AnanasTable {
+    AnanasTableMap map;
+};
+
 struct AnanasList {
     AnanasValue car;
     struct AnanasList *cdr;
 };
 
+// NOTE: Builds a list front to back, keeping a pointer to the last cons so that appending
+// never walks the list.
+typedef struct {
+    AnanasList *head;
+    AnanasList *tail;
+} AnanasListBuilder;
+
+static inline void AnanasListBuilderInit(AnanasListBuilder *builder) {
+    builder->head = NULL;
+    builder->tail = NULL;
+}
+
+static inline void AnanasListBuilderAppend(AnanasListBuilder *builder, HeliosAllocator allocator, AnanasValue value) {
+    AnanasList *cons = HeliosAlloc(allocator, sizeof(*cons));
+    cons->car = value;
+    cons->cdr = NULL;
+
+    if (builder->tail == NULL) builder->head = cons;
+    else builder->tail->cdr = cons;
+
+    builder->tail = cons;
+}
+
+// NOTE: Links `rest` after the built conses without copying it and returns the whole list.
+static inline AnanasList *AnanasListBuilderFinish(AnanasListBuilder *builder, AnanasList *rest) {
+    if (builder->tail == NULL) return rest;
+
+    builder->tail->cdr = rest;
+    return builder->head;
+}
+
+static inline AnanasValue AnanasListValue(AnanasList *list) {
+    AnanasValue value = {.type = AnanasValueType_List, .u = {.list = list}};
+    return value;
+}
+
 static inline AnanasList *AnanasListCopy(HeliosAllocator arena, AnanasList *list) {
-    AnanasList *out_list = NULL;
-    AnanasList *current_out_list = out_list;
-
-    while (list != NULL) {
-        AnanasList *l = HeliosAlloc(arena, sizeof(*l));
-
-        if (list->car.type == AnanasValueType_List) {
-            AnanasList *list_to_copy = list->car.u.list;
-            l->car.type = AnanasValueType_List;
-            l->car.u.list = AnanasListCopy(arena, list_to_copy);
-        } else {
-            l->car = list->car;
-        }
-
-        if (out_list == NULL) {
-            out_list = l;
-            current_out_list = l;
-        } else {
-            current_out_list->cdr = l;
-            current_out_list = l;
-        }
-
-        list = list->cdr;
+    AnanasListBuilder builder;
+    AnanasListBuilderInit(&builder);
+
+    for (; list != NULL; list = list->cdr) {
+        AnanasValue car = list->car;
+        if (car.type == AnanasValueType_List) car = AnanasListValue(AnanasListCopy(arena, car.u.list));
+        AnanasListBuilderAppend(&builder, arena, car);
     }
 
-    return out_list;
+    return builder.head;
 }
 
 struct AnanasEnv;
@@ -97,7 +186,7 @@ typedef struct {
 
 static inline AnanasValue AnanasArgAt(AnanasArgs args, UZ idx) {
     HELIOS_VERIFY(args.count > idx);
-    return args.values[idx];
+    return AnanasValueFlatten(args.values[idx]);
 }
 
 ERMIS_DECL_ARRAY(AnanasValue, AnanasValueArray)
@@ -170,10 +259,15 @@ struct AnanasFunction {
 
 typedef AnanasNativeFunction AnanasNativeMacro;
 
+ERMIS_DECL_HASHMAP(AnanasList *, AnanasValue, AnanasMacroExpansionMap)
+
 typedef struct {
     AnanasParams params;
     AnanasList *body;
     struct AnanasEnv *enclosing_env;
+    // NOTE: Expansions of this macro keyed by the cons of their call site, made on the first
+    // call the evaluator runs. Not stored in images.
+    AnanasMacroExpansionMap *expansions;
 } AnanasUserMacro;
 
 struct AnanasMacro {
@@ -1,6 +1,8 @@
 #include "vm.h"
+#include "print.h"
 
 ERMIS_IMPL_HASHMAP(HeliosStringView, AnanasVM_Value, AnanasVM_EnvMap, HeliosStringViewEqual, AnanasFnv1Hash)
+ERMIS_IMPL_HASHMAP(HeliosStringView, B32, AnanasVM_NameSet, HeliosStringViewEqual, AnanasFnv1Hash)
 ERMIS_IMPL_ARRAY(AnanasGC_Entity *, AnanasVM_EntityArray)
 
 static void RunStateInit(AnanasVM_RunState *rs,
@@ -13,6 +15,10 @@ static void RunStateInit(AnanasVM_RunState *rs,
     rs->bytecode = bytecode;
     rs->bytecode_count = bytecode_count;
     rs->ip = 0;
+    rs->frame_base = 0;
+    rs->registers = NULL;
+    rs->registers_count = 0;
+    rs->return_register = 0;
 }
 
 #define IS_INT(x) ((x) & 1)
@@ -24,6 +30,20 @@ static void RunStateInit(AnanasVM_RunState *rs,
     TO_INT(_x); \
 })
 
+// NOTE: Stack bounds and the operands of the Int ops are proven by the verifier, so only
+// a checked build keeps verifying them on every op.
+#ifdef ANANAS_VM_CHECKED
+#    define VM_CHECK(cond) HELIOS_VERIFY(cond)
+#else
+#    define VM_CHECK(cond) ((void)0)
+#endif
+
+#define UNCHECKED_INT(x) ({ \
+    AnanasVM_Value _x = (x); \
+    VM_CHECK(IS_INT(_x)); \
+    TO_INT(_x); \
+})
+
 #define IS_ENTITY(x) (!IS_INT((x)))
 #define TO_ENTITY(x) ((AnanasGC_Entity *)(x))
 #define FROM_ENTITY(x) ((AnanasVM_Value)(x))
@@ -33,13 +53,33 @@ static void RunStateInit(AnanasVM_RunState *rs,
     TO_ENTITY(_x); \
 })
 
+// NOTE: Natives pop and release their arguments and push exactly one result.
 typedef B32 (*NativeLambda)(AnanasVM *, UZ);
 
 #define DEFINE_NATIVE_LAMBDA(name) static B32 name(AnanasVM *vm, UZ nargs)
 #define DECLARE_NATIVE_LAMBDA DEFINE_NATIVE_LAMBDA
 
 #define ENUM_NATIVE_LAMBDAS \
-    X("print", AnanasPrint)
+    X("print", AnanasVM_Print) \
+    X("string-length", AnanasVM_StringLength) \
+    X("index-of", AnanasVM_IndexOf) \
+    X("char-at", AnanasVM_CharAt) \
+    X("string->int", AnanasVM_StringToInt) \
+    X("starts-with?", AnanasVM_StartsWith) \
+    X("trim", AnanasVM_Trim) \
+    X("make-table", AnanasVM_MakeTable) \
+    X("table-get", AnanasVM_TableGet) \
+    X("table-set!", AnanasVM_TableSet) \
+    X("table-remove!", AnanasVM_TableRemove) \
+    X("table-count", AnanasVM_TableCount) \
+    X("map", AnanasVM_Map) \
+    X("filter", AnanasVM_Filter) \
+    X("fold", AnanasVM_Fold) \
+    X("for-each", AnanasVM_ForEach)
+
+#define X(name, lam) DECLARE_NATIVE_LAMBDA(lam);
+ENUM_NATIVE_LAMBDAS
+#undef X
 
 typedef struct {
     B32 is_native;
@@ -57,6 +97,7 @@ typedef struct {
 enum {
     LAMBDA_DESCRIPTOR,
     STRING_DESCRIPTOR,
+    TABLE_DESCRIPTOR,
 };
 
 static void Release(AnanasVM *vm, AnanasVM_Value value) {
@@ -73,14 +114,21 @@ static void Release(AnanasVM *vm, AnanasVM_Value value) {
     }
 }
 
+static void Retain(AnanasVM_Value value) {
+    if (IS_ENTITY(value)) {
+        AnanasGC_Entity *e = TO_ENTITY(value);
+        ++e->rc;
+    }
+}
+
 static AnanasVM_Value Pop(AnanasVM *vm) {
-    HELIOS_VERIFY(vm->sp > 0);
+    VM_CHECK(vm->sp > 0);
     AnanasVM_Value value = vm->stack[--vm->sp];
     return value;
 }
 
 static void Push(AnanasVM *vm, AnanasVM_Value value) {
-    HELIOS_VERIFY(vm->sp < ANANAS_VM_STACK_MAX);
+    VM_CHECK(vm->sp < ANANAS_VM_STACK_MAX);
     vm->stack[vm->sp++] = value;
 
     if (IS_ENTITY(value)) {
@@ -121,21 +169,275 @@ static void ReturnEnv(AnanasVM *vm, AnanasVM_Env *env) {
     vm->env_pool = env;
 }
 
-DEFINE_NATIVE_LAMBDA(AnanasPrint) {
+// NOTE: Natives fail by returning the result of this, after popping their arguments.
+static B32 RuntimeError(AnanasVM *vm, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(vm->error, sizeof(vm->error), fmt, args);
+    va_end(args);
+    return 0;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_Print) {
     HELIOS_VERIFY(nargs == 1);
 
     AnanasVM_Value val = Pop(vm);
+    AnanasValue printed = {0};
     if (IS_INT(val)) {
-        S64 i = TO_INT(val);
-        printf(HELIOS_UZ_FMT "\n", i);
+        printed.type = AnanasValueType_Int;
+        printed.u.integer = TO_INT(val);
     } else {
         AnanasGC_Entity *e = TO_ENTITY(val);
-        HELIOS_ASSERT(e->descriptor == STRING_DESCRIPTOR);
-        StringEntity *s = (StringEntity *)e->data;
-        printf("\"" HELIOS_SV_FMT "\"\n", HELIOS_SV_ARG(*s));
+        switch (e->descriptor) {
+        case STRING_DESCRIPTOR: {
+            StringEntity *s = (StringEntity *)e->data;
+            printed.type = AnanasValueType_String;
+            printed.u.string = (HeliosStringView) {.data = s->data, .count = s->count};
+            break;
+        }
+        // NOTE: Only the kind is printed, the same way the evaluator prints these.
+        case TABLE_DESCRIPTOR: printed.type = AnanasValueType_Table; break;
+        case LAMBDA_DESCRIPTOR: printed.type = AnanasValueType_Function; break;
+        default: HELIOS_UNREACHABLE();
+        }
     }
 
+    AnanasPrintStdout(printed);
+
     Push(vm, val);
+    Release(vm, val);
+    return 1;
+}
+
+static AnanasVM_Value MakeString(AnanasVM *vm, HeliosStringView sv) {
+    AnanasGC_Entity *e = AnanasGC_AllocEntity(vm->allocator,
+                                              sizeof(StringEntity) + sv.count + 1,
+                                              STRING_DESCRIPTOR);
+
+    StringEntity *s = (StringEntity *)e->data;
+    s->count = sv.count;
+    memcpy(s->data, sv.data, sv.count);
+    s->data[s->count] = '\0';
+
+    return FROM_ENTITY(e);
+}
+
+static HeliosStringView StringArg(AnanasVM_Value value) {
+    AnanasGC_Entity *e = ENTITY(value);
+    HELIOS_VERIFY(e->descriptor == STRING_DESCRIPTOR);
+
+    StringEntity *s = (StringEntity *)e->data;
+    return (HeliosStringView) {.data = s->data, .count = s->count};
+}
+
+// NOTE: The string natives share their byte-level helpers with the evaluator. The VM has no
+// slices, so the results of `char-at` and `trim` are fresh strings.
+DEFINE_NATIVE_LAMBDA(AnanasVM_StringLength) {
+    HELIOS_VERIFY(nargs == 1);
+
+    AnanasVM_Value string = Pop(vm);
+    Push(vm, FROM_INT(StringArg(string).count));
+    Release(vm, string);
+    return 1;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_IndexOf) {
+    HELIOS_VERIFY(nargs == 2);
+
+    AnanasVM_Value needle = Pop(vm);
+    AnanasVM_Value string = Pop(vm);
+
+    UZ index;
+    B32 found = AnanasStringViewFind(StringArg(string), StringArg(needle), &index);
+    Push(vm, FROM_INT(found ? (SZ)index : -1));
+
+    Release(vm, string);
+    Release(vm, needle);
+    return 1;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_CharAt) {
+    HELIOS_VERIFY(nargs == 2);
+
+    SZ index = INT(Pop(vm));
+    AnanasVM_Value string = Pop(vm);
+
+    HeliosStringView sv = StringArg(string);
+    HELIOS_VERIFY(index >= 0 && (UZ)index < sv.count);
+    Push(vm, MakeString(vm, (HeliosStringView) {.data = sv.data + index, .count = 1}));
+
+    Release(vm, string);
+    return 1;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_StringToInt) {
+    HELIOS_VERIFY(nargs == 1);
+
+    AnanasVM_Value string = Pop(vm);
+
+    S64 integer;
+    B32 parsed = HeliosParseS64DetectBase(StringArg(string), &integer);
+    if (!parsed) {
+        RuntimeError(vm, "'string->int' could not parse \"" HELIOS_SV_FMT "\" as an integer",
+                     HELIOS_SV_ARG(StringArg(string)));
+    } else {
+        Push(vm, FROM_INT(integer));
+    }
+
+    Release(vm, string);
+    return parsed;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_StartsWith) {
+    HELIOS_VERIFY(nargs == 2);
+
+    AnanasVM_Value prefix = Pop(vm);
+    AnanasVM_Value string = Pop(vm);
+
+    Push(vm, FROM_INT(HeliosStringViewStartsWithSV(StringArg(string), StringArg(prefix))));
+
+    Release(vm, string);
+    Release(vm, prefix);
+    return 1;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_Trim) {
+    HELIOS_VERIFY(nargs == 1);
+
+    AnanasVM_Value string = Pop(vm);
+    Push(vm, MakeString(vm, AnanasStringViewTrim(StringArg(string))));
+    Release(vm, string);
+    return 1;
+}
+
+// NOTE: Table keys are ints and strings, strings are hashed and compared by their contents.
+static B32 TableKeyEqual(AnanasVM_Value lhs, AnanasVM_Value rhs) {
+    if (IS_INT(lhs) || IS_INT(rhs)) return lhs == rhs;
+    return HeliosStringViewEqual(StringArg(lhs), StringArg(rhs));
+}
+
+static U64 TableKeyHash(AnanasVM_Value key) {
+    if (IS_INT(key)) return (U64)TO_INT(key);
+    return AnanasFnv1Hash(StringArg(key));
+}
+
+ERMIS_DECL_HASHMAP(AnanasVM_Value, AnanasVM_Value, AnanasVM_TableMap)
+ERMIS_IMPL_HASHMAP(AnanasVM_Value, AnanasVM_Value, AnanasVM_TableMap, TableKeyEqual, TableKeyHash)
+
+// NOTE: A table holds a reference to each of its keys and values, they are released when the
+// entry is replaced or removed and when the table itself is freed.
+typedef struct {
+    AnanasVM_TableMap map;
+} TableEntity;
+
+static AnanasVM_TableMap *TableArg(AnanasVM_Value value) {
+    AnanasGC_Entity *e = ENTITY(value);
+    HELIOS_VERIFY(e->descriptor == TABLE_DESCRIPTOR);
+    return &((TableEntity *)e->data)->map;
+}
+
+static AnanasVM_Value TableKeyArg(AnanasVM_Value value) {
+    if (IS_ENTITY(value)) HELIOS_VERIFY(ENTITY(value)->descriptor == STRING_DESCRIPTOR);
+    return value;
+}
+
+static void FreeTable(AnanasVM *vm, AnanasGC_Entity *e) {
+    AnanasVM_TableMap *map = &((TableEntity *)e->data)->map;
+    ERMIS_HASHMAP_FOREACH(map, key, value, {
+        Release(vm, key);
+        Release(vm, value);
+    })
+
+    AnanasVM_TableMapFree(map);
+}
+
+static AnanasVM_Value MakeTable(AnanasVM *vm) {
+    AnanasGC_Entity *e = AnanasGC_AllocEntity(vm->allocator, sizeof(TableEntity), TABLE_DESCRIPTOR);
+    AnanasVM_TableMapInit(&((TableEntity *)e->data)->map, vm->allocator, 0);
+    return FROM_ENTITY(e);
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_MakeTable) {
+    HELIOS_VERIFY(nargs == 0);
+
+    Push(vm, MakeTable(vm));
+    return 1;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_TableGet) {
+    HELIOS_VERIFY(nargs == 2 || nargs == 3);
+
+    AnanasVM_Value fallback = nargs == 3 ? Pop(vm) : FROM_INT(0);
+    AnanasVM_Value key = TableKeyArg(Pop(vm));
+    AnanasVM_Value table = Pop(vm);
+
+    AnanasVM_Value *value = AnanasVM_TableMapFindPtr(TableArg(table), key);
+    Push(vm, value != NULL ? *value : fallback);
+
+    Release(vm, table);
+    Release(vm, key);
+    Release(vm, fallback);
+    return 1;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_TableSet) {
+    HELIOS_VERIFY(nargs == 3);
+
+    AnanasVM_Value value = Pop(vm);
+    AnanasVM_Value key = TableKeyArg(Pop(vm));
+    AnanasVM_Value table = Pop(vm);
+
+    AnanasVM_TableMap *map = TableArg(table);
+    Retain(value);
+
+    AnanasVM_Value *slot = AnanasVM_TableMapFindPtr(map, key);
+    if (slot != NULL) {
+        Release(vm, *slot);
+        *slot = value;
+    } else {
+        Retain(key);
+        AnanasVM_TableMapInsert(map, key, value);
+    }
+
+    Push(vm, value);
+
+    Release(vm, table);
+    Release(vm, key);
+    Release(vm, value);
+    return 1;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_TableRemove) {
+    HELIOS_VERIFY(nargs == 2);
+
+    AnanasVM_Value key = TableKeyArg(Pop(vm));
+    AnanasVM_Value table = Pop(vm);
+
+    AnanasVM_TableMap *map = TableArg(table);
+
+    AnanasVM_Value *slot = AnanasVM_TableMapFindPtr(map, key);
+    if (slot != NULL) {
+        AnanasVM_Value stored_key = map->keys[slot - map->values];
+        AnanasVM_Value stored_value = *slot;
+        AnanasVM_TableMapRemove(map, key);
+
+        Release(vm, stored_key);
+        Release(vm, stored_value);
+    }
+
+    Push(vm, FROM_INT(slot != NULL));
+
+    Release(vm, table);
+    Release(vm, key);
+    return 1;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_TableCount) {
+    HELIOS_VERIFY(nargs == 1);
+
+    AnanasVM_Value table = Pop(vm);
+    Push(vm, FROM_INT(TableArg(table)->count));
+    Release(vm, table);
     return 1;
 }
 
@@ -170,17 +472,129 @@ static B32 EnvInsert(AnanasVM_Env *env, HeliosStringView name, AnanasVM_Value va
     return AnanasVM_EnvMapInsert(&env->map, name, value);
 }
 
-B32 EnvLookup(AnanasVM_Env *env, HeliosStringView name, AnanasVM_Value *value) {
+static void InvalidateLookupCaches(AnanasVM *vm) {
+    ++vm->lookup_cache_version;
+    AnanasVM_NameSetClear(&vm->cached_globals);
+}
+
+// NOTE: Inline caches only ever point into the root env, so they have to be invalidated
+// when a new local shadows a global some cache points at, or when growing the root map
+// moves its slots. Locals with any other name, parameters included, leave them alone.
+static B32 EnvBind(AnanasVM *vm, AnanasVM_Env *env, HeliosStringView name, AnanasVM_Value value) {
+    UZ root_capacity = vm->root_env->map.capacity;
+
+    B32 inserted = EnvInsert(env, name, value);
+
+    if (vm->root_env->map.capacity != root_capacity) {
+        InvalidateLookupCaches(vm);
+    } else if (inserted && env != vm->root_env && AnanasVM_NameSetFindPtr(&vm->cached_globals, name) != NULL) {
+        InvalidateLookupCaches(vm);
+    }
+
+    return inserted;
+}
+
+static AnanasVM_Value *EnvLookupSlot(AnanasVM_Env *env, HeliosStringView name, AnanasVM_Env **found_env) {
     while (env != NULL) {
-        if (AnanasVM_EnvMapFind(&env->map, name, value)) return 1;
+        AnanasVM_Value *slot = AnanasVM_EnvMapFindPtr(&env->map, name);
+        if (slot != NULL) {
+            *found_env = env;
+            return slot;
+        }
         env = env->parent;
     }
 
-    return 0;
+    return NULL;
+}
+
+static AnanasVM_Value CachedLookup(AnanasVM *vm, AnanasLIR_OpLookup *lop) {
+    if (lop->cache_version == vm->lookup_cache_version) {
+        return *(AnanasVM_Value *)lop->cache_slot;
+    }
+
+    AnanasVM_Env *found_env = NULL;
+    AnanasVM_Value *slot = EnvLookupSlot(vm->env, lop->name, &found_env);
+    HELIOS_VERIFY(slot != NULL);
+
+    if (found_env == vm->root_env) {
+        lop->cache_slot = slot;
+        lop->cache_version = vm->lookup_cache_version;
+        AnanasVM_NameSetInsert(&vm->cached_globals, lop->name, 1);
+    }
+
+    return *slot;
+}
+
+static AnanasVM_RunState *CallLambda(AnanasVM *vm,
+                                     AnanasVM_RunState *rs,
+                                     AnanasVM_Value lam_value,
+                                     U32 args_count) {
+    AnanasGC_Entity *lam_e = ENTITY(lam_value);
+    HELIOS_VERIFY(lam_e->descriptor == LAMBDA_DESCRIPTOR);
+
+    LambdaEntity *lam = (LambdaEntity *)lam_e->data;
+    if (!lam->is_native) {
+        AnanasLIR_CompiledLambda blam = lam->u.bytecode;
+        HELIOS_VERIFY(args_count == blam.params.count);
+
+        UZ frame_base = vm->sp - args_count;
+        HELIOS_VERIFY(frame_base + blam.max_stack_depth <= ANANAS_VM_STACK_MAX);
+
+        AnanasVM_RunState *callee = AllocRunState(vm, rs, blam.bytecode, blam.bytecode_count, rs->module);
+        callee->frame_base = frame_base;
+        return callee;
+    }
+
+    NativeLambda native = lam->u.native;
+    if (!native(vm, args_count)) return NULL;
+    return rs;
+}
+
+static AnanasVM_Value MakeConst(AnanasVM *vm, AnanasValue value) {
+    switch (value.type) {
+    case AnanasValueType_Int: return FROM_INT(value.u.integer);
+    case AnanasValueType_Bool: return FROM_INT(value.u.boolean);
+    case AnanasValueType_String: return MakeString(vm, value.u.string);
+    case AnanasValueType_StringBuilder: return MakeString(vm, value.u.string_builder->string);
+    case AnanasValueType_Function:
+    case AnanasValueType_Macro:
+    case AnanasValueType_Table:
+    case AnanasValueType_HashMap:
+    case AnanasValueType_Vector:
+        HELIOS_UNREACHABLE();
+    default: HELIOS_TODO();
+    }
+}
+
+static AnanasVM_Value MakeLambda(AnanasVM *vm, AnanasLIR_CompiledModule module, U32 index) {
+    HELIOS_VERIFY(index < module.lambdas_count);
+
+    LambdaEntity lam = {0};
+    lam.is_native = 0;
+    lam.u.bytecode = module.lambdas[index];
+
+    AnanasGC_Entity *e = AnanasGC_AllocEntity(vm->allocator,
+                                              sizeof(lam),
+                                              LAMBDA_DESCRIPTOR);
+    memcpy(e->data, &lam, sizeof(lam));
+    return FROM_ENTITY(e);
+}
+
+static void FreeUnreachableEntities(AnanasVM *vm) {
+    for (UZ i = 0; i < vm->unreachable_entities.count; ++i) {
+        AnanasGC_Entity *e = AnanasVM_EntityArrayAt(&vm->unreachable_entities, i);
+        // NOTE: Releasing the contents of a table can add more entities to the array.
+        if (e->descriptor == TABLE_DESCRIPTOR) FreeTable(vm, e);
+        AnanasGC_FreeEntity(vm->allocator, e);
+    }
+
+    vm->unreachable_entities.count = 0;
 }
 
 static B32 Run(AnanasVM *vm, AnanasVM_RunState *rs) {
     while (rs->ip < rs->bytecode_count) {
+        ++vm->ops_executed;
+
         AnanasLIR_Op *op = (AnanasLIR_Op *)(rs->bytecode + rs->ip);
         switch (*op) {
         case AnanasLIR_Op_Add: {
@@ -217,47 +631,21 @@ static B32 Run(AnanasVM *vm, AnanasVM_RunState *rs) {
         }
         case AnanasLIR_Op_Const: {
             AnanasLIR_OpConst *cop = (AnanasLIR_OpConst *)op;
-            switch (cop->value.type) {
-            case AnanasValueType_Int: {
-                S64 i = cop->value.u.integer;
-                Push(vm, FROM_INT(i));
-                break;
-            }
-            case AnanasValueType_String: {
-                HeliosStringView sv = cop->value.u.string;
-                AnanasGC_Entity *e = AnanasGC_AllocEntity(vm->allocator,
-                                                          sizeof(StringEntity) + sv.count + 1,
-                                                          STRING_DESCRIPTOR);
-
-                StringEntity *s = (StringEntity *)e->data;
-                s->count = sv.count;
-                memcpy(s->data, sv.data, sv.count);
-                s->data[s->count] = '\0';
-
-                Push(vm, FROM_ENTITY(e));
-                break;
-            }
-            case AnanasValueType_Function:
-            case AnanasValueType_Macro:
-                HELIOS_UNREACHABLE();
-            default: HELIOS_TODO();
-            }
-
+            Push(vm, MakeConst(vm, cop->value));
             rs->ip += sizeof(*cop);
             break;
         }
         case AnanasLIR_Op_Define: {
             AnanasLIR_OpDefine *dop = (AnanasLIR_OpDefine *)op;
             AnanasVM_Value value = Pop(vm);
-            EnvInsert(vm->env, dop->name, value);
+            EnvBind(vm, vm->env, dop->name, value);
             Release(vm, value);
             rs->ip += sizeof(*dop);
             break;
         }
         case AnanasLIR_Op_Lookup: {
             AnanasLIR_OpLookup *lop = (AnanasLIR_OpLookup *)op;
-            AnanasVM_Value value;
-            HELIOS_VERIFY(EnvLookup(vm->env, lop->name, &value));
+            AnanasVM_Value value = CachedLookup(vm, lop);
             Push(vm, value);
             rs->ip += sizeof(*lop);
             break;
@@ -265,7 +653,7 @@ static B32 Run(AnanasVM *vm, AnanasVM_RunState *rs) {
         case AnanasLIR_Op_Update: {
             AnanasLIR_OpUpdate *uop = (AnanasLIR_OpUpdate *)op;
             AnanasVM_Value value = Pop(vm);
-            HELIOS_VERIFY(!EnvInsert(vm->env, uop->name, value));
+            HELIOS_VERIFY(!EnvBind(vm, vm->env, uop->name, value));
             Release(vm, value);
             rs->ip += sizeof(*uop);
             break;
@@ -304,25 +692,21 @@ static B32 Run(AnanasVM *vm, AnanasVM_RunState *rs) {
         }
         case AnanasLIR_Op_LoadLambda: {
             AnanasLIR_OpLoadLambda *lop = (AnanasLIR_OpLoadLambda *)op;
-
-            HELIOS_VERIFY(lop->index < rs->module.lambdas_count);
-
-            LambdaEntity lam = {0};
-            lam.is_native = 0;
-            lam.u.bytecode = rs->module.lambdas[lop->index];
-
-            AnanasGC_Entity *e = AnanasGC_AllocEntity(vm->allocator,
-                                                      sizeof(lam),
-                                                      LAMBDA_DESCRIPTOR);
-            memcpy(e->data, &lam, sizeof(lam));
-            Push(vm, FROM_ENTITY(e));
+            Push(vm, MakeLambda(vm, rs->module, lop->index));
 
             rs->ip += sizeof(*lop);
             break;
         }
         case AnanasLIR_Op_Return: {
-            // TODO(oleh): Push false if the callee did not push anything.
             HELIOS_VERIFY(rs->parent != NULL);
+
+            // NOTE: Leave exactly one value for the caller. The stack values keep their
+            // references, so the result is moved back without retaining it again.
+            AnanasVM_Value result = FROM_INT(0);
+            if (vm->sp > rs->frame_base) result = Pop(vm);
+            while (vm->sp > rs->frame_base) Release(vm, Pop(vm));
+            vm->stack[vm->sp++] = result;
+
             AnanasVM_RunState *prev_rs = rs;
             rs = prev_rs->parent;
             ReturnRunState(vm, prev_rs);
@@ -332,42 +716,635 @@ static B32 Run(AnanasVM *vm, AnanasVM_RunState *rs) {
             AnanasLIR_OpCall *cop = (AnanasLIR_OpCall *)op;
 
             AnanasVM_Value lam_value = Pop(vm);
-            AnanasGC_Entity *lam_e = ENTITY(lam_value);
-            HELIOS_VERIFY(lam_e->descriptor == LAMBDA_DESCRIPTOR);
+
+            rs->ip += sizeof(*cop);
+            rs = CallLambda(vm, rs, lam_value, cop->args_count);
 
             Release(vm, lam_value);
+            if (rs == NULL) return 0;
+            break;
+        }
+        case AnanasLIR_Op_LookupCall: {
+            AnanasLIR_OpLookupCall *lcop = (AnanasLIR_OpLookupCall *)op;
+
+            // NOTE: The callee never touches the stack, so there is no need to retain it.
+            AnanasVM_Value lam_value = CachedLookup(vm, &lcop->lookup);
+
+            rs->ip += sizeof(*lcop);
+            rs = CallLambda(vm, rs, lam_value, lcop->args_count);
+            if (rs == NULL) return 0;
+            break;
+        }
+        case AnanasLIR_Op_AddInt: {
+            SZ rhs = UNCHECKED_INT(Pop(vm));
+            SZ lhs = UNCHECKED_INT(Pop(vm));
+            Push(vm, FROM_INT(lhs + rhs));
+            rs->ip += sizeof(*op);
+            break;
+        }
+        case AnanasLIR_Op_SubInt: {
+            SZ rhs = UNCHECKED_INT(Pop(vm));
+            SZ lhs = UNCHECKED_INT(Pop(vm));
+            Push(vm, FROM_INT(lhs - rhs));
+            rs->ip += sizeof(*op);
+            break;
+        }
+        case AnanasLIR_Op_MulInt: {
+            SZ rhs = UNCHECKED_INT(Pop(vm));
+            SZ lhs = UNCHECKED_INT(Pop(vm));
+            Push(vm, FROM_INT(lhs * rhs));
+            rs->ip += sizeof(*op);
+            break;
+        }
+        case AnanasLIR_Op_RemInt: {
+            SZ rhs = UNCHECKED_INT(Pop(vm));
+            SZ lhs = UNCHECKED_INT(Pop(vm));
+            Push(vm, FROM_INT(lhs % rhs));
+            rs->ip += sizeof(*op);
+            break;
+        }
+        case AnanasLIR_Op_AddConst: {
+            AnanasLIR_OpAddConst *aop = (AnanasLIR_OpAddConst *)op;
+            SZ lhs = INT(Pop(vm));
+            SZ result = lhs + aop->value;
+            Push(vm, FROM_INT(result));
+            rs->ip += sizeof(*aop);
+            break;
+        }
+        }
+
+        FreeUnreachableEntities(vm);
+    }
+
+    return 1;
+}
+
+B32 AnanasVM_ExecModule(AnanasVM *vm, AnanasLIR_CompiledModule module) {
+    HELIOS_VERIFY(module.verified);
+    HELIOS_VERIFY(vm->sp + module.max_stack_depth <= ANANAS_VM_STACK_MAX);
+
+    AnanasVM_RunState rs = {0};
+    RunStateInit(&rs, NULL, module.bytecode, module.bytecode_count, module);
+    rs.frame_base = vm->sp;
 
+    vm->module = module;
+    vm->registers_mode = 0;
+
+    AnanasVM_Env *env = vm->env;
+    B32 ok = Run(vm, &rs);
+
+    // NOTE: A failed run leaves its frames and scopes behind, they are dropped here.
+    if (!ok) vm->env = env;
+    while (vm->sp > rs.frame_base) Release(vm, Pop(vm));
+    FreeUnreachableEntities(vm);
+    return ok;
+}
+
+static void SetRegister(AnanasVM *vm, AnanasVM_Value *registers, AnanasLIR_Reg reg, AnanasVM_Value value) {
+    Retain(value);
+    Release(vm, registers[reg]);
+    registers[reg] = value;
+}
+
+static AnanasVM_Value *AllocRegisters(AnanasVM *vm, U32 count) {
+    HELIOS_VERIFY(vm->registers_top + count <= ANANAS_VM_STACK_MAX);
+
+    AnanasVM_Value *registers = vm->registers + vm->registers_top;
+    for (U32 i = 0; i < count; ++i) {
+        registers[i] = FROM_INT(0);
+    }
+
+    vm->registers_top += count;
+    return registers;
+}
+
+static void FreeRegisters(AnanasVM *vm, AnanasVM_Value *registers, U32 count) {
+    HELIOS_VERIFY(registers + count == vm->registers + vm->registers_top);
+
+    for (U32 i = 0; i < count; ++i) {
+        Release(vm, registers[i]);
+    }
+
+    vm->registers_top -= count;
+}
+
+// NOTE: Bytecode lambdas get a fresh frame with the arguments in the first registers,
+// natives still take their arguments on the stack and leave the result there.
+static AnanasVM_RunState *CallLambdaReg(AnanasVM *vm,
+                                        AnanasVM_RunState *rs,
+                                        AnanasVM_Value lam_value,
+                                        AnanasLIR_Reg dst,
+                                        AnanasLIR_Reg *args,
+                                        U16 args_count) {
+    AnanasGC_Entity *lam_e = ENTITY(lam_value);
+    HELIOS_VERIFY(lam_e->descriptor == LAMBDA_DESCRIPTOR);
+
+    LambdaEntity *lam = (LambdaEntity *)lam_e->data;
+    if (!lam->is_native) {
+        AnanasLIR_CompiledLambda blam = lam->u.bytecode;
+        HELIOS_VERIFY(args_count == blam.params.count);
+        HELIOS_VERIFY(args_count <= blam.registers_count);
+
+        AnanasVM_Value *registers = AllocRegisters(vm, blam.registers_count);
+        for (U16 i = 0; i < args_count; ++i) {
+            SetRegister(vm, registers, i, rs->registers[args[i]]);
+        }
+
+        AnanasVM_RunState *callee = AllocRunState(vm, rs, blam.bytecode, blam.bytecode_count, rs->module);
+        callee->registers = registers;
+        callee->registers_count = blam.registers_count;
+        callee->return_register = dst;
+        return callee;
+    }
+
+    HELIOS_VERIFY(vm->sp + args_count < ANANAS_VM_STACK_MAX);
+    for (U16 i = 0; i < args_count; ++i) {
+        Push(vm, rs->registers[args[i]]);
+    }
+
+    NativeLambda native = lam->u.native;
+    if (!native(vm, args_count)) return NULL;
+
+    AnanasVM_Value result = Pop(vm);
+    SetRegister(vm, rs->registers, dst, result);
+    Release(vm, result);
+    return rs;
+}
+
+static B32 RunReg(AnanasVM *vm, AnanasVM_RunState *rs) {
+    while (rs->ip < rs->bytecode_count) {
+        ++vm->ops_executed;
+
+        U8 *bytes = rs->bytecode + rs->ip;
+        AnanasVM_Value *regs = rs->registers;
+
+        AnanasLIR_RegOp op = *(AnanasLIR_RegOp *)bytes;
+        switch (op) {
+        case AnanasLIR_RegOp_LoadConst: {
+            AnanasLIR_RegOpLoadConst *cop = (AnanasLIR_RegOpLoadConst *)bytes;
+            SetRegister(vm, regs, cop->dst, MakeConst(vm, cop->value));
             rs->ip += sizeof(*cop);
+            break;
+        }
+        case AnanasLIR_RegOp_Move: {
+            AnanasLIR_RegOpMove *mop = (AnanasLIR_RegOpMove *)bytes;
+            SetRegister(vm, regs, mop->dst, regs[mop->src]);
+            rs->ip += sizeof(*mop);
+            break;
+        }
+        case AnanasLIR_RegOp_Add:
+        case AnanasLIR_RegOp_Sub:
+        case AnanasLIR_RegOp_Mul:
+        case AnanasLIR_RegOp_Rem: {
+            AnanasLIR_RegOpBinary *bop = (AnanasLIR_RegOpBinary *)bytes;
+            SZ lhs = INT(regs[bop->lhs]);
+            SZ rhs = INT(regs[bop->rhs]);
 
-            LambdaEntity *lam = (LambdaEntity *)lam_e->data;
-            if (!lam->is_native) {
-                AnanasLIR_CompiledLambda blam = lam->u.bytecode;
-                AnanasVM_RunState *new_rs = AllocRunState(vm, rs, blam.bytecode, blam.bytecode_count, rs->module);
-                rs = new_rs;
-            } else {
-                NativeLambda native = lam->u.native;
-                native(vm, cop->args_count);
+            SZ result;
+            switch (op) {
+            case AnanasLIR_RegOp_Add: result = lhs + rhs; break;
+            case AnanasLIR_RegOp_Sub: result = lhs - rhs; break;
+            case AnanasLIR_RegOp_Mul: result = lhs * rhs; break;
+            default:                  result = lhs % rhs; break;
             }
 
+            SetRegister(vm, regs, bop->dst, FROM_INT(result));
+            rs->ip += sizeof(*bop);
             break;
         }
+        case AnanasLIR_RegOp_AddImm: {
+            AnanasLIR_RegOpAddImm *aop = (AnanasLIR_RegOpAddImm *)bytes;
+            SZ result = INT(regs[aop->src]) + aop->value;
+            SetRegister(vm, regs, aop->dst, FROM_INT(result));
+            rs->ip += sizeof(*aop);
+            break;
         }
+        case AnanasLIR_RegOp_Define: {
+            AnanasLIR_RegOpBind *dop = (AnanasLIR_RegOpBind *)bytes;
+            EnvBind(vm, vm->env, dop->name, regs[dop->src]);
+            rs->ip += sizeof(*dop);
+            break;
+        }
+        case AnanasLIR_RegOp_Update: {
+            AnanasLIR_RegOpBind *uop = (AnanasLIR_RegOpBind *)bytes;
+            HELIOS_VERIFY(!EnvBind(vm, vm->env, uop->name, regs[uop->src]));
+            rs->ip += sizeof(*uop);
+            break;
+        }
+        case AnanasLIR_RegOp_Lookup: {
+            AnanasLIR_RegOpLookup *lop = (AnanasLIR_RegOpLookup *)bytes;
+            SetRegister(vm, regs, lop->dst, CachedLookup(vm, &lop->lookup));
+            rs->ip += sizeof(*lop);
+            break;
+        }
+        case AnanasLIR_RegOp_LookupCall: {
+            AnanasLIR_RegOpLookupCall *lcop = (AnanasLIR_RegOpLookupCall *)bytes;
+            AnanasVM_Value lam_value = CachedLookup(vm, &lcop->lookup);
 
-        for (UZ i = 0; i < vm->unreachable_entities.count; ++i) {
-            AnanasGC_Entity *e = AnanasVM_EntityArrayAt(&vm->unreachable_entities, i);
-            AnanasGC_FreeEntity(vm->allocator, e);
+            rs->ip += AnanasLIR_RegOpSize(bytes);
+            rs = CallLambdaReg(vm, rs, lam_value, lcop->dst, (AnanasLIR_Reg *)(lcop + 1), lcop->args_count);
+            if (rs == NULL) return 0;
+            break;
         }
+        case AnanasLIR_RegOp_Call: {
+            AnanasLIR_RegOpCall *cop = (AnanasLIR_RegOpCall *)bytes;
 
-        vm->unreachable_entities.count = 0;
+            // NOTE: The callee register may be overwritten by the call, keep the lambda alive.
+            AnanasVM_Value lam_value = regs[cop->callee];
+            Retain(lam_value);
+
+            rs->ip += AnanasLIR_RegOpSize(bytes);
+            rs = CallLambdaReg(vm, rs, lam_value, cop->dst, (AnanasLIR_Reg *)(cop + 1), cop->args_count);
+
+            Release(vm, lam_value);
+            if (rs == NULL) return 0;
+            break;
+        }
+        case AnanasLIR_RegOp_Return: {
+            AnanasLIR_RegOpReturn *rop = (AnanasLIR_RegOpReturn *)bytes;
+            HELIOS_VERIFY(rs->parent != NULL);
+
+            AnanasVM_Value result = regs[rop->src];
+            Retain(result);
+
+            FreeRegisters(vm, rs->registers, rs->registers_count);
+
+            AnanasVM_RunState *prev_rs = rs;
+            rs = prev_rs->parent;
+            SetRegister(vm, rs->registers, prev_rs->return_register, result);
+            Release(vm, result);
+
+            ReturnRunState(vm, prev_rs);
+            break;
+        }
+        case AnanasLIR_RegOp_PushScope: {
+            AnanasVM_Env *env = AllocEnv(vm);
+            env->parent = vm->env;
+            vm->env = env;
+            rs->ip += sizeof(op);
+            break;
+        }
+        case AnanasLIR_RegOp_PopScope: {
+            HELIOS_VERIFY(vm->env != NULL);
+            AnanasVM_Env *env = vm->env;
+            vm->env = vm->env->parent;
+            ReturnEnv(vm, env);
+            rs->ip += sizeof(op);
+            break;
+        }
+        case AnanasLIR_RegOp_CondJmp: {
+            AnanasLIR_RegOpCondJmp *jop = (AnanasLIR_RegOpCondJmp *)bytes;
+            if (ValueToBool(regs[jop->cond])) {
+                rs->ip = jop->ip;
+            } else {
+                rs->ip += sizeof(*jop);
+            }
+            break;
+        }
+        case AnanasLIR_RegOp_Jmp: {
+            AnanasLIR_RegOpJmp *jop = (AnanasLIR_RegOpJmp *)bytes;
+            rs->ip = jop->ip;
+            break;
+        }
+        case AnanasLIR_RegOp_LoadLambda: {
+            AnanasLIR_RegOpLoadLambda *lop = (AnanasLIR_RegOpLoadLambda *)bytes;
+            SetRegister(vm, regs, lop->dst, MakeLambda(vm, rs->module, lop->index));
+            rs->ip += sizeof(*lop);
+            break;
+        }
+        }
+
+        FreeUnreachableEntities(vm);
     }
 
     return 1;
 }
 
-B32 AnanasVM_ExecModule(AnanasVM *vm, AnanasLIR_CompiledModule module) {
+// NOTE: Lets a native call a lambda once per item. The lambda runs in a nested loop under a
+// run state without any bytecode, the loop stops as soon as the lambda returns to it. In the
+// register mode the frame also owns the registers the arguments are passed in, which are
+// allocated once and overwritten by every call.
+typedef struct {
+    AnanasVM_RunState rs;
+    AnanasVM_Value lam;
+    U16 args_count;
+} NativeCallFrame;
+
+#define NATIVE_CALL_MAX_ARGS 3
+
+static void NativeCallFrameInit(AnanasVM *vm, NativeCallFrame *frame, AnanasVM_Value lam, U16 args_count) {
+    HELIOS_VERIFY(args_count <= NATIVE_CALL_MAX_ARGS);
+    HELIOS_VERIFY(ENTITY(lam)->descriptor == LAMBDA_DESCRIPTOR);
+
+    RunStateInit(&frame->rs, NULL, NULL, 0, vm->module);
+    frame->lam = lam;
+    frame->args_count = args_count;
+
+    if (vm->registers_mode) {
+        // NOTE: Register 0 receives the result, the arguments follow it.
+        frame->rs.registers = AllocRegisters(vm, args_count + 1);
+        frame->rs.registers_count = args_count + 1;
+    }
+}
+
+static void NativeCallFrameFree(AnanasVM *vm, NativeCallFrame *frame) {
+    if (vm->registers_mode) FreeRegisters(vm, frame->rs.registers, frame->rs.registers_count);
+}
+
+// NOTE: The caller owns the value stored in `result` and has to release it.
+static B32 NativeCallFrameCall(AnanasVM *vm, NativeCallFrame *frame, AnanasVM_Value *args, AnanasVM_Value *result) {
+    if (vm->registers_mode) {
+        AnanasLIR_Reg args_registers[NATIVE_CALL_MAX_ARGS] = {1, 2, 3};
+
+        for (U16 i = 0; i < frame->args_count; ++i) {
+            SetRegister(vm, frame->rs.registers, args_registers[i], args[i]);
+        }
+
+        AnanasVM_RunState *callee = CallLambdaReg(vm, &frame->rs, frame->lam, 0, args_registers, frame->args_count);
+        if (callee == NULL) return 0;
+        if (callee != &frame->rs && !RunReg(vm, callee)) return 0;
+
+        *result = frame->rs.registers[0];
+        Retain(*result);
+        return 1;
+    }
+
+    HELIOS_VERIFY(vm->sp + frame->args_count < ANANAS_VM_STACK_MAX);
+    for (U16 i = 0; i < frame->args_count; ++i) {
+        Push(vm, args[i]);
+    }
+
+    AnanasVM_RunState *callee = CallLambda(vm, &frame->rs, frame->lam, frame->args_count);
+    if (callee == NULL) return 0;
+    if (callee != &frame->rs && !Run(vm, callee)) return 0;
+
+    *result = Pop(vm);
+    return 1;
+}
+
+// NOTE: The only sequence the VM has is the table, so the lambda gets the key and the value
+// of each entry. The lambda may change the table while it is being walked, which can rehash
+// it, so the walk holds a reference to each key the table had at the start. The keys removed
+// since are skipped, the rest come with their current value.
+typedef struct {
+    AnanasVM_TableMap *map;
+    AnanasVM_Value *keys;
+    UZ keys_count;
+    UZ index;
+} TableWalk;
+
+static void TableWalkInit(AnanasVM *vm, TableWalk *walk, AnanasVM_TableMap *map) {
+    walk->map = map;
+    walk->keys = HeliosAlloc(vm->allocator, map->count * sizeof(*walk->keys));
+    walk->keys_count = 0;
+    walk->index = 0;
+
+    ERMIS_HASHMAP_FOREACH(map, key, value, {
+        (void) value;
+        Retain(key);
+        walk->keys[walk->keys_count++] = key;
+    })
+}
+
+// NOTE: The entry is retained until the caller releases it.
+static B32 TableWalkNext(TableWalk *walk, AnanasVM_Value *entry) {
+    while (walk->index < walk->keys_count) {
+        AnanasVM_Value key = walk->keys[walk->index++];
+        AnanasVM_Value *value = AnanasVM_TableMapFindPtr(walk->map, key);
+        if (value != NULL) {
+            entry[0] = key;
+            entry[1] = *value;
+            Retain(entry[0]);
+            Retain(entry[1]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void TableWalkFree(AnanasVM *vm, TableWalk *walk) {
+    for (UZ i = 0; i < walk->keys_count; ++i) {
+        Release(vm, walk->keys[i]);
+    }
+
+    HeliosFree(vm->allocator, walk->keys, walk->keys_count * sizeof(*walk->keys));
+}
+
+static const char *ValueTypeName(AnanasVM_Value value) {
+    if (IS_INT(value)) return "int";
+
+    switch (TO_ENTITY(value)->descriptor) {
+    case STRING_DESCRIPTOR: return "string";
+    case TABLE_DESCRIPTOR: return "table";
+    case LAMBDA_DESCRIPTOR: return "function";
+    default: HELIOS_UNREACHABLE();
+    }
+}
+
+// NOTE: There are no lists or vectors in the VM, a sequence of any other type than the table
+// is a runtime error rather than an abort.
+static B32 CheckSequenceArgs(AnanasVM *vm, const char *name, AnanasVM_Value lam, AnanasVM_Value table) {
+    if (IS_INT(lam) || TO_ENTITY(lam)->descriptor != LAMBDA_DESCRIPTOR) {
+        return RuntimeError(vm, "'%s' expected a function, got a value of type %s instead", name, ValueTypeName(lam));
+    }
+
+    if (IS_INT(table) || TO_ENTITY(table)->descriptor != TABLE_DESCRIPTOR) {
+        return RuntimeError(vm, "'%s' expected a table, got a value of type %s instead", name, ValueTypeName(table));
+    }
+
+    return 1;
+}
+
+// NOTE: Takes over the reference to the value.
+static void TableInsertNew(AnanasVM_TableMap *map, AnanasVM_Value key, AnanasVM_Value value) {
+    Retain(key);
+    AnanasVM_TableMapInsert(map, key, value);
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_Map) {
+    HELIOS_VERIFY(nargs == 2);
+
+    AnanasVM_Value table = Pop(vm);
+    AnanasVM_Value lam = Pop(vm);
+
+    B32 ok = CheckSequenceArgs(vm, "map", lam, table);
+    if (ok) {
+        AnanasVM_Value mapped = MakeTable(vm);
+        AnanasVM_TableMap *mapped_map = TableArg(mapped);
+
+        NativeCallFrame frame;
+        NativeCallFrameInit(vm, &frame, lam, 2);
+
+        TableWalk walk;
+        TableWalkInit(vm, &walk, TableArg(table));
+
+        AnanasVM_Value entry[2];
+        while (ok && TableWalkNext(&walk, entry)) {
+            AnanasVM_Value value;
+            ok = NativeCallFrameCall(vm, &frame, entry, &value);
+            if (ok) TableInsertNew(mapped_map, entry[0], value);
+            Release(vm, entry[0]);
+            Release(vm, entry[1]);
+        }
+
+        TableWalkFree(vm, &walk);
+
+        if (ok) {
+            NativeCallFrameFree(vm, &frame);
+            Push(vm, mapped);
+        } else {
+            // NOTE: The new table is not referenced yet, retaining it lets the release free it.
+            Retain(mapped);
+            Release(vm, mapped);
+        }
+    }
+
+    Release(vm, table);
+    Release(vm, lam);
+    return ok;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_Filter) {
+    HELIOS_VERIFY(nargs == 2);
+
+    AnanasVM_Value table = Pop(vm);
+    AnanasVM_Value lam = Pop(vm);
+
+    B32 ok = CheckSequenceArgs(vm, "filter", lam, table);
+    if (ok) {
+        AnanasVM_Value kept = MakeTable(vm);
+        AnanasVM_TableMap *kept_map = TableArg(kept);
+
+        NativeCallFrame frame;
+        NativeCallFrameInit(vm, &frame, lam, 2);
+
+        TableWalk walk;
+        TableWalkInit(vm, &walk, TableArg(table));
+
+        AnanasVM_Value entry[2];
+        while (ok && TableWalkNext(&walk, entry)) {
+            AnanasVM_Value keep;
+            ok = NativeCallFrameCall(vm, &frame, entry, &keep);
+            if (ok && ValueToBool(keep)) {
+                Retain(entry[1]);
+                TableInsertNew(kept_map, entry[0], entry[1]);
+            }
+            if (ok) Release(vm, keep);
+            Release(vm, entry[0]);
+            Release(vm, entry[1]);
+        }
+
+        TableWalkFree(vm, &walk);
+
+        if (ok) {
+            NativeCallFrameFree(vm, &frame);
+            Push(vm, kept);
+        } else {
+            Retain(kept);
+            Release(vm, kept);
+        }
+    }
+
+    Release(vm, table);
+    Release(vm, lam);
+    return ok;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_Fold) {
+    HELIOS_VERIFY(nargs == 3);
+
+    AnanasVM_Value table = Pop(vm);
+    AnanasVM_Value acc = Pop(vm);
+    AnanasVM_Value lam = Pop(vm);
+
+    B32 ok = CheckSequenceArgs(vm, "fold", lam, table);
+    if (ok) {
+        NativeCallFrame frame;
+        NativeCallFrameInit(vm, &frame, lam, 3);
+
+        TableWalk walk;
+        TableWalkInit(vm, &walk, TableArg(table));
+
+        AnanasVM_Value call_args[3];
+        while (ok && TableWalkNext(&walk, call_args + 1)) {
+            call_args[0] = acc;
+            ok = NativeCallFrameCall(vm, &frame, call_args, &acc);
+            Release(vm, call_args[0]);
+            Release(vm, call_args[1]);
+            Release(vm, call_args[2]);
+        }
+
+        TableWalkFree(vm, &walk);
+
+        if (ok) {
+            NativeCallFrameFree(vm, &frame);
+            Push(vm, acc);
+            Release(vm, acc);
+        }
+    } else {
+        Release(vm, acc);
+    }
+
+    Release(vm, table);
+    Release(vm, lam);
+    return ok;
+}
+
+DEFINE_NATIVE_LAMBDA(AnanasVM_ForEach) {
+    HELIOS_VERIFY(nargs == 2);
+
+    AnanasVM_Value table = Pop(vm);
+    AnanasVM_Value lam = Pop(vm);
+
+    B32 ok = CheckSequenceArgs(vm, "for-each", lam, table);
+    if (ok) {
+        NativeCallFrame frame;
+        NativeCallFrameInit(vm, &frame, lam, 2);
+
+        TableWalk walk;
+        TableWalkInit(vm, &walk, TableArg(table));
+
+        AnanasVM_Value entry[2];
+        while (ok && TableWalkNext(&walk, entry)) {
+            AnanasVM_Value value;
+            ok = NativeCallFrameCall(vm, &frame, entry, &value);
+            if (ok) Release(vm, value);
+            Release(vm, entry[0]);
+            Release(vm, entry[1]);
+        }
+
+        TableWalkFree(vm, &walk);
+
+        if (ok) {
+            NativeCallFrameFree(vm, &frame);
+            Push(vm, FROM_INT(0));
+        }
+    }
+
+    Release(vm, table);
+    Release(vm, lam);
+    return ok;
+}
+
+B32 AnanasVM_ExecRegModule(AnanasVM *vm, AnanasLIR_CompiledModule module) {
     AnanasVM_RunState rs = {0};
     RunStateInit(&rs, NULL, module.bytecode, module.bytecode_count, module);
-    return Run(vm, &rs);
+    rs.registers = AllocRegisters(vm, module.registers_count);
+    rs.registers_count = module.registers_count;
+
+    vm->module = module;
+    vm->registers_mode = 1;
+
+    UZ sp = vm->sp;
+    B32 ok = RunReg(vm, &rs);
+
+    // NOTE: A failed run leaves its frames behind, their registers are dropped here.
+    if (!ok) vm->registers_top = (rs.registers - vm->registers) + rs.registers_count;
+    while (vm->sp > sp) Release(vm, Pop(vm));
+    FreeRegisters(vm, rs.registers, rs.registers_count);
+    FreeUnreachableEntities(vm);
+    return ok;
 }
 
 static void EnvInitRoot(AnanasVM_Env *env, HeliosAllocator allocator) {
@@ -393,9 +1370,19 @@ void AnanasVM_Init(AnanasVM *vm, HeliosAllocator allocator) {
     vm->stack = HeliosAlloc(allocator, sizeof(*vm->stack) * ANANAS_VM_STACK_MAX);
     vm->sp = 0;
 
+    vm->registers = HeliosAlloc(allocator, sizeof(*vm->registers) * ANANAS_VM_STACK_MAX);
+    vm->registers_top = 0;
+    vm->ops_executed = 0;
+    vm->registers_mode = 0;
+
     vm->env_pool = NULL;
     vm->env = HeliosAlloc(allocator, sizeof(*vm->env));
     EnvInitRoot(vm->env, allocator);
+    vm->root_env = vm->env;
+
+    // NOTE: Version 0 marks an empty inline cache.
+    vm->lookup_cache_version = 1;
+    AnanasVM_NameSetInit(&vm->cached_globals, allocator, 64);
 
     vm->rs_pool = NULL;
     AnanasVM_EntityArrayInit(&vm->unreachable_entities, allocator, 10);
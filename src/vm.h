@@ -6,11 +6,14 @@
 
 #define ANANAS_VM_STACK_MAX (1024 * 1024 / sizeof(AnanasVM_Value))
 
+#define ANANAS_VM_ERROR_MAX 256
+
 typedef UZ AnanasVM_Value;
 
 _Static_assert(sizeof(AnanasVM_Value) == sizeof(void *), "size of value should be equal to size of machine word");
 
 ERMIS_DECL_HASHMAP(HeliosStringView, AnanasVM_Value, AnanasVM_EnvMap)
+ERMIS_DECL_HASHMAP(HeliosStringView, B32, AnanasVM_NameSet)
 
 typedef struct AnanasVM_Env {
     struct AnanasVM_Env *parent;
@@ -23,10 +26,18 @@ typedef struct AnanasVM_RunState {
     struct AnanasVM_RunState *parent;
     UZ ip;
 
+    // NOTE: Stack pointer at the entry of the frame, arguments excluded.
+    UZ frame_base;
+
     U8 *bytecode;
     UZ bytecode_count;
 
     AnanasLIR_CompiledModule module;
+
+    // NOTE: Only used when running register bytecode.
+    AnanasVM_Value *registers;
+    U32 registers_count;
+    AnanasLIR_Reg return_register;
 } AnanasVM_RunState;
 
 typedef struct {
@@ -35,16 +46,35 @@ typedef struct {
     AnanasVM_Value *stack;
     UZ sp;
 
+    AnanasVM_Value *registers;
+    UZ registers_top;
+
     AnanasVM_Env *env;
+    AnanasVM_Env *root_env;
     AnanasVM_Env *env_pool;
 
+    UZ lookup_cache_version;
+    // NOTE: Names of the globals some inline cache points at since the last invalidation.
+    AnanasVM_NameSet cached_globals;
+
     AnanasVM_RunState *rs_pool;
 
     AnanasVM_EntityArray unreachable_entities;
+
+    // NOTE: What natives need to run a lambda of the module being executed, see `NativeCallFrame`.
+    AnanasLIR_CompiledModule module;
+    B32 registers_mode;
+
+    UZ ops_executed;
+
+    // NOTE: Set by a native that fails, the run stops there and the exec function returns 0.
+    char error[ANANAS_VM_ERROR_MAX];
 } AnanasVM;
 
 void AnanasVM_Init(AnanasVM *, HeliosAllocator);
 
 B32 AnanasVM_ExecModule(AnanasVM *vm, AnanasLIR_CompiledModule module);
 
+B32 AnanasVM_ExecRegModule(AnanasVM *vm, AnanasLIR_CompiledModule module);
+
 #endif // ANANAS_VM_H_